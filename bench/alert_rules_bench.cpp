@@ -0,0 +1,132 @@
+// Times compiled alert rules (common/alert_rules.hpp) per satellite poll
+// against the hard-coded json eval_alerts the controlplane used to run, and
+// with rule sets of increasing size.
+//
+//   alert_rules_bench [polls]      default: 200000
+//
+// Exits non-zero if the default rule set raises different alerts from the old
+// evaluator on any poll.
+#include <nlohmann/json.hpp>
+
+#include "common/alert_rules.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+using json = nlohmann::json;
+
+// The evaluator the controlplane shipped with, for comparison.
+static json legacy_eval(const json& metrics) {
+    json alerts = json::array();
+    if (!metrics.contains("ok") || !metrics["ok"].is_boolean() || !metrics["ok"].get<bool>()) {
+        alerts.push_back({{"severity","HIGH"},{"type","AGGREGATOR_ERROR"},{"message","metrics not ok"}});
+        return alerts;
+    }
+    if (metrics.value("count", 0) == 0) return alerts;
+    double p95 = metrics.value("latency_p95_ms", 0.0);
+    double dr = metrics.value("drop_rate", 0.0);
+    double lq = metrics.value("avg_link_quality", 0.0);
+    if (p95 > 200.0) alerts.push_back({{"severity","MED"},{"type","LATENCY_P95"},{"value",p95},{"threshold",200.0}});
+    if (dr > 0.05) alerts.push_back({{"severity","HIGH"},{"type","DROP_RATE"},{"value",dr},{"threshold",0.05}});
+    if (lq < 0.7) alerts.push_back({{"severity","MED"},{"type","LINK_QUALITY"},{"value",lq},{"threshold",0.7}});
+    return alerts;
+}
+
+static const json kDefaultRules = json::parse(R"([
+  {"name":"LATENCY_P95","severity":"MED","when":"latency_p95_ms > 200.0 && count > 0"},
+  {"name":"DROP_RATE","severity":"HIGH","when":"drop_rate > 0.05 && count > 0"},
+  {"name":"LINK_QUALITY","severity":"MED","when":"avg_link_quality < 0.7 && count > 0"}
+])");
+
+// n rules over every metric, a third of them group-scoped and a fifth with a
+// "for N cycles" clause.
+static json random_rules(std::size_t n, std::mt19937_64& rng) {
+    static const char* metrics[] = {"count", "drop_rate", "latency_p50_ms", "latency_p95_ms", "latency_p99_ms", "avg_link_quality"};
+    static const char* ops[] = {">", ">=", "<", "<=", "!="};
+    std::uniform_real_distribution<double> k(0.0, 400.0);
+    json rules = json::array();
+    for (std::size_t i = 0; i < n; i++) {
+        auto cmp = [&] { return std::string(metrics[rng() % 6]) + " " + ops[rng() % 5] + " " + std::to_string(k(rng)); };
+        std::string when = cmp() + " && " + cmp() + " && (" + cmp() + " || !(" + cmp() + "))";
+        if (i % 5 == 0) when += " for 3 cycles";
+        json r = {{"name", "RULE_" + std::to_string(i)}, {"when", when}};
+        if (i % 3 == 0) r["group"] = "g" + std::to_string(rng() % 8);
+        rules.push_back(std::move(r));
+    }
+    return rules;
+}
+
+static json random_groups(std::mt19937_64& rng) {
+    json groups = json::object();
+    for (int g = 0; g < 8; g++) {
+        json members = json::array({"SAT-" + std::to_string(g) + "*"});
+        for (int i = 0; i < 20; i++) members.push_back("SAT-" + std::to_string(1000 + rng() % 1000));
+        groups["g" + std::to_string(g)] = std::move(members);
+    }
+    return groups;
+}
+
+int main(int argc, char** argv) {
+    std::size_t polls = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 200000;
+    std::mt19937_64 rng(7);
+    std::uniform_real_distribution<double> p95(50, 300), dr(0, 0.1), lq(0.5, 1.0);
+
+    std::vector<std::string> sat_ids;
+    std::vector<json> bodies;
+    std::vector<common::SatMetrics> typed;
+    for (std::size_t i = 0; i < 1000; i++) {
+        sat_ids.push_back("SAT-" + std::to_string(1000 + i));
+        json m = {{"ok", i % 97 != 0}, {"count", i % 13 == 0 ? 0 : 100 + (int)(rng() % 900)}, {"latency_p50_ms", 40.0},
+                  {"latency_p95_ms", p95(rng)}, {"latency_quantiles_ms", {{"99", 350.0}}}, {"drop_rate", dr(rng)},
+                  {"avg_link_quality", lq(rng)}};
+        typed.push_back(common::SatMetrics::from_json(m));
+        bodies.push_back(std::move(m));
+    }
+
+    common::AlertCounters counters;
+    auto defaults = common::RuleSet::compile(kDefaultRules, json::object(), 1, counters);
+    std::vector<std::uint32_t> prev, streaks;
+    for (std::size_t i = 0; i < bodies.size(); i++) {
+        json want = legacy_eval(bodies[i]);
+        json got = common::alerts_json(defaults->eval(sat_ids[i], typed[i], prev, streaks));
+        if (want != got) {
+            std::printf("MISMATCH for %s\n  legacy %s\n  rules  %s\n", sat_ids[i].c_str(), want.dump().c_str(), got.dump().c_str());
+            return 1;
+        }
+    }
+
+    auto time_ns = [&](auto&& fn) {
+        auto t0 = std::chrono::steady_clock::now();
+        std::size_t alerts = 0;
+        for (std::size_t i = 0; i < polls; i++) alerts += fn(i % bodies.size());
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+        return std::make_pair(ns / (double)polls, alerts);
+    };
+
+    std::printf("%zu polls over %zu satellites\n\n", polls, bodies.size());
+    std::printf("%-28s %12s %12s\n", "evaluator", "ns/poll", "alerts");
+    auto [legacy_ns, legacy_n] = time_ns([&](std::size_t i) { return legacy_eval(bodies[i]).size(); });
+    std::printf("%-28s %12.0f %12zu\n", "legacy json, 3 checks", legacy_ns, legacy_n);
+    auto [rules_ns, rules_n] = time_ns([&](std::size_t i) { return defaults->eval(sat_ids[i], typed[i], prev, streaks).size(); });
+    std::printf("%-28s %12.0f %12zu\n", "compiled, 3 default rules", rules_ns, rules_n);
+
+    json groups = random_groups(rng);
+    for (std::size_t n : {10, 100, 300, 1000}) {
+        auto set = common::RuleSet::compile(random_rules(n, rng), groups, 2, counters);
+        std::vector<std::vector<std::uint32_t>> runs(bodies.size());
+        auto [ns, alerts] = time_ns([&](std::size_t i) {
+            std::vector<std::uint32_t> next;
+            std::size_t k = set->eval(sat_ids[i], typed[i], runs[i], next).size();
+            runs[i].swap(next);
+            return k;
+        });
+        char label[64];
+        std::snprintf(label, sizeof(label), "compiled, %zu rules", n);
+        std::printf("%-28s %12.0f %12zu\n", label, ns, alerts);
+    }
+    return 0;
+}
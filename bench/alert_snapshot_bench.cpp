@@ -0,0 +1,194 @@
+// Many concurrent /alerts readers against one poller, comparing the old state
+// layout (json maps behind one mutex, copied and dumped per request) with the
+// common::SnapshotStore path (one atomic load, pre-serialized parts spliced).
+//
+//   alert_snapshot_bench [satellites] [seconds]   default: 1000 1
+//
+// For each reader count it reports reader throughput and how long the poller
+// took per update, which is where readers used to stall it. Exits non-zero if
+// the two paths answer differently.
+#include <nlohmann/json.hpp>
+
+#include "common/alert_state.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using json = nlohmann::json;
+using Clock = std::chrono::steady_clock;
+
+static std::string sat_name(std::size_t i) {
+    char b[32];
+    std::snprintf(b, sizeof(b), "SAT-%04zu", i);
+    return b;
+}
+
+// A /metrics body and its evaluated alerts, varying with seq.
+static std::string metrics_body(std::size_t i, std::uint64_t seq) {
+    return json{{"ok", true}, {"sat_id", sat_name(i)}, {"window_s", 600}, {"count", 500 + (seq % 100)},
+                {"drop_rate", 0.01 * (double)(seq % 9)}, {"latency_p50_ms", 40.0 + (double)(seq % 7)},
+                {"latency_p95_ms", 150.0 + (double)(seq % 120)}, {"avg_link_quality", 0.9},
+                {"quantile_mode", "exact"}}
+        .dump();
+}
+
+static std::vector<common::Alert> alerts_for(const common::SatMetrics& m) {
+    std::vector<common::Alert> out;
+    if (m.latency_p95_ms > 200.0) out.push_back({common::Severity::Med, "LATENCY_P95", m.latency_p95_ms, 200.0});
+    if (m.drop_rate > 0.05) out.push_back({common::Severity::High, "DROP_RATE", m.drop_rate, 0.05});
+    return out;
+}
+
+struct Result {
+    double reads_per_s;
+    double write_avg_us;
+    double write_p99_us;
+    double write_max_us;
+};
+
+// Runs readers against a writer paced at writes_per_s for `seconds`. read(i)
+// answers one request for satellite i; write(i, seq) applies one poll.
+template <class Read, class Write>
+static Result run(std::size_t sats, int readers, double seconds, double writes_per_s, Read&& read, Write&& write) {
+    std::atomic<bool> stop{false};
+    std::atomic<long long> reads{0};
+    std::vector<std::thread> threads;
+    for (int r = 0; r < readers; r++) {
+        threads.emplace_back([&, r] {
+            std::mt19937_64 rng(r);
+            long long n = 0;
+            std::size_t bytes = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                bytes += read(rng() % sats).size();
+                n++;
+            }
+            reads += n;
+            if (bytes == 0) std::abort();
+        });
+    }
+
+    std::vector<double> write_us;
+    auto start = Clock::now();
+    auto end = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+    auto step = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / writes_per_s));
+    std::uint64_t seq = 0;
+    for (auto next = start; next < end; next += step) {
+        std::this_thread::sleep_until(next);
+        auto t0 = Clock::now();
+        write(seq % sats, seq);
+        write_us.push_back(std::chrono::duration<double, std::micro>(Clock::now() - t0).count());
+        seq++;
+    }
+    stop = true;
+    for (auto& t : threads) t.join();
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::sort(write_us.begin(), write_us.end());
+    double sum = 0;
+    for (double w : write_us) sum += w;
+    return Result{(double)reads.load() / elapsed, sum / (double)write_us.size(),
+                  write_us[write_us.size() * 99 / 100], write_us.back()};
+}
+
+int main(int argc, char** argv) {
+    std::size_t sats = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000;
+    double seconds = argc > 2 ? std::atof(argv[2]) : 1.0;
+    const double writes_per_s = 2000;  // a busy poller: 1000 satellites, half on a 1 s tier
+    const json thresholds = {{"latency_p95_ms", 200.0}, {"drop_rate", 0.05}, {"min_link_quality", 0.7}, {"window_s", 600}};
+
+    // Old layout: json DOMs behind one mutex, copied out and dumped per read.
+    std::mutex mu;
+    std::unordered_map<std::string, json> metrics_by_sat, alerts_by_sat;
+    auto locked_write = [&](std::size_t i, std::uint64_t seq) {
+        std::string name = sat_name(i);
+        json m = json::parse(metrics_body(i, seq));
+        json a = common::alerts_json(alerts_for(common::SatMetrics::from_json(m)));
+        std::lock_guard<std::mutex> lock(mu);
+        metrics_by_sat[name] = m;
+        alerts_by_sat[name] = a;
+    };
+    auto locked_read = [&](std::size_t i) {
+        std::string name = sat_name(i);
+        json m = json{{"ok", false}, {"error", "no data yet"}};
+        json a = json::array();
+        {
+            std::lock_guard<std::mutex> lock(mu);
+            if (metrics_by_sat.count(name)) m = metrics_by_sat[name];
+            if (alerts_by_sat.count(name)) a = alerts_by_sat[name];
+        }
+        return json{{"ok", true}, {"sat_id", name}, {"metrics", m}, {"alerts", a}, {"thresholds", thresholds}}.dump();
+    };
+
+    // Snapshot layout: poller stages typed states, a publisher swaps snapshots.
+    common::SnapshotStore store;
+    std::string thresholds_dump = thresholds.dump();
+    auto snapshot_write = [&](std::size_t i, std::uint64_t seq) {
+        auto s = std::make_shared<common::SatState>();
+        s->metrics_json = metrics_body(i, seq);
+        s->metrics = common::SatMetrics::from_json(json::parse(s->metrics_json));
+        s->alerts = alerts_for(s->metrics);
+        s->alerts_json = common::alerts_json(s->alerts).dump();
+        store.stage(sat_name(i), std::move(s));
+    };
+    auto snapshot_read = [&](std::size_t i) {
+        std::string name = sat_name(i);
+        auto snap = store.load();
+        auto it = snap->sats.find(name);
+        const common::SatState* s = it == snap->sats.end() ? nullptr : it->second.get();
+        std::string out;
+        out += "{\"alerts\":";
+        out += s ? s->alerts_json : "[]";
+        out += ",\"metrics\":";
+        out += s ? s->metrics_json : R"({"error":"no data yet","ok":false})";
+        out += ",\"ok\":true,\"sat_id\":";
+        out += json(name).dump();
+        out += ",\"thresholds\":";
+        out += thresholds_dump;
+        out += "}";
+        return out;
+    };
+
+    for (std::size_t i = 0; i < sats; i++) {
+        locked_write(i, i);
+        snapshot_write(i, i);
+    }
+    store.publish(0);
+    for (std::size_t i = 0; i < sats; i++) {
+        if (json::parse(locked_read(i)) != json::parse(snapshot_read(i))) {
+            std::printf("MISMATCH for %s\n%s\n%s\n", sat_name(i).c_str(), locked_read(i).c_str(), snapshot_read(i).c_str());
+            return 1;
+        }
+    }
+
+    std::printf("%zu satellites, poller at %.0f updates/s, %.1f s per run\n\n", sats, writes_per_s, seconds);
+    std::printf("%-8s %-8s %14s %14s %14s %14s\n", "layout", "readers", "reads/s", "write avg us", "write p99 us",
+                "write max us");
+    for (int readers : {1, 4, 16, 64}) {
+        Result a = run(sats, readers, seconds, writes_per_s, locked_read, locked_write);
+        std::printf("%-8s %-8d %14.0f %14.1f %14.1f %14.1f\n", "mutex", readers, a.reads_per_s, a.write_avg_us,
+                    a.write_p99_us, a.write_max_us);
+
+        std::atomic<bool> stop{false};
+        std::thread publisher([&] {
+            while (!stop) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(250));
+                store.publish(0);
+            }
+        });
+        Result b = run(sats, readers, seconds, writes_per_s, snapshot_read, snapshot_write);
+        stop = true;
+        publisher.join();
+        std::printf("%-8s %-8d %14.0f %14.1f %14.1f %14.1f\n", "snapshot", readers, b.reads_per_s, b.write_avg_us,
+                    b.write_p99_us, b.write_max_us);
+    }
+    return 0;
+}
@@ -0,0 +1,136 @@
+// Times the column kernels in common/columns.hpp at every SIMD level the CPU
+// supports against the row-at-a-time loop /metrics used to run over an
+// array of Row structs.
+//
+//   columns_bench [rows...]        default: 10000 1000000 10000000
+//
+// Exits non-zero if any level disagrees with the scalar kernels: counts,
+// integer sums, min/max, copied latencies and bucket indexes must match
+// exactly, the link_quality sum to a relative 1e-9.
+#include "common/columns.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+struct Row {
+    std::int64_t ts_ms;
+    double latency_ms;
+    double link_quality;
+    int dropped;
+    int sent;
+};
+
+template <class F>
+static double best_ms(int reps, F&& fn) {
+    double best = 1e300;
+    for (int r = 0; r < reps; r++) {
+        auto t0 = std::chrono::steady_clock::now();
+        fn();
+        best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count());
+    }
+    return best;
+}
+
+int main(int argc, char** argv) {
+    std::vector<std::size_t> sizes;
+    for (int i = 1; i < argc; i++) sizes.push_back((std::size_t)std::atoll(argv[i]));
+    if (sizes.empty()) sizes = {10000, 1000000, 10000000};
+
+    using common::simd::Level;
+    std::vector<Level> levels = {Level::Scalar};
+    if (common::simd::detected_level() >= Level::Avx2) levels.push_back(Level::Avx2);
+    if (common::simd::detected_level() >= Level::Avx512) levels.push_back(Level::Avx512);
+
+    int failures = 0;
+    std::mt19937_64 rng(11);
+    for (std::size_t n : sizes) {
+        // Arrival order with some jitter, as the live store holds it; the
+        // range keeps roughly the middle 60%.
+        std::vector<Row> rows(n);
+        common::WindowColumns cols;
+        std::uniform_real_distribution<double> lat(5, 400), lq(0, 1);
+        std::uniform_int_distribution<int> jitter(-2000, 2000), dropped(0, 10);
+        for (std::size_t i = 0; i < n; i++) {
+            Row r{(std::int64_t)i * 10 + jitter(rng), lat(rng), lq(rng), dropped(rng), 100};
+            rows[i] = r;
+            cols.push_back(r.ts_ms, r.latency_ms, r.link_quality, r.dropped, r.sent);
+        }
+        auto span = cols.span();
+        std::int64_t from = (std::int64_t)n * 2, to = (std::int64_t)n * 8;
+        int reps = n > 1000000 ? 3 : 10;
+
+        std::vector<double> latencies;
+        std::int64_t row_count = 0, row_dropped = 0;
+        double row_ms = best_ms(reps, [&] {
+            latencies.clear();
+            std::int64_t count = 0, sum_dropped = 0, sum_sent = 0;
+            double sum_lq = 0.0;
+            for (auto& r : rows) {
+                if (r.ts_ms < from || r.ts_ms >= to) continue;
+                count++;
+                sum_dropped += r.dropped;
+                sum_sent += r.sent;
+                sum_lq += r.link_quality;
+                latencies.push_back(r.latency_ms);
+            }
+            row_count = count;
+            row_dropped = sum_dropped;
+        });
+        std::printf("n=%zu  rows selected=%lld\n", n, (long long)row_count);
+        std::printf("  %-8s filter+sums+copy %9.3f ms\n", "row loop", row_ms);
+
+        common::simd::WindowSums want = common::simd::sum_range(span, from, to, Level::Scalar);
+        std::vector<double> want_copy(n), got_copy(n);
+        std::size_t want_k = common::simd::copy_range(span.ts, span.latency, n, from, to, want_copy.data(), Level::Scalar);
+        std::int64_t step = 60000;
+        std::int32_t buckets = (std::int32_t)std::max<std::int64_t>(1, (std::int64_t)n * 10 / step);
+        std::vector<std::int32_t> want_idx(n), got_idx(n);
+        common::simd::bucket_index(span.ts, n, 0, step, buckets, want_idx.data(), Level::Scalar);
+        if (want.count != row_count || want.sum_dropped != row_dropped || want_k != latencies.size() ||
+            !std::equal(latencies.begin(), latencies.end(), want_copy.begin())) {
+            std::printf("FAIL scalar kernels disagree with the row loop\n");
+            failures++;
+        }
+
+        for (Level level : levels) {
+            common::simd::WindowSums got;
+            std::size_t got_k = 0;
+            double sums_ms = best_ms(reps, [&] { got = common::simd::sum_range(span, from, to, level); });
+            double copy_ms = best_ms(reps, [&] {
+                got_k = common::simd::copy_range(span.ts, span.latency, n, from, to, got_copy.data(), level);
+            });
+            double bucket_ms = best_ms(reps, [&] {
+                common::simd::bucket_index(span.ts, n, 0, step, buckets, got_idx.data(), level);
+            });
+            std::printf("  %-8s sums %8.3f ms  copy %8.3f ms  filter+sums+copy %8.3f ms (%.1fx)  buckets %8.3f ms\n",
+                        common::simd::level_name(level), sums_ms, copy_ms, sums_ms + copy_ms,
+                        row_ms / (sums_ms + copy_ms), bucket_ms);
+
+            bool lq_ok = std::fabs(got.sum_link_quality - want.sum_link_quality) <=
+                         1e-9 * std::max(1.0, std::fabs(want.sum_link_quality));
+            if (got.count != want.count || got.sum_dropped != want.sum_dropped || got.sum_sent != want.sum_sent ||
+                got.min_latency != want.min_latency || got.max_latency != want.max_latency || !lq_ok) {
+                std::printf("FAIL %s sum_range differs from scalar\n", common::simd::level_name(level));
+                failures++;
+            }
+            if (got_k != want_k || !std::equal(want_copy.begin(), want_copy.begin() + (std::ptrdiff_t)want_k,
+                                               got_copy.begin())) {
+                std::printf("FAIL %s copy_range differs from scalar\n", common::simd::level_name(level));
+                failures++;
+            }
+            if (got_idx != want_idx) {
+                std::printf("FAIL %s bucket_index differs from scalar\n", common::simd::level_name(level));
+                failures++;
+            }
+        }
+    }
+
+    std::printf(failures ? "%d check(s) failed\n" : "all checks passed\n", failures);
+    return failures ? 1 : 0;
+}
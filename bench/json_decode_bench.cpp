@@ -0,0 +1,74 @@
+// Compares the schema-specialized event decoder with the nlohmann DOM path on
+// payloads shaped like scripts/load_test.py traffic.
+//
+//   json_decode_bench [events]
+#include <nlohmann/json.hpp>
+
+#include "common/event_json.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+using json = nlohmann::json;
+
+static std::vector<std::string> make_payloads(std::size_t n) {
+    std::mt19937_64 rng(42);
+    std::uniform_real_distribution<double> lat(20, 80), lq(0.85, 0.99);
+    std::vector<std::string> out;
+    out.reserve(n);
+    char id[37];
+    for (std::size_t i = 0; i < n; i++) {
+        std::snprintf(id, sizeof(id), "%08llx-%04llx-4%03llx-a%03llx-%012llx",
+                      (unsigned long long)(rng() & 0xffffffff), (unsigned long long)(rng() & 0xffff),
+                      (unsigned long long)(rng() & 0xfff), (unsigned long long)(rng() & 0xfff),
+                      (unsigned long long)(rng() & 0xffffffffffffULL));
+        int sent = 80 + (int)(rng() % 120);
+        out.push_back(json{
+            {"event_id", id},
+            {"sat_id", "SAT-00" + std::to_string(1 + rng() % 5)},
+            {"ts_ms", (std::int64_t)1700000000000 + (std::int64_t)i},
+            {"latency_ms", lat(rng)},
+            {"dropped_packets", (int)(rng() % 2)},
+            {"sent_packets", sent},
+            {"link_quality", lq(rng)}
+        }.dump());
+    }
+    return out;
+}
+
+template <typename F>
+static void run(const char* name, const std::vector<std::string>& payloads, F&& decode) {
+    std::size_t ok = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    for (auto& p : payloads) ok += decode(p) ? 1 : 0;
+    auto t1 = std::chrono::steady_clock::now();
+    double s = std::chrono::duration<double>(t1 - t0).count();
+    std::printf("%-10s %10.0f events/s  %7.1f ns/event  ok=%zu\n",
+                name, (double)payloads.size() / s, s * 1e9 / (double)payloads.size(), ok);
+}
+
+int main(int argc, char** argv) {
+    std::size_t n = (argc > 1) ? (std::size_t)std::atoll(argv[1]) : 1000000;
+    auto payloads = make_payloads(n);
+
+    run("nlohmann", payloads, [](const std::string& body) {
+        auto j = json::parse(body);
+        std::string err;
+        if (!common::validate_event(j, err)) return false;
+        // The ingest route copies both ids out of the DOM afterwards.
+        std::string id = j["event_id"].get<std::string>();
+        std::string sat = j["sat_id"].get<std::string>();
+        return !id.empty() && !sat.empty();
+    });
+
+    run("fast", payloads, [](const std::string& body) {
+        common::EventView ev;
+        std::string err;
+        return common::decode_event_json(body, ev, err) == common::DecodeResult::Ok;
+    });
+    return 0;
+}
@@ -0,0 +1,139 @@
+// Before/after comparison of telemetry schema v1 and v2 (common/schema.hpp)
+// using the exact SQL ingest and the aggregator run.
+//
+//   schema_bench [events] [satellites] [dir]
+#include "common/schema.hpp"
+#include "common/storage.hpp"
+#include "common/telemetry.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+struct Ev {
+    std::string event_id;
+    std::string sat_id;
+    std::int64_t ts_ms;
+    double latency_ms;
+    int dropped;
+    int sent;
+    double lq;
+};
+
+static std::vector<Ev> make_events(std::size_t n, int sats) {
+    std::mt19937_64 rng(7);
+    std::vector<Ev> out;
+    out.reserve(n);
+    unsigned char id[16];
+    char text[36];
+    for (std::size_t i = 0; i < n; i++) {
+        for (auto& b : id) b = (unsigned char)rng();
+        common::format_uuid(id, text);
+        out.push_back(Ev{std::string(text, sizeof(text)), "SAT-" + std::to_string(1000 + (int)(rng() % (unsigned)sats)),
+                         1700000000000 + (std::int64_t)i * 10, 20.0 + (double)(rng() % 6000) / 100.0,
+                         (int)(rng() % 3), 100, 0.85 + (double)(rng() % 14) / 100.0});
+    }
+    return out;
+}
+
+static double seconds_since(std::chrono::steady_clock::time_point t0) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+static void run(int version, const std::vector<Ev>& events, int sats, const std::string& dir) {
+    std::string path = dir + "/schema_bench_v" + std::to_string(version) + ".db";
+    std::remove(path.c_str());
+    std::remove((path + "-wal").c_str());
+    std::remove((path + "-shm").c_str());
+
+    common::StoragePragmas pragmas;
+    pragmas.synchronous = "NORMAL";
+    common::Connection c(path, common::OpenMode::ReadWrite, pragmas);
+    if (version == common::kSchemaV2) common::create_schema_v2(c);
+    else common::create_schema_v1(c);
+
+    common::SatelliteKeys keys;
+    auto t0 = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < events.size(); i += 512) {
+        c.exec("BEGIN IMMEDIATE;");
+        for (std::size_t j = i; j < std::min(events.size(), i + 512); j++) {
+            const Ev& ev = events[j];
+            common::EventKey key(ev.event_id);
+            auto st = c.prepare(common::insert_sql(version));
+            if (version == common::kSchemaV2) {
+                key.bind(*st, 1);
+                st->bind(2, keys.get(c, ev.sat_id));
+            } else {
+                st->bind(1, std::string_view(ev.event_id));
+                st->bind(2, std::string_view(ev.sat_id));
+            }
+            st->bind(3, ev.ts_ms);
+            st->bind(4, ev.latency_ms);
+            st->bind(5, ev.dropped);
+            st->bind(6, ev.sent);
+            st->bind(7, ev.lq);
+            st->step();
+        }
+        c.exec("COMMIT;");
+    }
+    double ins = seconds_since(t0);
+    c.exec("PRAGMA wal_checkpoint(TRUNCATE);");
+
+    std::int64_t page_count = 0, page_size = 0;
+    {
+        auto st = c.prepare("PRAGMA page_count;");
+        st->step();
+        page_count = st->column_int64(0);
+    }
+    {
+        auto st = c.prepare("PRAGMA page_size;");
+        st->step();
+        page_size = st->column_int64(0);
+    }
+
+    std::printf("v%d ingest: %zu events in %.2fs (%.0f events/s), db %.1f MiB\n",
+                version, events.size(), ins, (double)events.size() / ins,
+                (double)(page_count * page_size) / (1024.0 * 1024.0));
+
+    std::int64_t max_ts = events.back().ts_ms;
+    std::int64_t span = max_ts - events.front().ts_ms;
+    for (double frac : {0.01, 0.10, 1.0}) {
+        std::int64_t min_ts = max_ts - (std::int64_t)((double)span * frac);
+        std::size_t rows = 0;
+        int queries = 0;
+        auto q0 = std::chrono::steady_clock::now();
+        for (int rep = 0; rep < 3; rep++) {
+            for (int s = 0; s < sats; s++) {
+                std::string sat = "SAT-" + std::to_string(1000 + s);
+                auto st = c.prepare(common::select_window_sql(version));
+                st->bind(1, std::string_view(sat));
+                st->bind(2, min_ts);
+                double sum = 0;
+                while (st->step()) {
+                    sum += st->column_double(0);
+                    rows++;
+                }
+                (void)sum;
+                queries++;
+            }
+        }
+        double q = seconds_since(q0);
+        std::printf("v%d window %5.1f%%: %.3f ms/query, %zu rows/query\n",
+                    version, frac * 100.0, q * 1000.0 / queries, rows / (std::size_t)queries);
+    }
+}
+
+int main(int argc, char** argv) {
+    std::size_t n = (argc > 1) ? (std::size_t)std::atoll(argv[1]) : 500000;
+    int sats = (argc > 2) ? std::atoi(argv[2]) : 50;
+    std::string dir = (argc > 3) ? argv[3] : std::string(".");
+
+    auto events = make_events(n, sats);
+    run(common::kSchemaV1, events, sats, dir);
+    run(common::kSchemaV2, events, sats, dir);
+    return 0;
+}
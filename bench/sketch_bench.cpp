@@ -0,0 +1,118 @@
+// Checks QuantileSketch against exact quantiles and times it against the
+// copy-and-sort percentile() the aggregator used to run per quantile.
+//
+//   sketch_bench [values]
+//
+// Exits non-zero if any quantile is off by more than the sketch's relative
+// accuracy, if merging shards differs from one sketch over the same values,
+// or if a serialize/deserialize round trip changes an answer.
+#include "common/sketch.hpp"
+#include "common/window_stats.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+static double old_percentile(std::vector<double> v, double p) {
+    if (v.empty()) return 0.0;
+    std::sort(v.begin(), v.end());
+    double idx = (p / 100.0) * (v.size() - 1);
+    std::size_t i = static_cast<std::size_t>(idx);
+    double frac = idx - static_cast<double>(i);
+    if (i + 1 < v.size()) return v[i] * (1.0 - frac) + v[i + 1] * frac;
+    return v[i];
+}
+
+template <class F>
+static double time_ms(F&& fn) {
+    auto t0 = std::chrono::steady_clock::now();
+    fn();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+}
+
+int main(int argc, char** argv) {
+    std::size_t n = (argc > 1) ? (std::size_t)std::atoll(argv[1]) : 1000000;
+    const double qs[] = {0.0, 0.01, 0.1, 0.25, 0.5, 0.75, 0.9, 0.95, 0.99, 0.999, 1.0};
+
+    std::mt19937_64 rng(7);
+    struct Dist {
+        const char* name;
+        std::function<double()> draw;
+    };
+    std::uniform_real_distribution<double> uni(20, 80);
+    std::lognormal_distribution<double> logn(3.5, 0.6);
+    std::exponential_distribution<double> expo(1.0 / 40);
+    std::normal_distribution<double> around_zero(0.0, 5.0);
+    std::vector<Dist> dists = {
+        {"uniform", [&] { return uni(rng); }},
+        {"lognormal", [&] { return logn(rng); }},
+        {"exponential", [&] { return expo(rng); }},
+        {"bimodal", [&] { return (rng() & 1) ? uni(rng) : 1000.0 + uni(rng); }},
+        {"signed", [&] { return around_zero(rng); }},
+    };
+
+    int failures = 0;
+    for (auto& d : dists) {
+        std::vector<double> values(n);
+        for (auto& v : values) v = d.draw();
+
+        common::QuantileSketch sketch;
+        double build = time_ms([&] { for (double v : values) sketch.add(v); });
+
+        // 16 shards merged must match the single sketch exactly.
+        std::vector<common::QuantileSketch> shards(16);
+        for (std::size_t i = 0; i < n; i++) shards[i % 16].add(values[i]);
+        common::QuantileSketch merged;
+        for (auto& s : shards) merged.merge(s);
+
+        std::string blob = sketch.serialize();
+        auto restored = common::QuantileSketch::deserialize(blob);
+
+        std::vector<double> sorted = values;
+        std::sort(sorted.begin(), sorted.end());
+
+        double worst = 0.0;
+        for (double q : qs) {
+            double truth = sorted[(std::size_t)(q * (double)(n - 1))];
+            double est = sketch.quantile(q);
+            double err = truth == 0.0 ? std::fabs(est) : std::fabs(est - truth) / std::fabs(truth);
+            worst = std::max(worst, err);
+            if (err > sketch.relative_accuracy() + 1e-12) {
+                std::printf("FAIL %s q=%.3f truth=%.6f est=%.6f err=%.5f\n", d.name, q, truth, est, err);
+                failures++;
+            }
+            if (merged.quantile(q) != est || restored.quantile(q) != est) {
+                std::printf("FAIL %s q=%.3f merged/restored sketch disagrees\n", d.name, q);
+                failures++;
+            }
+        }
+
+        double old = time_ms([&] {
+            volatile double sink = old_percentile(values, 50.0) + old_percentile(values, 95.0);
+            (void)sink;
+        });
+        std::printf("%-12s n=%zu worst_rel_err=%.5f buckets=%zu bytes=%zu build=%.1fms  old p50+p95=%.1fms\n",
+                    d.name, n, worst, sketch.bucket_count(), blob.size(), build, old);
+    }
+
+    // Exact mode must reproduce percentile() bit for bit.
+    std::vector<double> small(5000);
+    for (auto& v : small) v = uni(rng);
+    common::LatencyQuantiles exact(small.size());
+    for (double v : small) exact.add(v);
+    for (double p : {50.0, 95.0, 99.0}) {
+        if (!exact.exact() || exact.quantile(p / 100.0) != old_percentile(small, p)) {
+            std::printf("FAIL exact mode p%.0f differs from percentile()\n", p);
+            failures++;
+        }
+    }
+
+    std::printf(failures ? "%d check(s) failed\n" : "all checks passed\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include "common/alert_state.hpp"
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// The controlplane's alert change feed: every alert raised or cleared on a
+// satellite, numbered in order, kept in a bounded in-memory log that readers
+// page through by sequence cursor.
+namespace common {
+
+// Changes between two states of the fleet, serialized and counted, ready to
+// be numbered by AlertLog::append().
+struct AlertChanges {
+    std::vector<std::string> entries;  // JSON objects, without "seq"
+    std::size_t raised = 0;
+    std::size_t cleared = 0;
+};
+
+class AlertLog {
+public:
+    // Sequence numbers continue from start_seq. Starting each process from a
+    // larger one (the controlplane uses its start time) makes a cursor kept
+    // across a restart read as stale instead of silently skipping entries.
+    AlertLog(std::size_t capacity, std::uint64_t start_seq)
+        : capacity(std::max<std::size_t>(1, capacity)), last(start_seq), floor(start_seq) {}
+
+    // Adds to out a "raised" for every alert in after but not before and a
+    // "cleared" for every one in before but not after, an alert being its
+    // type and severity. A null state has no alerts; a null after means the
+    // satellite is no longer watched, and its clears say so.
+    static void diff(const std::string& sat_id, const SatState* before, const SatState* after, std::int64_t at_ms,
+                     AlertChanges& out) {
+        static const std::vector<Alert> none;
+        const auto& was = before ? before->alerts : none;
+        const auto& now = after ? after->alerts : none;
+        auto contains = [](const std::vector<Alert>& alerts, const Alert& a) {
+            return std::any_of(alerts.begin(), alerts.end(),
+                               [&](const Alert& b) { return b.type == a.type && b.severity == a.severity; });
+        };
+        auto entry = [&](const char* event, const Alert& a) {
+            nlohmann::json j = {{"at_ms", at_ms}, {"event", event}, {"sat_id", sat_id},
+                                {"severity", severity_name(a.severity)}, {"type", a.type}};
+            if (a.message) j["message"] = a.message;
+            if (a.value) j["value"] = *a.value;
+            if (a.threshold) j["threshold"] = *a.threshold;
+            if (!after) j["reason"] = "unwatched";
+            out.entries.push_back(j.dump());
+        };
+        for (const Alert& a : was) {
+            if (contains(now, a)) continue;
+            entry("cleared", a);
+            out.cleared++;
+        }
+        for (const Alert& a : now) {
+            if (contains(was, a)) continue;
+            entry("raised", a);
+            out.raised++;
+        }
+    }
+
+    // Numbers and stores changes in order, dropping the oldest entries past
+    // capacity, and wakes wait()ers.
+    void append(AlertChanges& changes) {
+        if (changes.entries.empty()) return;
+        {
+            std::lock_guard<std::mutex> lock(mu);
+            for (auto& body : changes.entries) {
+                Entry e;
+                e.seq = ++last;
+                e.json = "{\"seq\":" + std::to_string(e.seq) + "," + body.substr(1);
+                log.push_back(std::move(e));
+            }
+            while (log.size() > capacity) {
+                floor = log.front().seq;
+                log.pop_front();
+            }
+            raised += changes.raised;
+            cleared += changes.cleared;
+        }
+        cv.notify_all();
+    }
+
+    // Appends to out a JSON array of up to limit entries after since, oldest
+    // first, and returns the cursor to pass next time. resync is set when
+    // entries after since are no longer kept (or since is not from this
+    // process); the caller has missed changes and should rebuild its state
+    // from /alerts before carrying on from the returned cursor.
+    std::uint64_t read(std::uint64_t since, std::size_t limit, std::string& out, bool& resync) const {
+        std::lock_guard<std::mutex> lock(mu);
+        resync = since < floor || since > last;
+        if (since > last) since = last;
+        out += '[';
+        std::uint64_t next = std::max(since, floor);
+        // Entries are numbered consecutively, so the first one after since is
+        // found by offset.
+        std::size_t i = log.empty() || next < log.front().seq ? 0 : (std::size_t)(next - log.front().seq + 1);
+        for (std::size_t n = 0; i < log.size() && n < limit; i++, n++) {
+            if (n) out += ',';
+            out += log[i].json;
+            next = log[i].seq;
+        }
+        out += ']';
+        return next;
+    }
+
+    // Blocks until there is an entry after since or until `until`; true if
+    // there is.
+    bool wait(std::uint64_t since, std::chrono::steady_clock::time_point until) const {
+        std::unique_lock<std::mutex> lock(mu);
+        return cv.wait_until(lock, until, [&] { return last > since; });
+    }
+
+    struct Stats {
+        std::uint64_t last_seq = 0;
+        std::size_t entries = 0;
+        std::uint64_t raised = 0;
+        std::uint64_t cleared = 0;
+    };
+
+    Stats stats() const {
+        std::lock_guard<std::mutex> lock(mu);
+        return Stats{last, log.size(), raised, cleared};
+    }
+
+private:
+    struct Entry {
+        std::uint64_t seq = 0;
+        std::string json;
+    };
+
+    const std::size_t capacity;
+    mutable std::mutex mu;
+    mutable std::condition_variable cv;
+    std::deque<Entry> log;
+    std::uint64_t last;   // seq of the newest entry ever appended
+    std::uint64_t floor;  // entries up to here are gone
+    std::uint64_t raised = 0;
+    std::uint64_t cleared = 0;
+};
+
+} // namespace common
@@ -0,0 +1,576 @@
+#pragma once
+
+#include "common/alert_state.hpp"
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+// Operator-defined alert rules for the controlplane. A rule is a condition
+// over one satellite's SatMetrics, optionally held for several consecutive
+// polls:
+//
+//   latency_p99_ms > 300 && count > 50
+//   drop_rate > 0.1 for 3 cycles
+//   !(avg_link_quality >= 0.7) || (drop_rate > 0.02 && latency_p95_ms > 150)
+//
+// Operands are metric names and numbers; comparisons are > >= < <= == !=,
+// combined with && || ! and parentheses. Conditions are compiled once, when
+// the configuration is set, into postfix code for a small stack machine.
+namespace common {
+
+struct RuleError : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+enum class Metric : std::uint8_t { Count, DropRate, LatencyP50, LatencyP95, LatencyP99, AvgLinkQuality };
+
+inline constexpr std::pair<std::string_view, Metric> kMetricNames[] = {
+    {"count", Metric::Count},
+    {"drop_rate", Metric::DropRate},
+    {"latency_p50_ms", Metric::LatencyP50},
+    {"latency_p95_ms", Metric::LatencyP95},
+    {"latency_p99_ms", Metric::LatencyP99},
+    {"avg_link_quality", Metric::AvgLinkQuality},
+};
+
+inline double metric_value(const SatMetrics& m, Metric k) {
+    switch (k) {
+    case Metric::Count: return (double)m.count;
+    case Metric::DropRate: return m.drop_rate;
+    case Metric::LatencyP50: return m.latency_p50_ms;
+    case Metric::LatencyP95: return m.latency_p95_ms;
+    case Metric::LatencyP99: return m.latency_p99_ms;
+    case Metric::AvgLinkQuality: return m.avg_link_quality;
+    }
+    return 0.0;
+}
+
+inline constexpr std::size_t kMetricCount = std::size(kMetricNames);
+
+// Every metric of m, indexed by Metric, so rules read them without a switch.
+inline void metric_values(const SatMetrics& m, double (&out)[kMetricCount]) {
+    for (auto& [name, k] : kMetricNames) out[(int)k] = metric_value(m, k);
+}
+
+// A compiled condition: postfix code for a small stack machine. A comparison
+// of a metric against a number is one instruction, and && / || skip their
+// right side when the left side decides, so typical rules run a handful of
+// instructions.
+class RuleProgram {
+public:
+    static constexpr int kMaxDepth = 32;
+
+    // Throws RuleError naming the offending position. Sets for_cycles from an
+    // optional trailing "for N cycles" (1 without one).
+    static RuleProgram compile(std::string_view src, std::uint32_t& for_cycles) {
+        Parser p{src};
+        RuleProgram prog;
+        p.prog = &prog;
+        if (p.parse_or() != Kind::Bool) p.fail("condition must be a comparison");
+        for_cycles = 1;
+        if (p.peek_word() == "for") {
+            p.next_word();
+            std::size_t at = p.pos;
+            double n = p.number();
+            if (n < 1 || n > 1000000 || n != (double)(std::uint32_t)n) {
+                p.pos = at;
+                p.fail("cycle count must be a whole number from 1 to 1000000");
+            }
+            for_cycles = (std::uint32_t)n;
+            std::string_view unit = p.next_word();
+            if (unit != "cycles" && unit != "cycle") p.fail("expected 'cycles'");
+        }
+        p.skip_space();
+        if (p.pos != src.size()) p.fail("unexpected input");
+        return prog;
+    }
+
+    // v: metric values from metric_values().
+    bool eval(const double (&v)[kMetricCount]) const {
+        double stack[kMaxDepth];
+        int sp = 0;
+        for (std::size_t pc = 0; pc < code.size(); pc++) {
+            const Ins& in = code[pc];
+            switch (in.op) {
+            case Op::Load: stack[sp++] = v[(int)in.metric]; break;
+            case Op::Const: stack[sp++] = in.k; break;
+            case Op::Test: stack[sp++] = compare(in.cmp, v[(int)in.metric], in.k); break;
+            case Op::Compare: sp--; stack[sp - 1] = compare(in.cmp, stack[sp - 1], stack[sp]); break;
+            case Op::Not: stack[sp - 1] = stack[sp - 1] == 0.0; break;
+            // Left side on the stack: keep it and jump if it decides the
+            // result, else drop it and fall through to the right side.
+            case Op::AndThen:
+                if (stack[sp - 1] == 0.0) pc = in.target - 1;
+                else sp--;
+                break;
+            case Op::OrElse:
+                if (stack[sp - 1] != 0.0) pc = in.target - 1;
+                else sp--;
+                break;
+            }
+        }
+        return stack[0] != 0.0;
+    }
+
+    bool eval(const SatMetrics& m) const {
+        double v[kMetricCount];
+        metric_values(m, v);
+        return eval(v);
+    }
+
+    bool uses(Metric k) const {
+        for (const Ins& in : code) {
+            if ((in.op == Op::Load || in.op == Op::Test) && in.metric == k) return true;
+        }
+        return false;
+    }
+
+    // The first comparison of a metric against a number; its metric value and
+    // number are what an alert from this rule reports.
+    bool has_subject = false;
+    Metric subject = Metric::Count;
+    double subject_threshold = 0.0;
+
+private:
+    enum class Op : std::uint8_t { Load, Const, Test, Compare, Not, AndThen, OrElse };
+    enum class Cmp : std::uint8_t { Gt, Ge, Lt, Le, Eq, Ne };
+    enum class Kind { Number, Bool };
+
+    struct Ins {
+        Op op;
+        Cmp cmp = Cmp::Gt;               // Test, Compare
+        Metric metric = Metric::Count;   // Load, Test
+        std::uint32_t target = 0;        // AndThen, OrElse
+        double k = 0.0;                  // Const, Test
+    };
+
+    static bool compare(Cmp c, double a, double b) {
+        switch (c) {
+        case Cmp::Gt: return a > b;
+        case Cmp::Ge: return a >= b;
+        case Cmp::Lt: return a < b;
+        case Cmp::Le: return a <= b;
+        case Cmp::Eq: return a == b;
+        case Cmp::Ne: return a != b;
+        }
+        return false;
+    }
+
+    // b `c` a, for a comparison written the other way round.
+    static Cmp mirror(Cmp c) {
+        switch (c) {
+        case Cmp::Gt: return Cmp::Lt;
+        case Cmp::Ge: return Cmp::Le;
+        case Cmp::Lt: return Cmp::Gt;
+        case Cmp::Le: return Cmp::Ge;
+        default: return c;
+        }
+    }
+
+    // Recursive descent, emitting postfix code as it goes and tracking the
+    // stack depth the code will need.
+    struct Parser {
+        std::string_view src;
+        std::size_t pos = 0;
+        RuleProgram* prog = nullptr;
+        int depth = 0;   // current stack depth of the emitted code
+        int nesting = 0;
+
+        [[noreturn]] void fail(const std::string& what) const {
+            throw RuleError(what + " at column " + std::to_string(pos + 1));
+        }
+
+        void skip_space() {
+            while (pos < src.size() && std::isspace((unsigned char)src[pos])) pos++;
+        }
+
+        bool eat(std::string_view tok) {
+            skip_space();
+            if (src.substr(pos, tok.size()) != tok) return false;
+            pos += tok.size();
+            return true;
+        }
+
+        std::string_view peek_word() {
+            skip_space();
+            std::size_t end = pos;
+            while (end < src.size() && (std::isalnum((unsigned char)src[end]) || src[end] == '_')) end++;
+            return src.substr(pos, end - pos);
+        }
+
+        std::string_view next_word() {
+            std::string_view w = peek_word();
+            pos += w.size();
+            return w;
+        }
+
+        double number() {
+            skip_space();
+            std::size_t end = pos;
+            while (end < src.size() && (std::isdigit((unsigned char)src[end]) || src[end] == '.' || src[end] == 'e' ||
+                                        src[end] == 'E' || ((src[end] == '-' || src[end] == '+') && end > pos &&
+                                                            (src[end - 1] == 'e' || src[end - 1] == 'E')))) {
+                end++;
+            }
+            std::string text(src.substr(pos, end - pos));
+            char* stop = nullptr;
+            double v = text.empty() ? 0.0 : std::strtod(text.c_str(), &stop);
+            if (text.empty() || *stop != '\0') fail("expected a number");
+            pos = end;
+            return v;
+        }
+
+        // Appends in, keeping depth; returns its index.
+        std::size_t emit(Ins in) {
+            if (in.op == Op::Load || in.op == Op::Const || in.op == Op::Test) {
+                if (++depth > kMaxDepth) fail("condition too deeply nested");
+            } else if (in.op != Op::Not) {
+                depth--;  // Compare pops two and pushes one; AndThen/OrElse pop on fall-through
+            }
+            prog->code.push_back(in);
+            return prog->code.size() - 1;
+        }
+
+        Kind parse_or() {
+            Kind k = parse_and();
+            while (eat("||")) {
+                if (k != Kind::Bool) fail("'||' needs comparisons on both sides");
+                std::size_t jump = emit(Ins{Op::OrElse});
+                if (parse_and() != Kind::Bool) fail("'||' needs comparisons on both sides");
+                prog->code[jump].target = (std::uint32_t)prog->code.size();
+            }
+            return k;
+        }
+
+        Kind parse_and() {
+            Kind k = parse_not();
+            while (eat("&&")) {
+                if (k != Kind::Bool) fail("'&&' needs comparisons on both sides");
+                std::size_t jump = emit(Ins{Op::AndThen});
+                if (parse_not() != Kind::Bool) fail("'&&' needs comparisons on both sides");
+                prog->code[jump].target = (std::uint32_t)prog->code.size();
+            }
+            return k;
+        }
+
+        Kind parse_not() {
+            skip_space();
+            if (pos < src.size() && src[pos] == '!' && src.substr(pos, 2) != "!=") {
+                pos++;
+                if (++nesting > kMaxDepth) fail("condition too deeply nested");
+                if (parse_not() != Kind::Bool) fail("'!' needs a comparison");
+                nesting--;
+                emit(Ins{Op::Not});
+                return Kind::Bool;
+            }
+            return parse_cmp();
+        }
+
+        Kind parse_cmp() {
+            std::size_t lhs_at = prog->code.size();
+            Kind k = parse_primary();
+            static constexpr std::pair<std::string_view, Cmp> ops[] = {
+                {">=", Cmp::Ge}, {"<=", Cmp::Le}, {"==", Cmp::Eq}, {"!=", Cmp::Ne}, {">", Cmp::Gt}, {"<", Cmp::Lt}};
+            for (auto& [tok, cmp] : ops) {
+                if (!eat(tok)) continue;
+                std::size_t rhs_at = prog->code.size();
+                if (k != Kind::Number || parse_primary() != Kind::Number) fail("comparisons take a metric or a number on each side");
+                emit_compare(cmp, lhs_at, rhs_at);
+                return Kind::Bool;
+            }
+            return k;
+        }
+
+        Kind parse_primary() {
+            skip_space();
+            if (pos >= src.size()) fail("unexpected end of condition");
+            char c = src[pos];
+            if (c == '(') {
+                pos++;
+                if (++nesting > kMaxDepth) fail("condition too deeply nested");
+                Kind k = parse_or();
+                nesting--;
+                if (!eat(")")) fail("expected ')'");
+                return k;
+            }
+            if (std::isdigit((unsigned char)c) || c == '.' || c == '-') {
+                bool neg = c == '-';
+                if (neg) pos++;
+                double v = number();
+                Ins in{Op::Const};
+                in.k = neg ? -v : v;
+                emit(in);
+                return Kind::Number;
+            }
+            std::size_t at = pos;
+            std::string_view word = next_word();
+            for (auto& [name, metric] : kMetricNames) {
+                if (word == name) {
+                    Ins in{Op::Load};
+                    in.metric = metric;
+                    emit(in);
+                    return Kind::Number;
+                }
+            }
+            pos = at;
+            fail(word.empty() ? "unexpected '" + std::string(1, c) + "'" : "unknown metric '" + std::string(word) + "'");
+        }
+
+        // Emits the comparison of the operands at lhs_at and rhs_at. `metric
+        // op number` either way round becomes one Test, and the first such
+        // comparison is the rule's subject.
+        void emit_compare(Cmp cmp, std::size_t lhs_at, std::size_t rhs_at) {
+            auto& code = prog->code;
+            if (rhs_at - lhs_at == 1 && code.size() - rhs_at == 1) {
+                const Ins& a = code[lhs_at];
+                const Ins& b = code[rhs_at];
+                Ins test{Op::Test};
+                if (a.op == Op::Load && b.op == Op::Const) {
+                    test.cmp = cmp;
+                    test.metric = a.metric;
+                    test.k = b.k;
+                } else if (a.op == Op::Const && b.op == Op::Load) {
+                    test.cmp = mirror(cmp);
+                    test.metric = b.metric;
+                    test.k = a.k;
+                }
+                if (test.op == Op::Test && a.op != b.op) {
+                    code.resize(lhs_at);
+                    depth -= 2;
+                    emit(test);
+                    if (!prog->has_subject) {
+                        prog->has_subject = true;
+                        prog->subject = test.metric;
+                        prog->subject_threshold = test.k;
+                    }
+                    return;
+                }
+            }
+            Ins in{Op::Compare};
+            in.cmp = cmp;
+            emit(in);
+        }
+    };
+
+    std::vector<Ins> code;
+};
+
+// Alert counts by type, one atomic slot per type name. Slots are handed out as
+// rule sets are compiled and never reused, so counts survive configuration
+// changes; raising an alert is a single relaxed increment.
+class AlertCounters {
+public:
+    static constexpr std::size_t kSlots = 1024;
+
+    // The slot for type; past kSlots - 1 names, every new one shares "OTHER".
+    std::size_t slot(const std::string& type) {
+        std::lock_guard<std::mutex> lock(mu);
+        auto it = index.find(type);
+        if (it != index.end()) return it->second;
+        std::size_t i = names.size() < kSlots - 1 ? names.size() : kSlots - 1;
+        if (i == names.size()) names.push_back(i == kSlots - 1 ? "OTHER" : type);
+        index.emplace(type, i);
+        return i;
+    }
+
+    void add(std::size_t slot) { counts[slot].fetch_add(1, std::memory_order_relaxed); }
+
+    std::vector<std::pair<std::string, long long>> totals() const {
+        std::lock_guard<std::mutex> lock(mu);
+        std::vector<std::pair<std::string, long long>> out;
+        for (std::size_t i = 0; i < names.size(); i++) out.emplace_back(names[i], counts[i].load(std::memory_order_relaxed));
+        return out;
+    }
+
+private:
+    mutable std::mutex mu;  // slot assignment only
+    std::vector<std::string> names;
+    std::unordered_map<std::string, std::size_t> index;
+    std::atomic<long long> counts[kSlots] = {};
+};
+
+// A compiled configuration: named satellite groups and the rules that apply
+// to them. Immutable; /config compiles a new one and swaps it in.
+class RuleSet {
+public:
+    static constexpr std::size_t kMaxRules = 1000;
+    static constexpr const char* kAggregatorError = "AGGREGATOR_ERROR";
+
+    // rules: [{"name" ([A-Za-z0-9_]{1,64}), "when", "severity" (LOW|MED|HIGH,
+    // default MED), "group" (optional)}]; groups: {"name": ["SAT-001", "SAT-1*", ...]},
+    // where a trailing '*' matches by prefix. Throws RuleError.
+    static std::shared_ptr<const RuleSet> compile(const nlohmann::json& rules, const nlohmann::json& groups,
+                                                  std::uint64_t version, AlertCounters& counters) {
+        auto set = std::make_shared<RuleSet>(counters);
+        set->ver = version;
+        set->groups_json = groups.is_null() ? nlohmann::json::object() : groups;
+        if (!set->groups_json.is_object()) throw RuleError("groups must be an object of name: [satellite patterns]");
+        for (auto& [name, members] : set->groups_json.items()) {
+            if (!members.is_array()) throw RuleError("group '" + name + "' must be an array of satellite patterns");
+            Group g;
+            g.name = name;
+            for (auto& m : members) {
+                if (!m.is_string() || m.get<std::string>().empty()) throw RuleError("group '" + name + "' has a non-string member");
+                std::string p = m.get<std::string>();
+                if (p.back() == '*') g.prefixes.push_back(p.substr(0, p.size() - 1));
+                else g.ids.insert(p);
+            }
+            set->groups.push_back(std::move(g));
+        }
+
+        if (!rules.is_array()) throw RuleError("rules must be an array");
+        if (rules.size() > kMaxRules) throw RuleError("too many rules (max " + std::to_string(kMaxRules) + ")");
+        std::unordered_set<std::string> names;  // a rule's name is its alerts' type, so one rule per name
+        for (std::size_t i = 0; i < rules.size(); i++) {
+            const auto& r = rules[i];
+            std::string where = "rule " + std::to_string(i);
+            if (!r.is_object()) throw RuleError(where + ": expected an object");
+            Rule rule;
+            rule.name = r.value("name", std::string());
+            rule.when = r.value("when", std::string());
+            // The name goes verbatim into alert JSON and Prometheus labels.
+            if (rule.name.empty() || rule.name.size() > 64 ||
+                !std::all_of(rule.name.begin(), rule.name.end(),
+                             [](unsigned char c) { return std::isalnum(c) || c == '_'; }))
+                throw RuleError(where + ": name must be 1 to 64 of A-Z, a-z, 0-9 and _");
+            if (rule.name == kAggregatorError) throw RuleError(where + ": " + kAggregatorError + " is reserved");
+            if (!names.insert(rule.name).second) throw RuleError(where + ": another rule is already named '" + rule.name + "'");
+            where += " (" + rule.name + ")";
+            std::string sev = r.value("severity", std::string("MED"));
+            if (sev == "LOW") rule.severity = Severity::Low;
+            else if (sev == "MED") rule.severity = Severity::Med;
+            else if (sev == "HIGH") rule.severity = Severity::High;
+            else throw RuleError(where + ": severity must be LOW, MED or HIGH");
+            if (r.contains("group") && !r["group"].is_null()) {
+                std::string group = r["group"].is_string() ? r["group"].get<std::string>() : std::string();
+                for (std::size_t g = 0; g < set->groups.size(); g++) {
+                    if (set->groups[g].name == group) rule.group = (int)g;
+                }
+                if (rule.group < 0) throw RuleError(where + ": unknown group '" + group + "'");
+            }
+            try {
+                rule.cond = RuleProgram::compile(rule.when, rule.for_cycles);
+            } catch (const RuleError& e) {
+                throw RuleError(where + ": " + e.what());
+            }
+            set->rules.push_back(std::move(rule));
+        }
+        // Only once the whole set has compiled, so a rejected config leaves
+        // no names behind in alerts_total.
+        for (Rule& rule : set->rules) rule.counter = counters.slot(rule.name);
+        set->error_counter = counters.slot(kAggregatorError);
+        return set;
+    }
+
+    explicit RuleSet(AlertCounters& counters) : counters(&counters) {}
+
+    std::uint64_t version() const { return ver; }
+
+    bool uses(Metric k) const {
+        for (const Rule& r : rules) {
+            if (r.cond.uses(k)) return true;
+        }
+        return false;
+    }
+
+    // Alerts for one poll of sat_id, counted in the AlertCounters the set was
+    // compiled against. streaks carries each rule's run of consecutive polls
+    // with its condition true: pass the previous poll's (empty after a
+    // configuration change), get this poll's back. A poll the aggregator
+    // could not answer raises AGGREGATOR_ERROR and resets every run.
+    std::vector<Alert> eval(const std::string& sat_id, const SatMetrics& m, const std::vector<std::uint32_t>& prev,
+                            std::vector<std::uint32_t>& streaks) const {
+        std::vector<Alert> out;
+        streaks.assign(rules.size(), 0);
+        if (!m.ok) {
+            counters->add(error_counter);
+            out.push_back(Alert{Severity::High, kAggregatorError, std::nullopt, std::nullopt, "metrics not ok"});
+            return out;
+        }
+        std::uint64_t in_group = 0;  // bit g set: sat_id is in group g (first 64 groups)
+        for (std::size_t g = 0; g < groups.size() && g < 64; g++) {
+            if (groups[g].matches(sat_id)) in_group |= 1ull << g;
+        }
+        double v[kMetricCount];
+        metric_values(m, v);
+        for (std::size_t i = 0; i < rules.size(); i++) {
+            const Rule& r = rules[i];
+            if (r.group >= 0 && !(r.group < 64 ? (in_group >> r.group) & 1 : groups[r.group].matches(sat_id))) continue;
+            if (!r.cond.eval(v)) continue;
+            streaks[i] = (i < prev.size() ? prev[i] : 0) + 1;
+            if (streaks[i] < r.for_cycles) continue;
+            streaks[i] = r.for_cycles;  // saturate; only "reached N" matters
+            counters->add(r.counter);
+            Alert a{r.severity, r.name, std::nullopt, std::nullopt, nullptr};
+            if (r.cond.has_subject) {
+                a.value = v[(int)r.cond.subject];
+                a.threshold = r.cond.subject_threshold;
+            }
+            out.push_back(std::move(a));
+        }
+        return out;
+    }
+
+    // The configuration this set was compiled from, as /config reports it.
+    nlohmann::json rules_json() const {
+        nlohmann::json out = nlohmann::json::array();
+        for (const Rule& r : rules) {
+            nlohmann::json j = {{"name", r.name}, {"when", r.when}, {"severity", severity_name(r.severity)}};
+            if (r.group >= 0) j["group"] = groups[r.group].name;
+            out.push_back(std::move(j));
+        }
+        return out;
+    }
+
+    const nlohmann::json& groups_config() const { return groups_json; }
+
+private:
+    struct Group {
+        std::string name;
+        std::unordered_set<std::string> ids;
+        std::vector<std::string> prefixes;
+
+        bool matches(const std::string& sat_id) const {
+            if (ids.count(sat_id)) return true;
+            for (const auto& p : prefixes) {
+                if (sat_id.compare(0, p.size(), p) == 0) return true;
+            }
+            return false;
+        }
+    };
+
+    struct Rule {
+        std::string name;
+        std::string when;
+        Severity severity = Severity::Med;
+        int group = -1;  // -1: every satellite
+        RuleProgram cond;
+        std::uint32_t for_cycles = 1;
+        std::size_t counter = 0;
+    };
+
+    AlertCounters* counters;
+    std::uint64_t ver = 0;
+    std::vector<Group> groups;
+    nlohmann::json groups_json;
+    std::vector<Rule> rules;
+    std::size_t error_counter = 0;
+};
+
+} // namespace common
@@ -0,0 +1,262 @@
+#pragma once
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Controlplane poll state: typed per-satellite results and the immutable fleet
+// snapshot that /alerts readers share with the pollers.
+namespace common {
+
+// The aggregator /metrics fields alerts are evaluated on, read once per poll.
+struct SatMetrics {
+    bool ok = false;
+    std::int64_t count = 0;
+    double latency_p50_ms = 0.0;
+    double latency_p95_ms = 0.0;
+    double latency_p99_ms = 0.0;  // from latency_quantiles_ms["99"], when requested with q=99
+    double drop_rate = 0.0;
+    double avg_link_quality = 0.0;
+
+    static SatMetrics from_json(const nlohmann::json& j) {
+        SatMetrics m;
+        auto ok = j.find("ok");
+        m.ok = ok != j.end() && ok->is_boolean() && ok->get<bool>();
+        m.count = j.value("count", (std::int64_t)0);
+        m.latency_p50_ms = j.value("latency_p50_ms", 0.0);
+        m.latency_p95_ms = j.value("latency_p95_ms", 0.0);
+        auto q = j.find("latency_quantiles_ms");
+        if (q != j.end() && q->is_object()) m.latency_p99_ms = q->value("99", 0.0);
+        m.drop_rate = j.value("drop_rate", 0.0);
+        m.avg_link_quality = j.value("avg_link_quality", 0.0);
+        return m;
+    }
+};
+
+enum class Severity : std::uint8_t { Low, Med, High };
+
+inline const char* severity_name(Severity s) {
+    switch (s) {
+    case Severity::Low: return "LOW";
+    case Severity::Med: return "MED";
+    case Severity::High: return "HIGH";
+    }
+    return "MED";
+}
+
+struct Alert {
+    Severity severity;
+    std::string type;
+    std::optional<double> value;      // the metric that tripped and the limit
+    std::optional<double> threshold;  // it crossed, where the rule has one
+    const char* message = nullptr;
+};
+
+inline nlohmann::json alerts_json(const std::vector<Alert>& alerts) {
+    nlohmann::json out = nlohmann::json::array();
+    for (const Alert& a : alerts) {
+        nlohmann::json j = {{"severity", severity_name(a.severity)}, {"type", a.type}};
+        if (a.message) j["message"] = a.message;
+        if (a.value) j["value"] = *a.value;
+        if (a.threshold) j["threshold"] = *a.threshold;
+        out.push_back(std::move(j));
+    }
+    return out;
+}
+
+// One satellite's latest poll; never modified once staged.
+struct SatState {
+    SatMetrics metrics;
+    std::string metrics_json;  // the aggregator's /metrics body, served as is
+    std::vector<Alert> alerts;
+    std::string alerts_json;
+    std::int64_t polled_ms = 0;
+    std::uint64_t rules_version = 0;     // the RuleSet the alerts came from, and
+    std::vector<std::uint32_t> streaks;  // its per-rule runs of true conditions
+};
+
+struct FleetSnapshot {
+    std::uint64_t version = 0;
+    std::int64_t published_ms = 0;
+    std::unordered_map<std::string, std::shared_ptr<const SatState>> sats;
+};
+
+// /alerts/all: every published satellite's alerts, serialized once when they
+// change and shared by every reader. Filtered responses are spliced from the
+// per-alert pieces kept alongside the full body.
+struct FleetAlerts {
+    struct Entry {
+        Severity severity;
+        std::string type;
+        std::string json;
+    };
+    struct Sat {
+        std::string tail;  // `],"sat_id":"..."}`, closing the alerts array
+        std::vector<Entry> alerts;
+    };
+
+    std::vector<Sat> sats;  // by sat_id
+    std::uint64_t cursor = 0;
+    std::string body;       // {"cursor":N,"ok":true,"satellites":[{"alerts":[...],"sat_id":"..."},...]}
+    std::string etag;       // quoted hash of body
+
+    // cursor: the alert change feed position the alerts are current as of,
+    // for following /alerts/changes from.
+    static std::shared_ptr<const FleetAlerts> build(const FleetSnapshot& snap, std::uint64_t cursor) {
+        auto out = std::make_shared<FleetAlerts>();
+        std::vector<const std::string*> ids;
+        ids.reserve(snap.sats.size());
+        for (const auto& [id, state] : snap.sats) ids.push_back(&id);
+        std::sort(ids.begin(), ids.end(), [](const std::string* a, const std::string* b) { return *a < *b; });
+
+        out->cursor = cursor;
+        out->sats.reserve(ids.size());
+        for (const std::string* id : ids) {
+            Sat sat;
+            sat.tail = "],\"sat_id\":" + nlohmann::json(*id).dump() + "}";
+            const SatState& state = *snap.sats.at(*id);
+            nlohmann::json alerts = alerts_json(state.alerts);
+            for (std::size_t i = 0; i < state.alerts.size(); i++) {
+                sat.alerts.push_back(Entry{state.alerts[i].severity, state.alerts[i].type, alerts[i].dump()});
+            }
+            out->sats.push_back(std::move(sat));
+        }
+        out->body = out->render([](const Entry&) { return true; }, false);
+
+        std::uint64_t h = 14695981039346656037ull;  // FNV-1a
+        for (unsigned char c : out->body) h = (h ^ c) * 1099511628211ull;
+        char tag[24];
+        std::snprintf(tag, sizeof(tag), "\"%016llx\"", (unsigned long long)h);
+        out->etag = tag;
+        return out;
+    }
+
+    // The body with only the alerts keep() accepts; with skip_empty, without
+    // satellites left with none.
+    template <class Keep>
+    std::string render(Keep&& keep, bool skip_empty) const {
+        std::string out = "{\"cursor\":" + std::to_string(cursor) + ",\"ok\":true,\"satellites\":[";
+        bool first_sat = true;
+        for (const Sat& sat : sats) {
+            std::size_t mark = out.size();
+            out += first_sat ? "{\"alerts\":[" : ",{\"alerts\":[";
+            bool any = false;
+            for (const Entry& e : sat.alerts) {
+                if (!keep(e)) continue;
+                if (any) out += ',';
+                out += e.json;
+                any = true;
+            }
+            if (skip_empty && !any) {
+                out.resize(mark);
+                continue;
+            }
+            out += sat.tail;
+            first_sat = false;
+        }
+        out += "]}";
+        return out;
+    }
+};
+
+// Pollers stage each satellite's new SatState; publish() folds the staged
+// states into a fresh FleetSnapshot and swaps it in with one atomic store.
+// Readers load() the current snapshot without taking any lock the pollers
+// hold, and keep using it for as long as they hold the pointer. A publish
+// copies the map of pointers, not the states. publish() is meant to be called
+// from a single thread.
+class SnapshotStore {
+public:
+    SnapshotStore() : current(std::make_shared<const FleetSnapshot>()) {}
+
+    // Ignored for satellites outside the last retain() set, so a poll that
+    // finishes after its satellite was unwatched does not bring it back.
+    void stage(const std::string& sat_id, std::shared_ptr<const SatState> state) {
+        std::lock_guard<std::mutex> lock(mu);
+        if (watched && !watched->count(sat_id)) return;
+        staged[sat_id] = std::move(state);
+    }
+
+    // Satellites not in ids are dropped at the next publish.
+    void retain(const std::vector<std::string>& ids) {
+        auto next = std::make_shared<const std::unordered_set<std::string>>(ids.begin(), ids.end());
+        std::lock_guard<std::mutex> lock(mu);
+        for (auto it = staged.begin(); it != staged.end();) {
+            it = next->count(it->first) ? std::next(it) : staged.erase(it);
+        }
+        watched = std::move(next);
+        refilter = true;
+    }
+
+    // False, publishing nothing, if nothing changed since the last publish.
+    bool publish(std::int64_t now_ms) {
+        return publish(now_ms, [](const std::string&, const SatState*, const SatState*) {});
+    }
+
+    // Also calls on_change(sat_id, before, after) for every satellite the new
+    // snapshot differs in, before it becomes visible: before is null for one
+    // seen for the first time, after for one no longer watched.
+    template <class OnChange>
+    bool publish(std::int64_t now_ms, OnChange&& on_change) {
+        std::unordered_map<std::string, std::shared_ptr<const SatState>> changes;
+        std::shared_ptr<const std::unordered_set<std::string>> only;
+        {
+            std::lock_guard<std::mutex> lock(mu);
+            if (staged.empty() && !refilter) return false;
+            changes.swap(staged);
+            if (refilter) only = watched;
+            refilter = false;
+        }
+        auto prev = load();
+        auto next = std::make_shared<FleetSnapshot>();
+        next->version = prev->version + 1;
+        next->published_ms = now_ms;
+        next->sats.reserve(prev->sats.size() + changes.size());
+        for (const auto& [id, state] : prev->sats) {
+            if (!only || only->count(id)) next->sats.emplace(id, state);
+            else if (!changes.count(id)) on_change(id, state.get(), nullptr);
+        }
+        for (auto& [id, state] : changes) {
+            auto it = prev->sats.find(id);
+            on_change(id, it == prev->sats.end() ? nullptr : it->second.get(), state.get());
+            next->sats[id] = std::move(state);
+        }
+        current.store(std::move(next), std::memory_order_release);
+        return true;
+    }
+
+    std::shared_ptr<const FleetSnapshot> load() const { return current.load(std::memory_order_acquire); }
+
+    // The newest state for sat_id, staged or published; null if none. For
+    // pollers carrying state from one poll to the next.
+    std::shared_ptr<const SatState> latest(const std::string& sat_id) {
+        {
+            std::lock_guard<std::mutex> lock(mu);
+            auto it = staged.find(sat_id);
+            if (it != staged.end()) return it->second;
+        }
+        auto snap = load();
+        auto it = snap->sats.find(sat_id);
+        return it == snap->sats.end() ? nullptr : it->second;
+    }
+
+private:
+    std::mutex mu;  // staging only; readers never take it
+    std::unordered_map<std::string, std::shared_ptr<const SatState>> staged;
+    std::shared_ptr<const std::unordered_set<std::string>> watched;
+    bool refilter = false;
+    std::atomic<std::shared_ptr<const FleetSnapshot>> current;
+};
+
+} // namespace common
@@ -0,0 +1,294 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Writer for the Arrow IPC streaming format: a schema message, then one record
+// batch message per flush(), then end(). Enough of the format for flat tables
+// of non-null utf8, int32, int64, float64 and timestamp[ms, UTC] columns, with
+// no dictionaries or body compression. Arrow readers (pyarrow.ipc.open_stream,
+// arrow::ipc::RecordBatchStreamReader, DuckDB, Polars) take it as is.
+//
+// Messages are metadata version V5: a 0xFFFFFFFF continuation marker, the
+// flatbuffer length, the flatbuffer Message padded to 8 bytes, then the body
+// with every buffer 8-byte aligned. See
+// https://arrow.apache.org/docs/format/Columnar.html#serialization-and-interprocess-communication-ipc
+namespace common::arrow {
+
+static_assert(std::endian::native == std::endian::little, "Arrow IPC writer assumes a little-endian host");
+
+enum class Type { Utf8, Int32, Int64, Float64, TimestampMs };
+
+struct Field {
+    std::string name;
+    Type type;
+};
+
+namespace detail {
+
+// Builds one flatbuffer front to back: a parent is written before its children
+// and its offset fields are patched once they exist, since flatbuffer offsets
+// only point forward. Alignment is relative to the buffer start, which the
+// message framing keeps 8-byte aligned in the stream.
+class FlatBuilder {
+public:
+    struct Table {
+        std::size_t pos;
+        std::vector<std::size_t> fields;  // byte offset of each field from pos; 0 if absent
+
+        std::size_t at(std::size_t i) const { return pos + fields[i]; }
+    };
+
+    FlatBuilder() : buf(4, 0) {}
+
+    // A vtable plus an inline table for fields of the given byte sizes, in
+    // field-id order (0 = absent). Fields are placed largest first so each is
+    // naturally aligned; their values start zeroed.
+    Table table(std::initializer_list<std::size_t> sizes) {
+        std::vector<std::size_t> size(sizes);
+        std::vector<std::size_t> offset(size.size(), 0);
+        std::size_t inline_size = 4, max_align = 4;
+        for (std::size_t width : {8, 4, 2, 1}) {
+            for (std::size_t i = 0; i < size.size(); i++) {
+                if (size[i] != width) continue;
+                inline_size = (inline_size + width - 1) / width * width;
+                offset[i] = inline_size;
+                inline_size += width;
+                max_align = std::max(max_align, width);
+            }
+        }
+        inline_size = (inline_size + max_align - 1) / max_align * max_align;
+
+        align(2);
+        std::size_t vtable = buf.size();
+        buf.resize(vtable + 4 + 2 * size.size(), 0);
+        put<std::uint16_t>(vtable, (std::uint16_t)(4 + 2 * size.size()));
+        put<std::uint16_t>(vtable + 2, (std::uint16_t)inline_size);
+        for (std::size_t i = 0; i < size.size(); i++) put<std::uint16_t>(vtable + 4 + 2 * i, (std::uint16_t)offset[i]);
+
+        align(max_align);
+        std::size_t pos = buf.size();
+        buf.resize(pos + inline_size, 0);
+        put<std::int32_t>(pos, (std::int32_t)(pos - vtable));
+        return Table{pos, std::move(offset)};
+    }
+
+    std::size_t string(std::string_view s) {
+        align(4);
+        std::size_t pos = buf.size();
+        buf.resize(pos + 4 + s.size() + 1, 0);
+        put<std::uint32_t>(pos, (std::uint32_t)s.size());
+        if (!s.empty()) std::memcpy(buf.data() + pos + 4, s.data(), s.size());
+        return pos;
+    }
+
+    // A vector of count elements of elem_size bytes whose data is aligned to
+    // elem_align; returns the position of its length prefix. Element i is at
+    // pos + 4 + i * elem_size.
+    std::size_t vector(std::size_t count, std::size_t elem_size, std::size_t elem_align) {
+        std::size_t a = std::max<std::size_t>(elem_align, 4);
+        while ((buf.size() + 4) % a != 0) buf.push_back(0);
+        std::size_t pos = buf.size();
+        buf.resize(pos + 4 + count * elem_size, 0);
+        put<std::uint32_t>(pos, (std::uint32_t)count);
+        return pos;
+    }
+
+    // Points the offset field at `at` to `target`, written after it.
+    void ref(std::size_t at, std::size_t target) { put<std::uint32_t>(at, (std::uint32_t)(target - at)); }
+
+    template <class T>
+    void put(std::size_t at, T v) {
+        std::memcpy(buf.data() + at, &v, sizeof(T));
+    }
+
+    std::vector<std::uint8_t> finish(std::size_t root) {
+        ref(0, root);
+        return std::move(buf);
+    }
+
+private:
+    void align(std::size_t a) {
+        while (buf.size() % a != 0) buf.push_back(0);
+    }
+
+    std::vector<std::uint8_t> buf;
+};
+
+// Schema.fbs / Message.fbs enum values.
+constexpr std::int16_t kMetadataV5 = 4;
+constexpr std::uint8_t kHeaderSchema = 1;
+constexpr std::uint8_t kHeaderRecordBatch = 3;
+constexpr std::uint8_t kTypeInt = 2;
+constexpr std::uint8_t kTypeFloatingPoint = 3;
+constexpr std::uint8_t kTypeUtf8 = 5;
+constexpr std::uint8_t kTypeTimestamp = 10;
+constexpr std::int16_t kPrecisionDouble = 2;
+constexpr std::int16_t kUnitMillisecond = 1;
+
+// Message { version, header_type, header, bodyLength }, header to be patched.
+inline FlatBuilder::Table message(FlatBuilder& fb, std::uint8_t header_type, std::int64_t body_length) {
+    auto msg = fb.table({2, 1, 4, 8});
+    fb.put<std::int16_t>(msg.at(0), kMetadataV5);
+    fb.put<std::uint8_t>(msg.at(1), header_type);
+    fb.put<std::int64_t>(msg.at(3), body_length);
+    return msg;
+}
+
+inline void frame(std::string& out, const std::vector<std::uint8_t>& meta, std::string_view body) {
+    std::size_t padded = (meta.size() + 7) / 8 * 8;
+    std::uint32_t marker = 0xFFFFFFFFu;
+    std::int32_t len = (std::int32_t)padded;
+    out.append(reinterpret_cast<const char*>(&marker), 4);
+    out.append(reinterpret_cast<const char*>(&len), 4);
+    out.append(reinterpret_cast<const char*>(meta.data()), meta.size());
+    out.append(padded - meta.size(), '\0');
+    out.append(body);
+}
+
+} // namespace detail
+
+class StreamWriter {
+public:
+    explicit StreamWriter(std::vector<Field> fields) : fields(std::move(fields)), columns(this->fields.size()) {
+        for (std::size_t i = 0; i < columns.size(); i++) {
+            if (this->fields[i].type == Type::Utf8) columns[i].offsets.push_back(0);
+        }
+    }
+
+    // The schema message; goes first in the stream.
+    std::string schema() const {
+        detail::FlatBuilder fb;
+        auto msg = detail::message(fb, detail::kHeaderSchema, 0);
+        auto schema = fb.table({0, 4});  // endianness (Little, the default), fields
+        fb.ref(msg.at(2), schema.pos);
+        std::size_t vec = fb.vector(fields.size(), 4, 4);
+        fb.ref(schema.at(1), vec);
+        for (std::size_t i = 0; i < fields.size(); i++) {
+            // name, nullable, type_type, type, dictionary, children
+            auto f = fb.table({4, 0, 1, 4, 0, 4});
+            fb.ref(vec + 4 + 4 * i, f.pos);
+            fb.ref(f.at(0), fb.string(fields[i].name));
+            switch (fields[i].type) {
+            case Type::Utf8: {
+                fb.put<std::uint8_t>(f.at(2), detail::kTypeUtf8);
+                fb.ref(f.at(3), fb.table({}).pos);
+                break;
+            }
+            case Type::Int32:
+            case Type::Int64: {
+                fb.put<std::uint8_t>(f.at(2), detail::kTypeInt);
+                auto t = fb.table({4, 1});  // bitWidth, is_signed
+                fb.put<std::int32_t>(t.at(0), fields[i].type == Type::Int32 ? 32 : 64);
+                fb.put<std::uint8_t>(t.at(1), 1);
+                fb.ref(f.at(3), t.pos);
+                break;
+            }
+            case Type::Float64: {
+                fb.put<std::uint8_t>(f.at(2), detail::kTypeFloatingPoint);
+                auto t = fb.table({2});  // precision
+                fb.put<std::int16_t>(t.at(0), detail::kPrecisionDouble);
+                fb.ref(f.at(3), t.pos);
+                break;
+            }
+            case Type::TimestampMs: {
+                fb.put<std::uint8_t>(f.at(2), detail::kTypeTimestamp);
+                auto t = fb.table({2, 4});  // unit, timezone
+                fb.put<std::int16_t>(t.at(0), detail::kUnitMillisecond);
+                fb.ref(t.at(1), fb.string("UTC"));
+                fb.ref(f.at(3), t.pos);
+                break;
+            }
+            }
+            // Readers insist on a children vector, even an empty one.
+            fb.ref(f.at(5), fb.vector(0, 4, 4));
+        }
+        std::string out;
+        detail::frame(out, fb.finish(msg.pos), {});
+        return out;
+    }
+
+    void append(std::size_t col, std::string_view v) {
+        Column& c = columns[col];
+        c.data.append(v);
+        c.offsets.push_back((std::int32_t)c.data.size());
+    }
+    void append(std::size_t col, std::int32_t v) { columns[col].data.append(reinterpret_cast<const char*>(&v), 4); }
+    void append(std::size_t col, std::int64_t v) { columns[col].data.append(reinterpret_cast<const char*>(&v), 8); }
+    void append(std::size_t col, double v) { columns[col].data.append(reinterpret_cast<const char*>(&v), 8); }
+
+    // Call once per row, after appending one value to every column.
+    void end_row() { rows++; }
+
+    std::size_t pending_rows() const { return rows; }
+
+    // A record batch message with the rows appended since the last flush;
+    // empty if there are none. Utf8 columns hold at most 2 GiB per batch.
+    std::string flush() {
+        if (rows == 0) return {};
+        std::string body;
+        std::vector<std::pair<std::int64_t, std::int64_t>> buffers;
+        auto add = [&](const void* p, std::size_t n) {
+            buffers.emplace_back((std::int64_t)body.size(), (std::int64_t)n);
+            body.append(static_cast<const char*>(p), n);
+            body.append((8 - body.size() % 8) % 8, '\0');
+        };
+        for (std::size_t i = 0; i < columns.size(); i++) {
+            Column& c = columns[i];
+            add(nullptr, 0);  // no validity bitmap: nothing is null
+            if (fields[i].type == Type::Utf8) {
+                if (c.data.size() > (std::size_t)INT32_MAX) throw std::length_error("arrow utf8 batch over 2 GiB");
+                add(c.offsets.data(), c.offsets.size() * 4);
+            }
+            add(c.data.data(), c.data.size());
+        }
+
+        detail::FlatBuilder fb;
+        auto msg = detail::message(fb, detail::kHeaderRecordBatch, (std::int64_t)body.size());
+        auto batch = fb.table({8, 4, 4});  // length, nodes, buffers
+        fb.ref(msg.at(2), batch.pos);
+        fb.put<std::int64_t>(batch.at(0), (std::int64_t)rows);
+        std::size_t nodes = fb.vector(columns.size(), 16, 8);
+        fb.ref(batch.at(1), nodes);
+        for (std::size_t i = 0; i < columns.size(); i++) {
+            fb.put<std::int64_t>(nodes + 4 + 16 * i, (std::int64_t)rows);  // length; null_count stays 0
+        }
+        std::size_t bufs = fb.vector(buffers.size(), 16, 8);
+        fb.ref(batch.at(2), bufs);
+        for (std::size_t i = 0; i < buffers.size(); i++) {
+            fb.put<std::int64_t>(bufs + 4 + 16 * i, buffers[i].first);
+            fb.put<std::int64_t>(bufs + 12 + 16 * i, buffers[i].second);
+        }
+
+        std::string out;
+        detail::frame(out, fb.finish(msg.pos), body);
+        for (auto& c : columns) {
+            c.data.clear();
+            if (!c.offsets.empty()) c.offsets.assign(1, 0);
+        }
+        rows = 0;
+        return out;
+    }
+
+    // End-of-stream marker.
+    static std::string end() { return std::string("\xFF\xFF\xFF\xFF\0\0\0\0", 8); }
+
+private:
+    struct Column {
+        std::string data;
+        std::vector<std::int32_t> offsets;  // utf8 only
+    };
+
+    std::vector<Field> fields;
+    std::vector<Column> columns;
+    std::size_t rows = 0;
+};
+
+} // namespace common::arrow
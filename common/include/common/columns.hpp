@@ -0,0 +1,433 @@
+#pragma once
+
+#include "common/config.hpp"
+#include "common/window_stats.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define COMMON_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+// Window data held column by column, and the kernels that reduce it.
+//
+// Each kernel has a scalar version and, on x86-64 with GCC or Clang, AVX2 and
+// AVX-512 versions built with per-function target attributes, so the binary
+// still runs on any x86-64 CPU. The widest level the CPU supports is picked
+// on first use; TELEMETRY_SIMD=scalar|avx2 caps it. Integer results are the
+// same at every level; floating-point sums are added in a different order
+// and may differ in the last bits.
+namespace common {
+
+namespace simd {
+
+enum class Level { Scalar, Avx2, Avx512 };
+
+inline const char* level_name(Level l) {
+    switch (l) {
+    case Level::Avx512: return "avx512";
+    case Level::Avx2: return "avx2";
+    default: return "scalar";
+    }
+}
+
+inline Level detected_level() {
+#ifdef COMMON_SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq")) return Level::Avx512;
+    if (__builtin_cpu_supports("avx2")) return Level::Avx2;
+#endif
+    return Level::Scalar;
+}
+
+inline Level active_level() {
+    static const Level level = [] {
+        Level l = detected_level();
+        std::string cap = env_str("TELEMETRY_SIMD", "");
+        if (cap == "scalar") return Level::Scalar;
+        if (cap == "avx2" && l == Level::Avx512) return Level::Avx2;
+        return l;
+    }();
+    return level;
+}
+
+// One window's rows; every array holds n entries.
+struct ColumnSpan {
+    const std::int64_t* ts = nullptr;
+    const double* latency = nullptr;
+    const double* link_quality = nullptr;
+    const std::int32_t* dropped = nullptr;
+    const std::int32_t* sent = nullptr;
+    std::size_t n = 0;
+
+    ColumnSpan from(std::size_t i) const {
+        return {ts + i, latency + i, link_quality + i, dropped + i, sent + i, n - i};
+    }
+};
+
+struct WindowSums {
+    std::int64_t count = 0;
+    std::int64_t sum_dropped = 0;
+    std::int64_t sum_sent = 0;
+    double sum_link_quality = 0.0;
+    double min_latency = std::numeric_limits<double>::infinity();
+    double max_latency = -std::numeric_limits<double>::infinity();
+
+    void merge(const WindowSums& o) {
+        count += o.count;
+        sum_dropped += o.sum_dropped;
+        sum_sent += o.sum_sent;
+        sum_link_quality += o.sum_link_quality;
+        min_latency = std::min(min_latency, o.min_latency);
+        max_latency = std::max(max_latency, o.max_latency);
+    }
+};
+
+namespace detail {
+
+inline WindowSums sum_range_scalar(const ColumnSpan& c, std::int64_t from, std::int64_t to) {
+    WindowSums s;
+    for (std::size_t i = 0; i < c.n; i++) {
+        if (c.ts[i] < from || c.ts[i] >= to) continue;
+        s.count++;
+        s.sum_dropped += c.dropped[i];
+        s.sum_sent += c.sent[i];
+        s.sum_link_quality += c.link_quality[i];
+        s.min_latency = std::min(s.min_latency, c.latency[i]);
+        s.max_latency = std::max(s.max_latency, c.latency[i]);
+    }
+    return s;
+}
+
+inline std::size_t copy_range_scalar(const std::int64_t* ts, const double* v, std::size_t n, std::int64_t from,
+                                     std::int64_t to, double* out) {
+    std::size_t k = 0;
+    for (std::size_t i = 0; i < n; i++) {
+        out[k] = v[i];
+        k += (ts[i] >= from && ts[i] < to) ? 1 : 0;
+    }
+    return k;
+}
+
+inline void bucket_index_scalar(const std::int64_t* ts, std::size_t n, std::int64_t from, std::int64_t step,
+                                std::int64_t span, std::int32_t* out) {
+    for (std::size_t i = 0; i < n; i++) {
+        std::int64_t d = ts[i] - from;
+        out[i] = (d < 0 || d >= span) ? -1 : (std::int32_t)(d / step);
+    }
+}
+
+#ifdef COMMON_SIMD_X86
+
+// Lanes of ts outside [from, to) as all-ones.
+__attribute__((target("avx2"))) inline __m256i outside_avx2(__m256i ts, __m256i vfrom, __m256i vto) {
+    __m256i below = _mm256_cmpgt_epi64(vfrom, ts);
+    __m256i before_to = _mm256_cmpgt_epi64(vto, ts);
+    return _mm256_or_si256(below, _mm256_xor_si256(before_to, _mm256_set1_epi64x(-1)));
+}
+
+__attribute__((target("avx2"))) inline WindowSums sum_range_avx2(const ColumnSpan& c, std::int64_t from,
+                                                                 std::int64_t to) {
+    const __m256i vfrom = _mm256_set1_epi64x(from), vto = _mm256_set1_epi64x(to);
+    const __m256d inf = _mm256_set1_pd(std::numeric_limits<double>::infinity());
+    const __m256d ninf = _mm256_set1_pd(-std::numeric_limits<double>::infinity());
+    __m256i acc_dropped = _mm256_setzero_si256(), acc_sent = _mm256_setzero_si256();
+    __m256d acc_lq = _mm256_setzero_pd(), lo = inf, hi = ninf;
+    std::int64_t count = 0;
+    std::size_t i = 0;
+    for (; i + 4 <= c.n; i += 4) {
+        __m256i skip = outside_avx2(_mm256_loadu_si256((const __m256i*)(c.ts + i)), vfrom, vto);
+        __m256d skip_pd = _mm256_castsi256_pd(skip);
+        __m256i d = _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i*)(c.dropped + i)));
+        __m256i s = _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i*)(c.sent + i)));
+        acc_dropped = _mm256_add_epi64(acc_dropped, _mm256_andnot_si256(skip, d));
+        acc_sent = _mm256_add_epi64(acc_sent, _mm256_andnot_si256(skip, s));
+        acc_lq = _mm256_add_pd(acc_lq, _mm256_andnot_pd(skip_pd, _mm256_loadu_pd(c.link_quality + i)));
+        __m256d lat = _mm256_loadu_pd(c.latency + i);
+        lo = _mm256_min_pd(lo, _mm256_blendv_pd(lat, inf, skip_pd));
+        hi = _mm256_max_pd(hi, _mm256_blendv_pd(lat, ninf, skip_pd));
+        count += 4 - __builtin_popcount(_mm256_movemask_pd(skip_pd));
+    }
+    alignas(32) std::int64_t di[4], si[4];
+    alignas(32) double lqd[4], lod[4], hid[4];
+    _mm256_store_si256((__m256i*)di, acc_dropped);
+    _mm256_store_si256((__m256i*)si, acc_sent);
+    _mm256_store_pd(lqd, acc_lq);
+    _mm256_store_pd(lod, lo);
+    _mm256_store_pd(hid, hi);
+    WindowSums out;
+    out.count = count;
+    for (int j = 0; j < 4; j++) {
+        out.sum_dropped += di[j];
+        out.sum_sent += si[j];
+        out.sum_link_quality += lqd[j];
+        out.min_latency = std::min(out.min_latency, lod[j]);
+        out.max_latency = std::max(out.max_latency, hid[j]);
+    }
+    out.merge(sum_range_scalar(c.from(i), from, to));
+    return out;
+}
+
+// Row j of the table moves the doubles whose bit is set in j to the front,
+// as pairs of 32-bit lanes for _mm256_permutevar8x32_ps.
+struct CompressTable {
+    alignas(32) std::int32_t idx[16][8];
+    constexpr CompressTable() : idx{} {
+        for (int m = 0; m < 16; m++) {
+            int o = 0;
+            for (int j = 0; j < 4; j++) {
+                if (m >> j & 1) {
+                    idx[m][o++] = 2 * j;
+                    idx[m][o++] = 2 * j + 1;
+                }
+            }
+        }
+    }
+};
+inline constexpr CompressTable kCompressTable{};
+
+__attribute__((target("avx2"))) inline std::size_t copy_range_avx2(const std::int64_t* ts, const double* v,
+                                                                    std::size_t n, std::int64_t from, std::int64_t to,
+                                                                    double* out) {
+    const __m256i vfrom = _mm256_set1_epi64x(from), vto = _mm256_set1_epi64x(to);
+    std::size_t i = 0, k = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i skip = outside_avx2(_mm256_loadu_si256((const __m256i*)(ts + i)), vfrom, vto);
+        int keep = ~_mm256_movemask_pd(_mm256_castsi256_pd(skip)) & 0xF;
+        __m256i perm = _mm256_load_si256((const __m256i*)kCompressTable.idx[keep]);
+        // Writes a full vector at out + k <= out + i; only the kept prefix counts.
+        _mm256_storeu_ps((float*)(out + k), _mm256_permutevar8x32_ps(_mm256_castpd_ps(_mm256_loadu_pd(v + i)), perm));
+        k += (std::size_t)__builtin_popcount(keep);
+    }
+    return k + copy_range_scalar(ts + i, v + i, n - i, from, to, out + k);
+}
+
+__attribute__((target("avx2"))) inline void bucket_index_avx2(const std::int64_t* ts, std::size_t n,
+                                                               std::int64_t from, std::int64_t step,
+                                                               std::int64_t span, std::int32_t* out) {
+    // d in [0, span) with span <= 2^52 converts exactly through the 2^52
+    // mantissa trick, and floor(d / step) in doubles is then exact too.
+    const __m256i vfrom = _mm256_set1_epi64x(from);
+    const __m256i vlast = _mm256_set1_epi64x(span - 1);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i magic_i = _mm256_set1_epi64x(0x4330000000000000LL);
+    const __m256d magic_d = _mm256_set1_pd(4503599627370496.0);
+    const __m256d vstep = _mm256_set1_pd((double)step);
+    const __m256i low_halves = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+    const __m128i none = _mm_set1_epi32(-1);
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i d = _mm256_sub_epi64(_mm256_loadu_si256((const __m256i*)(ts + i)), vfrom);
+        __m256i bad = _mm256_or_si256(_mm256_cmpgt_epi64(zero, d), _mm256_cmpgt_epi64(d, vlast));
+        __m256d dd = _mm256_sub_pd(_mm256_castsi256_pd(_mm256_or_si256(d, magic_i)), magic_d);
+        __m128i q = _mm256_cvttpd_epi32(_mm256_div_pd(dd, vstep));
+        __m128i bad32 = _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(bad, low_halves));
+        _mm_storeu_si128((__m128i*)(out + i), _mm_blendv_epi8(q, none, bad32));
+    }
+    bucket_index_scalar(ts + i, n - i, from, step, span, out + i);
+}
+
+__attribute__((target("avx512f,avx512dq"))) inline WindowSums sum_range_avx512(const ColumnSpan& c,
+                                                                                std::int64_t from, std::int64_t to) {
+    const __m512i vfrom = _mm512_set1_epi64(from), vto = _mm512_set1_epi64(to);
+    __m512i acc_dropped = _mm512_setzero_si512(), acc_sent = _mm512_setzero_si512();
+    __m512d acc_lq = _mm512_setzero_pd();
+    __m512d lo = _mm512_set1_pd(std::numeric_limits<double>::infinity());
+    __m512d hi = _mm512_set1_pd(-std::numeric_limits<double>::infinity());
+    std::int64_t count = 0;
+    std::size_t i = 0;
+    for (; i + 8 <= c.n; i += 8) {
+        __m512i ts = _mm512_loadu_si512(c.ts + i);
+        __mmask8 keep = _mm512_cmpge_epi64_mask(ts, vfrom) & _mm512_cmplt_epi64_mask(ts, vto);
+        // The zero-masked widenings drop the skipped rows; they also avoid the
+        // undefined-source forms GCC 12 warns about.
+        acc_dropped = _mm512_add_epi64(acc_dropped,
+            _mm512_maskz_cvtepi32_epi64(keep, _mm256_loadu_si256((const __m256i*)(c.dropped + i))));
+        acc_sent = _mm512_add_epi64(acc_sent,
+            _mm512_maskz_cvtepi32_epi64(keep, _mm256_loadu_si256((const __m256i*)(c.sent + i))));
+        acc_lq = _mm512_mask_add_pd(acc_lq, keep, acc_lq, _mm512_loadu_pd(c.link_quality + i));
+        __m512d lat = _mm512_loadu_pd(c.latency + i);
+        lo = _mm512_mask_min_pd(lo, keep, lo, lat);
+        hi = _mm512_mask_max_pd(hi, keep, hi, lat);
+        count += __builtin_popcount(keep);
+    }
+    alignas(64) std::int64_t di[8], si[8];
+    alignas(64) double lqd[8], lod[8], hid[8];
+    _mm512_store_si512(di, acc_dropped);
+    _mm512_store_si512(si, acc_sent);
+    _mm512_store_pd(lqd, acc_lq);
+    _mm512_store_pd(lod, lo);
+    _mm512_store_pd(hid, hi);
+    WindowSums out;
+    out.count = count;
+    for (int j = 0; j < 8; j++) {
+        out.sum_dropped += di[j];
+        out.sum_sent += si[j];
+        out.sum_link_quality += lqd[j];
+        out.min_latency = std::min(out.min_latency, lod[j]);
+        out.max_latency = std::max(out.max_latency, hid[j]);
+    }
+    out.merge(sum_range_scalar(c.from(i), from, to));
+    return out;
+}
+
+__attribute__((target("avx512f,avx512dq"))) inline std::size_t copy_range_avx512(const std::int64_t* ts,
+                                                                                  const double* v, std::size_t n,
+                                                                                  std::int64_t from, std::int64_t to,
+                                                                                  double* out) {
+    const __m512i vfrom = _mm512_set1_epi64(from), vto = _mm512_set1_epi64(to);
+    std::size_t i = 0, k = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m512i t = _mm512_loadu_si512(ts + i);
+        __mmask8 keep = _mm512_cmpge_epi64_mask(t, vfrom) & _mm512_cmplt_epi64_mask(t, vto);
+        _mm512_mask_compressstoreu_pd(out + k, keep, _mm512_loadu_pd(v + i));
+        k += (std::size_t)__builtin_popcount(keep);
+    }
+    return k + copy_range_scalar(ts + i, v + i, n - i, from, to, out + k);
+}
+
+__attribute__((target("avx512f,avx512dq"))) inline void bucket_index_avx512(const std::int64_t* ts, std::size_t n,
+                                                                             std::int64_t from, std::int64_t step,
+                                                                             std::int64_t span, std::int32_t* out) {
+    const __m512i vfrom = _mm512_set1_epi64(from);
+    const __m512i vspan = _mm512_set1_epi64(span);
+    const __m512i zero = _mm512_setzero_si512();
+    const __m512d vstep = _mm512_set1_pd((double)step);
+    const __m256i none = _mm256_set1_epi32(-1);
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m512i d = _mm512_sub_epi64(_mm512_loadu_si512(ts + i), vfrom);
+        __mmask8 ok = _mm512_cmpge_epi64_mask(d, zero) & _mm512_cmplt_epi64_mask(d, vspan);
+        __m512d q = _mm512_div_pd(_mm512_cvtepi64_pd(d), vstep);
+        _mm256_storeu_si256((__m256i*)(out + i), _mm512_mask_cvttpd_epi32(none, ok, q));
+    }
+    bucket_index_scalar(ts + i, n - i, from, step, span, out + i);
+}
+
+#endif // COMMON_SIMD_X86
+
+} // namespace detail
+
+// Count, sums and latency min/max over the rows with from <= ts < to.
+// `level` must not exceed detected_level().
+inline WindowSums sum_range(const ColumnSpan& c, std::int64_t from, std::int64_t to, Level level = active_level()) {
+    switch (level) {
+#ifdef COMMON_SIMD_X86
+    case Level::Avx512: return detail::sum_range_avx512(c, from, to);
+    case Level::Avx2: return detail::sum_range_avx2(c, from, to);
+#endif
+    default: return detail::sum_range_scalar(c, from, to);
+    }
+}
+
+// Copies v[i] for every row with from <= ts[i] < to to out, in order, and
+// returns how many were copied. out must have room for n values.
+inline std::size_t copy_range(const std::int64_t* ts, const double* v, std::size_t n, std::int64_t from,
+                              std::int64_t to, double* out, Level level = active_level()) {
+    switch (level) {
+#ifdef COMMON_SIMD_X86
+    case Level::Avx512: return detail::copy_range_avx512(ts, v, n, from, to, out);
+    case Level::Avx2: return detail::copy_range_avx2(ts, v, n, from, to, out);
+#endif
+    default: return detail::copy_range_scalar(ts, v, n, from, to, out);
+    }
+}
+
+// Histogram bucketing: out[i] = floor((ts[i] - from) / step) for rows inside
+// [from, from + step * buckets), -1 for the rest. step > 0, buckets >= 0.
+inline void bucket_index(const std::int64_t* ts, std::size_t n, std::int64_t from, std::int64_t step,
+                         std::int32_t buckets, std::int32_t* out, Level level = active_level()) {
+    std::int64_t span = step > std::numeric_limits<std::int64_t>::max() / std::max<std::int32_t>(1, buckets)
+                            ? std::numeric_limits<std::int64_t>::max()
+                            : step * buckets;
+    // The vector versions convert offsets through doubles.
+    if (span > (1LL << 52)) level = Level::Scalar;
+    switch (level) {
+#ifdef COMMON_SIMD_X86
+    case Level::Avx512: return detail::bucket_index_avx512(ts, n, from, step, span, out);
+    case Level::Avx2: return detail::bucket_index_avx2(ts, n, from, step, span, out);
+#endif
+    default: return detail::bucket_index_scalar(ts, n, from, step, span, out);
+    }
+}
+
+} // namespace simd
+
+// One satellite's rows in arrival order, one vector per column. Rows leave
+// from the front by advancing head; the vectors are compacted once the dead
+// prefix outgrows the live rows, so dropping is amortised O(1) per row.
+class WindowColumns {
+public:
+    static constexpr std::size_t kRowBytes = sizeof(std::int64_t) + 2 * sizeof(double) + 2 * sizeof(std::int32_t);
+
+    void push_back(std::int64_t ts_ms, double latency_ms, double lq, std::int32_t dropped_packets,
+                   std::int32_t sent_packets) {
+        ts.push_back(ts_ms);
+        latency.push_back(latency_ms);
+        link_quality.push_back(lq);
+        dropped.push_back(dropped_packets);
+        sent.push_back(sent_packets);
+    }
+
+    std::size_t size() const { return ts.size() - head; }
+    bool empty() const { return size() == 0; }
+
+    // Drops leading rows older than cut; returns how many.
+    std::size_t drop_front_before(std::int64_t cut) {
+        std::size_t start = head;
+        while (head < ts.size() && ts[head] < cut) head++;
+        std::size_t dropped_rows = head - start;
+        if (head >= 1024 && head * 2 >= ts.size()) compact();
+        return dropped_rows;
+    }
+
+    simd::ColumnSpan span() const {
+        return {ts.data() + head, latency.data() + head, link_quality.data() + head, dropped.data() + head,
+                sent.data() + head, size()};
+    }
+
+private:
+    void compact() {
+        auto cut = [this](auto& v) { v.erase(v.begin(), v.begin() + (std::ptrdiff_t)head); };
+        cut(ts);
+        cut(latency);
+        cut(link_quality);
+        cut(dropped);
+        cut(sent);
+        head = 0;
+    }
+
+    std::vector<std::int64_t> ts;
+    std::vector<double> latency;
+    std::vector<double> link_quality;
+    std::vector<std::int32_t> dropped;
+    std::vector<std::int32_t> sent;
+    std::size_t head = 0;
+};
+
+// Adds the rows with from <= ts < to to stats; returns how many.
+inline std::int64_t accumulate_range(const simd::ColumnSpan& c, std::int64_t from, std::int64_t to,
+                                     WindowStats& stats) {
+    simd::WindowSums sums = simd::sum_range(c, from, to);
+    if (sums.count == 0) return 0;
+    stats.count += sums.count;
+    stats.sum_dropped += sums.sum_dropped;
+    stats.sum_sent += sums.sum_sent;
+    stats.sum_link_quality += sums.sum_link_quality;
+    if ((std::size_t)sums.count == c.n) {
+        stats.latency.add(c.latency, c.n);
+        return sums.count;
+    }
+    thread_local std::vector<double> selected;
+    if (selected.size() < c.n) selected.resize(c.n);
+    std::size_t k = simd::copy_range(c.ts, c.latency, c.n, from, to, selected.data());
+    stats.latency.add(selected.data(), k);
+    return sums.count;
+}
+
+} // namespace common
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdlib>
+#include <string>
+
+// Tunables are read from the environment so the positional CLI (port, db path)
+// stays unchanged. Unset or unparsable values fall back to the default.
+namespace common {
+
+inline long long env_int(const char* name, long long def) {
+    const char* v = std::getenv(name);
+    if (!v || !*v) return def;
+    char* end = nullptr;
+    long long x = std::strtoll(v, &end, 10);
+    return (end && *end == '\0') ? x : def;
+}
+
+inline double env_double(const char* name, double def) {
+    const char* v = std::getenv(name);
+    if (!v || !*v) return def;
+    char* end = nullptr;
+    double x = std::strtod(v, &end);
+    return (end && *end == '\0') ? x : def;
+}
+
+inline std::string env_str(const char* name, const std::string& def) {
+    const char* v = std::getenv(name);
+    return (v && *v) ? std::string(v) : def;
+}
+
+} // namespace common
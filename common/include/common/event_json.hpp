@@ -0,0 +1,264 @@
+#pragma once
+
+#include <nlohmann/json.hpp>
+
+#include "common/telemetry.hpp"
+
+#include <charconv>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <string_view>
+
+// Two decoders for one JSON telemetry event: the reference DOM path
+// (nlohmann parse + validate_event) and a schema-specialized single-pass
+// decoder that reads straight into an EventView borrowing from the body.
+namespace common {
+
+inline bool validate_event(const nlohmann::json& j, std::string& err) {
+    const char* req[] = {"event_id","sat_id","ts_ms","latency_ms","dropped_packets","sent_packets","link_quality"};
+    for (auto k : req) if (!j.contains(k)) { err = std::string("missing field: ") + k; return false; }
+
+    if (!j["event_id"].is_string() || j["event_id"].get_ref<const std::string&>().empty()) { err = "event_id invalid"; return false; }
+    if (!j["sat_id"].is_string()   || j["sat_id"].get_ref<const std::string&>().empty())   { err = "sat_id invalid"; return false; }
+    if (!j["ts_ms"].is_number_integer()) { err = "ts_ms must be int64"; return false; }
+    if (!j["latency_ms"].is_number())    { err = "latency_ms must be number"; return false; }
+    if (!j["dropped_packets"].is_number_integer()) { err = "dropped_packets must be int"; return false; }
+    if (!j["sent_packets"].is_number_integer())    { err = "sent_packets must be int"; return false; }
+
+    EventView ev;
+    ev.event_id = j["event_id"].get_ref<const std::string&>();
+    ev.sat_id = j["sat_id"].get_ref<const std::string&>();
+    ev.latency_ms = j["latency_ms"].get<double>();
+    ev.sent_packets = j["sent_packets"].get<int>();
+    ev.dropped_packets = j["dropped_packets"].get<int>();
+    ev.link_quality = j["link_quality"].get<double>();
+    return validate_ranges(ev, err);
+}
+
+// Ok: ev is filled and passed validation. Invalid: err holds the message
+// validate_event would have produced. Fallback: the input is outside what the
+// fast path reproduces exactly (escaped or non-ASCII strings, malformed JSON,
+// out-of-range integers, a non-numeric link_quality, ...); the caller must
+// re-run the DOM path, which also owns every parse-error message.
+enum class DecodeResult { Ok, Invalid, Fallback };
+
+namespace detail {
+
+class EventJsonDecoder {
+public:
+    explicit EventJsonDecoder(std::string_view s) : p(s.data()), end(s.data() + s.size()) {}
+
+    DecodeResult run(EventView& ev, std::string& err) {
+        ws();
+        if (!eat('{')) return DecodeResult::Fallback;
+        ws();
+        if (!eat('}')) {
+            while (true) {
+                std::string_view key;
+                ws();
+                if (!string(key)) return DecodeResult::Fallback;
+                ws();
+                if (!eat(':')) return DecodeResult::Fallback;
+                ws();
+                int slot = slot_of(key);
+                if (!(slot < 0 ? skip_value(0) : value(fields[slot]))) return DecodeResult::Fallback;
+                ws();
+                if (eat(',')) continue;
+                if (eat('}')) break;
+                return DecodeResult::Fallback;
+            }
+        }
+        ws();
+        if (p != end) return DecodeResult::Fallback;
+        return finish(ev, err);
+    }
+
+private:
+    enum Kind { Missing, String, Int, Float, Other };
+    struct Field {
+        Kind kind = Missing;
+        std::string_view str;
+        std::int64_t i = 0;
+        double d = 0.0;
+    };
+    enum Slot { EventId, SatId, TsMs, LatencyMs, Dropped, Sent, LinkQuality, SlotCount };
+
+    static int slot_of(std::string_view k) {
+        static constexpr std::string_view names[SlotCount] = {
+            "event_id", "sat_id", "ts_ms", "latency_ms", "dropped_packets", "sent_packets", "link_quality"};
+        for (int i = 0; i < SlotCount; i++) if (k == names[i]) return i;
+        return -1;
+    }
+
+    DecodeResult finish(EventView& ev, std::string& err) {
+        static const char* names[SlotCount] = {
+            "event_id", "sat_id", "ts_ms", "latency_ms", "dropped_packets", "sent_packets", "link_quality"};
+        for (int i = 0; i < SlotCount; i++) {
+            if (fields[i].kind == Missing) { err = std::string("missing field: ") + names[i]; return DecodeResult::Invalid; }
+        }
+
+        auto& id = fields[EventId];
+        auto& sat = fields[SatId];
+        if (id.kind != String || id.str.empty())  { err = "event_id invalid"; return DecodeResult::Invalid; }
+        if (sat.kind != String || sat.str.empty()) { err = "sat_id invalid"; return DecodeResult::Invalid; }
+        if (fields[TsMs].kind != Int) { err = "ts_ms must be int64"; return DecodeResult::Invalid; }
+        if (!is_number(fields[LatencyMs])) { err = "latency_ms must be number"; return DecodeResult::Invalid; }
+        if (fields[Dropped].kind != Int) { err = "dropped_packets must be int"; return DecodeResult::Invalid; }
+        if (fields[Sent].kind != Int)    { err = "sent_packets must be int"; return DecodeResult::Invalid; }
+
+        // get<int>() would narrow these, and get<double>() throws on a
+        // non-number; leave both to the DOM path.
+        if (!fits_int(fields[Dropped].i) || !fits_int(fields[Sent].i)) return DecodeResult::Fallback;
+        if (!is_number(fields[LinkQuality])) return DecodeResult::Fallback;
+
+        ev.event_id = id.str;
+        ev.sat_id = sat.str;
+        ev.ts_ms = fields[TsMs].i;
+        ev.latency_ms = as_double(fields[LatencyMs]);
+        ev.dropped_packets = (int)fields[Dropped].i;
+        ev.sent_packets = (int)fields[Sent].i;
+        ev.link_quality = as_double(fields[LinkQuality]);
+        return validate_ranges(ev, err) ? DecodeResult::Ok : DecodeResult::Invalid;
+    }
+
+    static bool is_number(const Field& f) { return f.kind == Int || f.kind == Float; }
+    static double as_double(const Field& f) { return f.kind == Int ? (double)f.i : f.d; }
+    static bool fits_int(std::int64_t v) {
+        return v >= std::numeric_limits<int>::min() && v <= std::numeric_limits<int>::max();
+    }
+
+    void ws() {
+        while (p != end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t')) p++;
+    }
+
+    bool eat(char c) {
+        if (p != end && *p == c) { p++; return true; }
+        return false;
+    }
+
+    // Plain ASCII strings only: escapes, control and non-ASCII bytes need the
+    // DOM path's unescaping and UTF-8 checks.
+    bool string(std::string_view& out) {
+        if (!eat('"')) return false;
+        const char* s = p;
+        while (p != end) {
+            unsigned char c = (unsigned char)*p;
+            if (c == '"') {
+                out = std::string_view(s, (std::size_t)(p - s));
+                p++;
+                return true;
+            }
+            if (c == '\\' || c < 0x20 || c >= 0x80) return false;
+            p++;
+        }
+        return false;
+    }
+
+    bool value(Field& f) {
+        if (p == end) return false;
+        if (*p == '"') {
+            f.kind = String;
+            return string(f.str);
+        }
+        if (*p == '-' || (*p >= '0' && *p <= '9')) return number(f);
+        f.kind = Other;
+        return skip_value(0);
+    }
+
+    // JSON number grammar; integers that fit int64 are Int like nlohmann's
+    // number_integer, anything larger is left to the DOM path.
+    bool number(Field& f) {
+        const char* s = p;
+        bool integral = true;
+        eat('-');
+        if (eat('0')) {
+        } else if (p != end && *p >= '1' && *p <= '9') {
+            while (p != end && *p >= '0' && *p <= '9') p++;
+        } else {
+            return false;
+        }
+        if (eat('.')) {
+            integral = false;
+            if (!digits()) return false;
+        }
+        if (p != end && (*p == 'e' || *p == 'E')) {
+            integral = false;
+            p++;
+            if (!eat('+')) eat('-');
+            if (!digits()) return false;
+        }
+
+        if (integral) {
+            f.kind = Int;
+            auto r = std::from_chars(s, p, f.i);
+            return r.ec == std::errc() && r.ptr == p;
+        }
+        f.kind = Float;
+        auto r = std::from_chars(s, p, f.d);
+        return r.ec == std::errc() && r.ptr == p;
+    }
+
+    bool digits() {
+        const char* s = p;
+        while (p != end && *p >= '0' && *p <= '9') p++;
+        return p != s;
+    }
+
+    bool literal(std::string_view lit) {
+        if ((std::size_t)(end - p) < lit.size() || std::string_view(p, lit.size()) != lit) return false;
+        p += lit.size();
+        return true;
+    }
+
+    bool skip_value(int depth) {
+        if (p == end || depth > 64) return false;
+        switch (*p) {
+            case '"': {
+                std::string_view ignored;
+                return string(ignored);
+            }
+            case '{':
+            case '[': {
+                char close = (*p == '{') ? '}' : ']';
+                bool object = (*p == '{');
+                p++;
+                ws();
+                if (eat(close)) return true;
+                while (true) {
+                    ws();
+                    if (object) {
+                        std::string_view ignored;
+                        if (!string(ignored)) return false;
+                        ws();
+                        if (!eat(':')) return false;
+                        ws();
+                    }
+                    if (!skip_value(depth + 1)) return false;
+                    ws();
+                    if (eat(',')) continue;
+                    return eat(close);
+                }
+            }
+            case 't': return literal("true");
+            case 'f': return literal("false");
+            case 'n': return literal("null");
+            default: {
+                Field ignored;
+                return number(ignored);
+            }
+        }
+    }
+
+    const char* p;
+    const char* end;
+    Field fields[SlotCount];
+};
+
+} // namespace detail
+
+inline DecodeResult decode_event_json(std::string_view body, EventView& ev, std::string& err) {
+    return detail::EventJsonDecoder(body).run(ev, err);
+}
+
+} // namespace common
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <zlib.h>
+
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace common {
+
+// Incremental gzip (RFC 1952) encoder for streamed response bodies. Every
+// write() is sync-flushed, so a client can decode each chunk as it arrives;
+// finish() emits the trailer. Only built where zlib is available (httplib
+// links it when CPPHTTPLIB_ZLIB_SUPPORT is defined).
+class GzipStream {
+public:
+    explicit GzipStream(int level = Z_DEFAULT_COMPRESSION) {
+        std::memset(&z, 0, sizeof(z));
+        if (deflateInit2(&z, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            throw std::runtime_error("deflateInit2 failed");
+        }
+    }
+
+    ~GzipStream() { deflateEnd(&z); }
+
+    GzipStream(const GzipStream&) = delete;
+    GzipStream& operator=(const GzipStream&) = delete;
+
+    std::string write(std::string_view in) { return run(in, Z_SYNC_FLUSH); }
+    std::string finish() { return run({}, Z_FINISH); }
+
+private:
+    std::string run(std::string_view in, int flush) {
+        z.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+        z.avail_in = (uInt)in.size();
+        std::string out;
+        char buf[16384];
+        do {
+            z.next_out = reinterpret_cast<Bytef*>(buf);
+            z.avail_out = sizeof(buf);
+            if (deflate(&z, flush) == Z_STREAM_ERROR) throw std::runtime_error("deflate failed");
+            out.append(buf, sizeof(buf) - z.avail_out);
+        } while (z.avail_out == 0);
+        return out;
+    }
+
+    z_stream z;
+};
+
+} // namespace common
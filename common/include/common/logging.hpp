@@ -0,0 +1,67 @@
+#pragma once
+
+#include <spdlog/async.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <spdlog/spdlog.h>
+
+#include "common/config.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <sstream>
+#include <string>
+
+namespace common {
+
+// Replaces the default logger with an async stdout logger so request threads
+// only enqueue. LOG_QUEUE_SIZE bounds the queue; LOG_OVERFLOW=block makes
+// producers wait when it is full, otherwise the oldest queued message is
+// dropped (and counted).
+inline void init_async_logging(const std::string& service) {
+    std::size_t queue = (std::size_t)env_int("LOG_QUEUE_SIZE", 8192);
+    spdlog::init_thread_pool(queue, 1);
+
+    std::shared_ptr<spdlog::logger> logger;
+    if (env_str("LOG_OVERFLOW", "drop_oldest") == "block") {
+        logger = spdlog::create_async<spdlog::sinks::stdout_color_sink_mt>(service);
+    } else {
+        logger = spdlog::create_async_nb<spdlog::sinks::stdout_color_sink_mt>(service);
+    }
+    spdlog::set_default_logger(logger);
+}
+
+// Lets one call in every N through (N <= 0 disables, 1 keeps everything) and
+// counts the rest.
+class LogSampler {
+public:
+    explicit LogSampler(long long every_n) : every_n(every_n) {}
+
+    bool sample() {
+        if (every_n <= 0) {
+            suppressed_count++;
+            return false;
+        }
+        if (seen++ % every_n == 0) return true;
+        suppressed_count++;
+        return false;
+    }
+
+    long long suppressed() const { return suppressed_count.load(); }
+
+private:
+    const long long every_n;
+    std::atomic<long long> seen{0};
+    std::atomic<long long> suppressed_count{0};
+};
+
+inline std::string logging_prom(const std::string& service) {
+    std::ostringstream out;
+    auto tp = spdlog::thread_pool();
+    out << "# TYPE log_queue_depth gauge\n";
+    out << "log_queue_depth{service=\"" << service << "\"} " << (tp ? tp->queue_size() : 0) << "\n";
+    out << "# TYPE log_messages_dropped_total counter\n";
+    out << "log_messages_dropped_total{service=\"" << service << "\"} " << (tp ? tp->overrun_counter() : 0) << "\n";
+    return out.str();
+}
+
+} // namespace common
@@ -0,0 +1,161 @@
+#pragma once
+
+#include "common/config.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <limits>
+#include <string>
+#include <system_error>
+#include <vector>
+
+// Time partitioning of raw telemetry. With TELEMETRY_PARTITION=hour or day the
+// database path given to ingest and the aggregator names a directory holding
+// one SQLite file per UTC hour or day:
+//
+//   <dir>/telemetry-YYYYMMDDHH.db   (hour)
+//   <dir>/telemetry-YYYYMMDD.db     (day)
+//
+// An event lands in the partition covering its ts_ms, so an event_id that is
+// resent always meets its earlier copy. Retention unlinks whole files.
+// TELEMETRY_PARTITION=none (the default) keeps the single-file layout, modelled
+// as one partition covering all time.
+namespace common {
+
+enum class Granularity { None, Hour, Day };
+
+struct Partition {
+    std::int64_t start_ms = 0;
+    std::int64_t end_ms = 0;  // exclusive
+    std::string path;
+};
+
+class PartitionScheme {
+public:
+    // Timestamps a partitioned layout can hold: 1970-01-01 up to, but not
+    // including, 10000-01-01, the range the four-digit year in a file name
+    // covers.
+    static constexpr std::int64_t kMinTsMs = 0;
+    static constexpr std::int64_t kMaxTsMs = 253402300800000;
+
+    PartitionScheme(Granularity g, std::string db_path) : g(g), base(std::move(db_path)) {}
+
+    static PartitionScheme from_env(const std::string& db_path) {
+        std::string v = env_str("TELEMETRY_PARTITION", "none");
+        Granularity g = v == "hour" ? Granularity::Hour : v == "day" ? Granularity::Day : Granularity::None;
+        return PartitionScheme(g, db_path);
+    }
+
+    Granularity granularity() const { return g; }
+    bool partitioned() const { return g != Granularity::None; }
+    const std::string& root() const { return base; }
+
+    std::int64_t span_ms() const {
+        switch (g) {
+            case Granularity::Hour: return 3600LL * 1000;
+            case Granularity::Day: return 86400LL * 1000;
+            default: return std::numeric_limits<std::int64_t>::max();
+        }
+    }
+
+    // Whether an event at ts_ms has a partition to go to; always true for
+    // the single file.
+    bool covers(std::int64_t ts_ms) const { return !partitioned() || (ts_ms >= kMinTsMs && ts_ms < kMaxTsMs); }
+
+    // Only meaningful for a ts_ms the scheme covers(); the end is clamped
+    // rather than overflowing for one it does not.
+    Partition partition_for(std::int64_t ts_ms) const {
+        if (!partitioned()) return whole();
+        std::int64_t span = span_ms();
+        std::int64_t start = ts_ms - ((ts_ms % span) + span) % span;
+        std::int64_t end = start > std::numeric_limits<std::int64_t>::max() - span
+                               ? std::numeric_limits<std::int64_t>::max()
+                               : start + span;
+        return Partition{start, end, path_for(start)};
+    }
+
+    // Partitions present on disk, oldest first.
+    std::vector<Partition> list() const {
+        if (!partitioned()) return {whole()};
+        std::vector<Partition> out;
+        std::error_code ec;
+        for (auto& entry : std::filesystem::directory_iterator(base, ec)) {
+            std::int64_t start;
+            if (parse_name(entry.path().filename().string(), start)) {
+                out.push_back(Partition{start, start + span_ms(), entry.path().string()});
+            }
+        }
+        std::sort(out.begin(), out.end(), [](const Partition& a, const Partition& b) { return a.start_ms < b.start_ms; });
+        return out;
+    }
+
+    // Partitions on disk that can hold rows with ts_ms in [from_ms, to_ms).
+    std::vector<Partition> overlapping(std::int64_t from_ms, std::int64_t to_ms) const {
+        std::vector<Partition> out;
+        for (auto& p : list()) {
+            if (p.end_ms > from_ms && p.start_ms < to_ms) out.push_back(std::move(p));
+        }
+        return out;
+    }
+
+    // Removes a partition file and its WAL/SHM side files.
+    static void unlink(const Partition& p) {
+        std::error_code ec;
+        std::filesystem::remove(p.path, ec);
+        std::filesystem::remove(p.path + "-wal", ec);
+        std::filesystem::remove(p.path + "-shm", ec);
+    }
+
+private:
+    Partition whole() const {
+        return Partition{std::numeric_limits<std::int64_t>::min(), std::numeric_limits<std::int64_t>::max(), base};
+    }
+
+    std::string path_for(std::int64_t start_ms) const {
+        using namespace std::chrono;
+        sys_days day = floor<days>(sys_time<milliseconds>(milliseconds(start_ms)));
+        year_month_day ymd(day);
+        int hour = (int)((start_ms - duration_cast<milliseconds>(day.time_since_epoch()).count()) / 3600000);
+        char name[64];
+        if (g == Granularity::Hour) {
+            std::snprintf(name, sizeof(name), "telemetry-%04d%02u%02u%02d.db",
+                          (int)ymd.year(), (unsigned)ymd.month(), (unsigned)ymd.day(), hour);
+        } else {
+            std::snprintf(name, sizeof(name), "telemetry-%04d%02u%02u.db",
+                          (int)ymd.year(), (unsigned)ymd.month(), (unsigned)ymd.day());
+        }
+        return (std::filesystem::path(base) / name).string();
+    }
+
+    bool parse_name(const std::string& name, std::int64_t& start_ms) const {
+        std::size_t digits = (g == Granularity::Hour) ? 10 : 8;
+        const std::string prefix = "telemetry-";
+        if (name.size() != prefix.size() + digits + 3 || name.compare(0, prefix.size(), prefix) != 0 ||
+            name.compare(name.size() - 3, 3, ".db") != 0) {
+            return false;
+        }
+        int v[4] = {0, 0, 0, 0};
+        const int widths[4] = {4, 2, 2, 2};
+        std::size_t pos = prefix.size();
+        for (int i = 0; i < (g == Granularity::Hour ? 4 : 3); i++) {
+            for (int k = 0; k < widths[i]; k++, pos++) {
+                char c = name[pos];
+                if (c < '0' || c > '9') return false;
+                v[i] = v[i] * 10 + (c - '0');
+            }
+        }
+        using namespace std::chrono;
+        year_month_day ymd{year(v[0]), month((unsigned)v[1]), day((unsigned)v[2])};
+        if (!ymd.ok() || v[3] > 23) return false;
+        start_ms = duration_cast<milliseconds>(sys_days(ymd).time_since_epoch()).count() + (std::int64_t)v[3] * 3600000;
+        return true;
+    }
+
+    Granularity g;
+    std::string base;
+};
+
+} // namespace common
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace common {
+
+// Calls fn on a dedicated thread every `interval`, starting one interval after
+// construction, until destroyed. A throwing run is logged and the schedule
+// carries on.
+class PeriodicTask {
+public:
+    PeriodicTask(std::string name, std::chrono::milliseconds interval, std::function<void()> fn)
+        : name(std::move(name)), interval(interval), fn(std::move(fn)) {
+        thread = std::thread([this] { run(); });
+    }
+
+    ~PeriodicTask() {
+        {
+            std::lock_guard<std::mutex> lock(mu);
+            stop = true;
+        }
+        cv.notify_all();
+        if (thread.joinable()) thread.join();
+    }
+
+    PeriodicTask(const PeriodicTask&) = delete;
+    PeriodicTask& operator=(const PeriodicTask&) = delete;
+
+private:
+    void run() {
+        auto next = std::chrono::steady_clock::now() + interval;
+        std::unique_lock<std::mutex> lock(mu);
+        while (!cv.wait_until(lock, next, [this] { return stop; })) {
+            lock.unlock();
+            try {
+                fn();
+            } catch (const std::exception& e) {
+                spdlog::error("{} failed: {}", name, e.what());
+            }
+            lock.lock();
+            next = std::max(next + interval, std::chrono::steady_clock::now());
+        }
+    }
+
+    std::string name;
+    std::chrono::milliseconds interval;
+    std::function<void()> fn;
+
+    std::mutex mu;
+    std::condition_variable cv;
+    bool stop = false;
+    std::thread thread;
+};
+
+} // namespace common
@@ -0,0 +1,127 @@
+#pragma once
+
+#include "common/partitions.hpp"
+#include "common/sketch.hpp"
+#include "common/storage.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <limits>
+#include <string>
+#include <string_view>
+
+// Per-satellite summaries of raw telemetry at fixed resolutions, kept in their
+// own database next to the raw data (telemetry.rollups.db beside a single
+// file, rollups.db inside a partition directory) so folding never contends
+// with the ingest writer's lock.
+//
+// rollup_watermark records, per raw source file, the highest rowid already
+// folded in; it is updated in the same transaction as the buckets, so a
+// restart resumes exactly where the last committed pass stopped.
+namespace common {
+
+enum class RollupTier { Minute, Hour };
+
+inline std::int64_t tier_width_ms(RollupTier t) {
+    return t == RollupTier::Minute ? 60LL * 1000 : 3600LL * 1000;
+}
+
+inline const char* tier_table(RollupTier t) {
+    return t == RollupTier::Minute ? "rollup_1m" : "rollup_1h";
+}
+
+inline std::string rollup_path(const PartitionScheme& scheme) {
+    if (scheme.partitioned()) return (std::filesystem::path(scheme.root()) / "rollups.db").string();
+    std::filesystem::path p(scheme.root());
+    return p.replace_extension(".rollups.db").string();
+}
+
+// rollup_watermark.source for a raw file: its name inside the data directory,
+// so the watermark survives the directory being moved.
+inline std::string rollup_source(const std::string& raw_path) {
+    return std::filesystem::path(raw_path).filename().string();
+}
+
+inline void create_rollup_schema(Connection& c) {
+    for (auto t : {RollupTier::Minute, RollupTier::Hour}) {
+        c.exec(std::string("CREATE TABLE IF NOT EXISTS ") + tier_table(t) + R"sql( (
+                sat_id TEXT NOT NULL,
+                bucket_ms INTEGER NOT NULL,
+                count INTEGER NOT NULL,
+                sum_dropped INTEGER NOT NULL,
+                sum_sent INTEGER NOT NULL,
+                sum_link_quality REAL NOT NULL,
+                min_link_quality REAL NOT NULL,
+                max_link_quality REAL NOT NULL,
+                latency_sketch BLOB NOT NULL,
+                PRIMARY KEY (sat_id, bucket_ms)
+            ) WITHOUT ROWID;
+        )sql");
+        c.exec(std::string("CREATE INDEX IF NOT EXISTS idx_") + tier_table(t) + "_bucket ON " + tier_table(t) + "(bucket_ms);");
+    }
+    c.exec(R"sql(
+        CREATE TABLE IF NOT EXISTS rollup_watermark (
+            source TEXT PRIMARY KEY,
+            last_rowid INTEGER NOT NULL
+        );
+    )sql");
+}
+
+// One bucket's worth of telemetry. Latency min, max and sum live in the sketch.
+struct RollupAgg {
+    std::int64_t count = 0;
+    std::int64_t sum_dropped = 0;
+    std::int64_t sum_sent = 0;
+    double sum_link_quality = 0.0;
+    double min_link_quality = std::numeric_limits<double>::infinity();
+    double max_link_quality = -std::numeric_limits<double>::infinity();
+    QuantileSketch latency;
+
+    void add(double latency_ms, std::int64_t dropped, std::int64_t sent, double link_quality) {
+        count++;
+        sum_dropped += dropped;
+        sum_sent += sent;
+        sum_link_quality += link_quality;
+        min_link_quality = std::min(min_link_quality, link_quality);
+        max_link_quality = std::max(max_link_quality, link_quality);
+        latency.add(latency_ms);
+    }
+
+    void merge(const RollupAgg& o) {
+        count += o.count;
+        sum_dropped += o.sum_dropped;
+        sum_sent += o.sum_sent;
+        sum_link_quality += o.sum_link_quality;
+        min_link_quality = std::min(min_link_quality, o.min_link_quality);
+        max_link_quality = std::max(max_link_quality, o.max_link_quality);
+        latency.merge(o.latency);
+    }
+
+    // Columns count .. latency_sketch, in table order, starting at `col`.
+    static RollupAgg from_row(Statement& st, int col) {
+        RollupAgg a;
+        a.count = st.column_int64(col);
+        a.sum_dropped = st.column_int64(col + 1);
+        a.sum_sent = st.column_int64(col + 2);
+        a.sum_link_quality = st.column_double(col + 3);
+        a.min_link_quality = st.column_double(col + 4);
+        a.max_link_quality = st.column_double(col + 5);
+        a.latency = QuantileSketch::deserialize(st.column_blob(col + 6));
+        return a;
+    }
+};
+
+inline std::string rollup_select_bucket_sql(RollupTier t) {
+    return std::string("SELECT count, sum_dropped, sum_sent, sum_link_quality, min_link_quality, max_link_quality, "
+                       "latency_sketch FROM ") + tier_table(t) + " WHERE sat_id = ? AND bucket_ms = ?;";
+}
+
+// Binds sat_id, bucket_ms, then the RollupAgg columns in table order.
+inline std::string rollup_upsert_sql(RollupTier t) {
+    return std::string("INSERT OR REPLACE INTO ") + tier_table(t) +
+           "(sat_id, bucket_ms, count, sum_dropped, sum_sent, sum_link_quality, min_link_quality, "
+           "max_link_quality, latency_sketch) VALUES(?,?,?,?,?,?,?,?,?);";
+}
+
+} // namespace common
@@ -0,0 +1,275 @@
+#pragma once
+
+#include "common/storage.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// Telemetry table layouts and the SQL each service runs against them.
+//
+// v1 (legacy): event_id and sat_id as TEXT, single-column indexes on ts_ms and
+// sat_id.
+// v2: event_id as a 16-byte BLOB (ids that are not UUIDs are kept as TEXT,
+// which never compares equal to a BLOB), sat_id interned through the
+// satellites table, and a covering (sat_key, ts_ms, metrics...) index so a
+// window query never touches the base rows.
+//
+// PRAGMA user_version holds the layout; a database with a telemetry table and
+// user_version 0 is v1. tools/migrate upgrades v1 to v2 in place.
+namespace common {
+
+constexpr int kSchemaNone = 0;
+constexpr int kSchemaV1 = 1;
+constexpr int kSchemaV2 = 2;
+
+inline int schema_version(Connection& c) {
+    int v = 0;
+    {
+        auto st = c.prepare("PRAGMA user_version;");
+        if (st->step()) v = st->column_int(0);
+    }
+    if (v != 0) return v;
+    auto st = c.prepare("SELECT 1 FROM sqlite_master WHERE type='table' AND name='telemetry';");
+    return st->step() ? kSchemaV1 : kSchemaNone;
+}
+
+inline void create_schema_v1(Connection& c) {
+    c.exec(R"sql(
+        CREATE TABLE IF NOT EXISTS telemetry (
+            event_id TEXT PRIMARY KEY,
+            sat_id TEXT NOT NULL,
+            ts_ms INTEGER NOT NULL,
+            latency_ms REAL NOT NULL,
+            dropped_packets INTEGER NOT NULL,
+            sent_packets INTEGER NOT NULL,
+            link_quality REAL NOT NULL
+        );
+    )sql");
+    c.exec("CREATE INDEX IF NOT EXISTS idx_telemetry_ts ON telemetry(ts_ms);");
+    c.exec("CREATE INDEX IF NOT EXISTS idx_telemetry_sat ON telemetry(sat_id);");
+}
+
+// `table` is "telemetry" for a new database and the staging table during a
+// migration. Index names are fixed so they survive the final rename.
+inline void create_schema_v2(Connection& c, const std::string& table = "telemetry") {
+    c.exec(R"sql(
+        CREATE TABLE IF NOT EXISTS satellites (
+            sat_key INTEGER PRIMARY KEY,
+            sat_id TEXT NOT NULL UNIQUE
+        );
+    )sql");
+    c.exec("CREATE TABLE IF NOT EXISTS " + table + R"sql( (
+            event_id BLOB PRIMARY KEY,
+            sat_key INTEGER NOT NULL,
+            ts_ms INTEGER NOT NULL,
+            latency_ms REAL NOT NULL,
+            dropped_packets INTEGER NOT NULL,
+            sent_packets INTEGER NOT NULL,
+            link_quality REAL NOT NULL
+        );
+    )sql");
+    c.exec("CREATE INDEX IF NOT EXISTS idx_telemetry_v2_sat_ts ON " + table +
+           "(sat_key, ts_ms, latency_ms, dropped_packets, sent_packets, link_quality);");
+    c.exec("CREATE INDEX IF NOT EXISTS idx_telemetry_v2_ts ON " + table + "(ts_ms);");
+    if (table == "telemetry") c.exec("PRAGMA user_version=2;");
+}
+
+// Lowercase only; see parse_uuid().
+inline int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+// Accepts only the canonical lowercase 8-4-4-4-12 form, the one format_uuid()
+// gives back. Any other spelling (uppercase included) stays text, so every
+// event_id reads back exactly as sent and ids differing in case stay
+// distinct events.
+inline bool parse_uuid(std::string_view s, unsigned char* out) {
+    if (s.size() != 36) return false;
+    int o = 0;
+    for (std::size_t i = 0; i < 36;) {
+        if (i == 8 || i == 13 || i == 18 || i == 23) {
+            if (s[i] != '-') return false;
+            i++;
+            continue;
+        }
+        int hi = hex_value(s[i]), lo = hex_value(s[i + 1]);
+        if (hi < 0 || lo < 0) return false;
+        out[o++] = (unsigned char)(hi << 4 | lo);
+        i += 2;
+    }
+    return true;
+}
+
+// Storage key of an event_id under v2. view() is also what the ingest dedupe
+// filter hashes, whatever the schema.
+struct EventKey {
+    unsigned char bytes[16];
+    std::string_view text;
+    bool uuid = false;
+
+    explicit EventKey(std::string_view id) : text(id), uuid(parse_uuid(id, bytes)) {}
+
+    std::string_view view() const {
+        return uuid ? std::string_view(reinterpret_cast<const char*>(bytes), sizeof(bytes)) : text;
+    }
+
+    void bind(Statement& st, int idx) const {
+        if (uuid) st.bind_blob(idx, bytes, (int)sizeof(bytes));
+        else st.bind(idx, text);
+    }
+};
+
+// Bind order for both versions: event_id, sat_id (v1) or sat_key (v2), ts_ms,
+// latency_ms, dropped_packets, sent_packets, link_quality.
+inline const char* insert_sql(int version) {
+    if (version == kSchemaV2) {
+        return "INSERT OR IGNORE INTO telemetry(event_id,sat_key,ts_ms,latency_ms,dropped_packets,sent_packets,link_quality) VALUES(?,?,?,?,?,?,?);";
+    }
+    return "INSERT OR IGNORE INTO telemetry(event_id,sat_id,ts_ms,latency_ms,dropped_packets,sent_packets,link_quality) VALUES(?,?,?,?,?,?,?);";
+}
+
+// Binds sat_id, min_ts_ms; yields latency_ms, dropped_packets, sent_packets,
+// link_quality.
+inline const char* select_window_sql(int version) {
+    if (version == kSchemaV2) {
+        return "SELECT latency_ms, dropped_packets, sent_packets, link_quality FROM telemetry "
+               "WHERE sat_key = (SELECT sat_key FROM satellites WHERE sat_id = ?) AND ts_ms >= ?;";
+    }
+    return "SELECT latency_ms, dropped_packets, sent_packets, link_quality "
+           "FROM telemetry WHERE sat_id = ? AND ts_ms >= ?;";
+}
+
+// Binds sat_id, from_ms, to_ms; yields ts_ms, latency_ms, dropped_packets,
+// sent_packets, link_quality for from_ms <= ts_ms < to_ms in ts_ms order. Under
+// v2 the order comes straight off the (sat_key, ts_ms, ...) index.
+inline const char* select_range_sql(int version) {
+    if (version == kSchemaV2) {
+        return "SELECT ts_ms, latency_ms, dropped_packets, sent_packets, link_quality FROM telemetry "
+               "WHERE sat_key = (SELECT sat_key FROM satellites WHERE sat_id = ?) AND ts_ms >= ? AND ts_ms < ? "
+               "ORDER BY ts_ms;";
+    }
+    return "SELECT ts_ms, latency_ms, dropped_packets, sent_packets, link_quality "
+           "FROM telemetry WHERE sat_id = ? AND ts_ms >= ? AND ts_ms < ? ORDER BY ts_ms;";
+}
+
+// Binds sat_id; yields one value that grows when a row for sat_id is added,
+// answered from an index without visiting the satellite's rows: max(rowid)
+// under v1, max(ts_ms) under v2 (which misses a late row older than the
+// satellite's newest).
+inline const char* sat_watermark_sql(int version) {
+    if (version == kSchemaV2) {
+        return "SELECT coalesce(max(ts_ms), 0) FROM telemetry "
+               "WHERE sat_key = (SELECT sat_key FROM satellites WHERE sat_id = ?);";
+    }
+    return "SELECT coalesce(max(rowid), 0) FROM telemetry WHERE sat_id = ?;";
+}
+
+// Binds min_ts_ms; yields sat_key (v2) or sat_id (v1), latency_ms,
+// dropped_packets, sent_packets, link_quality for every satellite. v2 callers
+// resolve keys through the satellites table once each rather than per row.
+inline const char* select_fleet_window_sql(int version) {
+    if (version == kSchemaV2) {
+        return "SELECT sat_key, latency_ms, dropped_packets, sent_packets, link_quality "
+               "FROM telemetry WHERE ts_ms >= ?;";
+    }
+    return "SELECT sat_id, latency_ms, dropped_packets, sent_packets, link_quality "
+           "FROM telemetry WHERE ts_ms >= ?;";
+}
+
+// Binds last_rowid, limit; yields rowid, sat_id, ts_ms, latency_ms,
+// dropped_packets, sent_packets, link_quality for rows past last_rowid in
+// rowid (i.e. commit) order. Used by consumers that follow the table.
+inline const char* tail_sql(int version) {
+    if (version == kSchemaV2) {
+        return "SELECT t.rowid, s.sat_id, t.ts_ms, t.latency_ms, t.dropped_packets, t.sent_packets, t.link_quality "
+               "FROM telemetry t JOIN satellites s ON s.sat_key = t.sat_key "
+               "WHERE t.rowid > ? ORDER BY t.rowid LIMIT ?;";
+    }
+    return "SELECT rowid, sat_id, ts_ms, latency_ms, dropped_packets, sent_packets, link_quality "
+           "FROM telemetry WHERE rowid > ? ORDER BY rowid LIMIT ?;";
+}
+
+// Binds min_ts_ms, max_rowid; same columns as tail_sql(), for seeding a
+// follower with a recent window before it starts tailing from max_rowid.
+inline const char* since_sql(int version) {
+    if (version == kSchemaV2) {
+        return "SELECT t.rowid, s.sat_id, t.ts_ms, t.latency_ms, t.dropped_packets, t.sent_packets, t.link_quality "
+               "FROM telemetry t JOIN satellites s ON s.sat_key = t.sat_key "
+               "WHERE t.ts_ms >= ? AND t.rowid <= ?;";
+    }
+    return "SELECT rowid, sat_id, ts_ms, latency_ms, dropped_packets, sent_packets, link_quality "
+           "FROM telemetry WHERE ts_ms >= ? AND rowid <= ?;";
+}
+
+// Binds lower_ms, to_ms, after_ts_ms, after_rowid, limit; yields rowid, sat_id,
+// event_id, ts_ms, latency_ms, dropped_packets, sent_packets, link_quality for
+// up to `limit` rows with lower_ms <= ts_ms < to_ms that come after
+// (after_ts_ms, after_rowid) in (ts_ms, rowid) order. The ts_ms index already
+// holds that order, so each page is a range seek with no sort; resuming from
+// the last row of the previous page walks a range without a held cursor.
+//
+// With by_sat, only rows of some satellites come back: those whose sat_id is
+// in the JSON array bound to ?6, or that lies in [?7, ?8) (no upper bound when
+// ?8 is NULL, no range when ?7 is). v2 resolves that set to sat_keys first, so
+// skipped rows are never joined or handed out.
+inline const char* export_page_sql(int version, bool by_sat) {
+    if (version == kSchemaV2) {
+        return by_sat
+                   ? "SELECT t.rowid, s.sat_id, t.event_id, t.ts_ms, t.latency_ms, t.dropped_packets, t.sent_packets, "
+                     "t.link_quality FROM telemetry t JOIN satellites s ON s.sat_key = t.sat_key "
+                     "WHERE t.ts_ms >= ?1 AND t.ts_ms < ?2 AND (t.ts_ms > ?3 OR t.rowid > ?4) "
+                     "AND t.sat_key IN (SELECT sat_key FROM satellites WHERE sat_id IN (SELECT value FROM json_each(?6)) "
+                     "OR (sat_id >= ?7 AND (?8 IS NULL OR sat_id < ?8))) "
+                     "ORDER BY t.ts_ms, t.rowid LIMIT ?5;"
+                   : "SELECT t.rowid, s.sat_id, t.event_id, t.ts_ms, t.latency_ms, t.dropped_packets, t.sent_packets, "
+                     "t.link_quality FROM telemetry t JOIN satellites s ON s.sat_key = t.sat_key "
+                     "WHERE t.ts_ms >= ?1 AND t.ts_ms < ?2 AND (t.ts_ms > ?3 OR t.rowid > ?4) "
+                     "ORDER BY t.ts_ms, t.rowid LIMIT ?5;";
+    }
+    return by_sat ? "SELECT rowid, sat_id, event_id, ts_ms, latency_ms, dropped_packets, sent_packets, link_quality "
+                    "FROM telemetry WHERE ts_ms >= ?1 AND ts_ms < ?2 AND (ts_ms > ?3 OR rowid > ?4) "
+                    "AND (sat_id IN (SELECT value FROM json_each(?6)) OR (sat_id >= ?7 AND (?8 IS NULL OR sat_id < ?8))) "
+                    "ORDER BY ts_ms, rowid LIMIT ?5;"
+                  : "SELECT rowid, sat_id, event_id, ts_ms, latency_ms, dropped_packets, sent_packets, link_quality "
+                    "FROM telemetry WHERE ts_ms >= ?1 AND ts_ms < ?2 AND (ts_ms > ?3 OR rowid > ?4) "
+                    "ORDER BY ts_ms, rowid LIMIT ?5;";
+}
+
+// Writer-side sat_id -> sat_key interning. Keys handed out inside a
+// transaction that is rolled back are gone, so call clear() after a rollback.
+class SatelliteKeys {
+public:
+    std::int64_t get(Connection& c, std::string_view sat_id) {
+        auto it = keys.find(sat_id);
+        if (it != keys.end()) return it->second;
+
+        {
+            auto ins = c.prepare("INSERT OR IGNORE INTO satellites(sat_id) VALUES(?);");
+            ins->bind(1, sat_id);
+            ins->step();
+        }
+        auto sel = c.prepare("SELECT sat_key FROM satellites WHERE sat_id = ?;");
+        sel->bind(1, sat_id);
+        if (!sel->step()) throw std::runtime_error("satellite key lookup failed");
+        std::int64_t key = sel->column_int64(0);
+        keys.emplace(std::string(sat_id), key);
+        return key;
+    }
+
+    void clear() { keys.clear(); }
+
+private:
+    struct Hash {
+        using is_transparent = void;
+        std::size_t operator()(std::string_view s) const { return std::hash<std::string_view>{}(s); }
+    };
+    std::unordered_map<std::string, std::int64_t, Hash, std::equal_to<>> keys;
+};
+
+} // namespace common
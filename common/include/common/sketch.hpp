@@ -0,0 +1,257 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace common {
+
+// Mergeable quantile sketch with bounded relative error (DDSketch). A value x
+// is counted in bucket ceil(log_gamma(|x|)), gamma = (1 + alpha) / (1 - alpha),
+// so any quantile is answered within a factor (1 +- alpha) of a value that
+// was actually added. Two sketches with the same alpha merge by adding bucket
+// counts, which is what lets per-minute rollups combine into any window.
+//
+// Memory is bounded by max_buckets per sign; past that the lowest buckets are
+// folded together, which only affects the accuracy of the lowest quantiles.
+class QuantileSketch {
+public:
+    static constexpr double kDefaultAlpha = 0.01;
+    static constexpr std::size_t kDefaultMaxBuckets = 2048;
+
+    explicit QuantileSketch(double alpha = kDefaultAlpha, std::size_t max_buckets = kDefaultMaxBuckets)
+        : alpha(alpha), gamma((1.0 + alpha) / (1.0 - alpha)), log_gamma(std::log(gamma)),
+          max_buckets(std::max<std::size_t>(16, max_buckets)) {}
+
+    void add(double x, std::uint64_t n = 1) {
+        if (std::isnan(x) || n == 0) return;
+        if (total == 0) {
+            lo = hi = x;
+        } else {
+            lo = std::min(lo, x);
+            hi = std::max(hi, x);
+        }
+        total += n;
+        sum_values += x * (double)n;
+        if (std::fabs(x) < kMinIndexable) zero += n;
+        else if (x > 0) pos.add(index(x), n, max_buckets);
+        else neg.add(index(-x), n, max_buckets);
+    }
+
+    // Throws if the sketches were built with different alphas.
+    void merge(const QuantileSketch& o) {
+        if (o.total == 0) return;
+        if (o.alpha != alpha) throw std::invalid_argument("sketch alpha mismatch");
+        if (total == 0) {
+            lo = o.lo;
+            hi = o.hi;
+        } else {
+            lo = std::min(lo, o.lo);
+            hi = std::max(hi, o.hi);
+        }
+        total += o.total;
+        sum_values += o.sum_values;
+        zero += o.zero;
+        pos.merge(o.pos, max_buckets);
+        neg.merge(o.neg, max_buckets);
+    }
+
+    // q in [0, 1]; 0 for an empty sketch. The extremes are exact.
+    double quantile(double q) const {
+        if (total == 0) return 0.0;
+        if (q <= 0.0) return lo;
+        if (q >= 1.0) return hi;
+        std::uint64_t rank = (std::uint64_t)(q * (double)(total - 1));
+        std::uint64_t seen = 0;
+
+        // Negative values, most negative first.
+        for (std::size_t i = neg.counts.size(); i-- > 0;) {
+            seen += neg.counts[i];
+            if (seen > rank) return std::clamp(-value(neg.offset + (int)i), lo, hi);
+        }
+        seen += zero;
+        if (seen > rank) return 0.0;
+        for (std::size_t i = 0; i < pos.counts.size(); i++) {
+            seen += pos.counts[i];
+            if (seen > rank) return std::clamp(value(pos.offset + (int)i), lo, hi);
+        }
+        return hi;
+    }
+
+    std::uint64_t count() const { return total; }
+    double sum() const { return sum_values; }
+    double min() const { return total ? lo : 0.0; }
+    double max() const { return total ? hi : 0.0; }
+    double relative_accuracy() const { return alpha; }
+    std::size_t bucket_count() const { return pos.counts.size() + neg.counts.size(); }
+    std::size_t memory_bytes() const {
+        return sizeof(*this) + (pos.counts.capacity() + neg.counts.capacity()) * sizeof(std::uint64_t);
+    }
+
+    // Compact binary form: a header, then each store as a zigzag varint offset,
+    // a varint length and varint counts.
+    std::string serialize() const {
+        std::string out;
+        out.push_back((char)kFormat);
+        put_raw(out, alpha);
+        put_varint(out, total);
+        put_raw(out, sum_values);
+        put_raw(out, lo);
+        put_raw(out, hi);
+        put_varint(out, zero);
+        pos.serialize(out);
+        neg.serialize(out);
+        return out;
+    }
+
+    static QuantileSketch deserialize(std::string_view in, std::size_t max_buckets = kDefaultMaxBuckets) {
+        Reader r{in};
+        if (r.byte() != kFormat) throw std::runtime_error("unknown sketch format");
+        QuantileSketch s(r.raw<double>(), max_buckets);
+        s.total = r.varint();
+        s.sum_values = r.raw<double>();
+        s.lo = r.raw<double>();
+        s.hi = r.raw<double>();
+        s.zero = r.varint();
+        s.pos.deserialize(r);
+        s.neg.deserialize(r);
+        return s;
+    }
+
+private:
+    static constexpr unsigned char kFormat = 1;
+    static constexpr double kMinIndexable = 1e-9;
+
+    struct Reader {
+        std::string_view in;
+        std::size_t pos = 0;
+
+        unsigned char byte() {
+            if (pos >= in.size()) throw std::runtime_error("truncated sketch");
+            return (unsigned char)in[pos++];
+        }
+
+        std::uint64_t varint() {
+            std::uint64_t v = 0;
+            for (int shift = 0; shift < 64; shift += 7) {
+                unsigned char b = byte();
+                v |= (std::uint64_t)(b & 0x7f) << shift;
+                if (!(b & 0x80)) return v;
+            }
+            throw std::runtime_error("bad sketch varint");
+        }
+
+        template <class T>
+        T raw() {
+            if (in.size() - pos < sizeof(T)) throw std::runtime_error("truncated sketch");
+            T v;
+            std::memcpy(&v, in.data() + pos, sizeof(T));
+            pos += sizeof(T);
+            return v;
+        }
+    };
+
+    struct Store {
+        int offset = 0;  // bucket index of counts[0]
+        std::vector<std::uint64_t> counts;
+
+        void add(int idx, std::uint64_t n, std::size_t cap) {
+            if (counts.empty()) {
+                offset = idx;
+                counts.push_back(0);
+            } else if (idx < offset) {
+                counts.insert(counts.begin(), (std::size_t)(offset - idx), 0);
+                offset = idx;
+            } else if (idx >= offset + (int)counts.size()) {
+                counts.resize((std::size_t)(idx - offset) + 1, 0);
+            }
+            counts[(std::size_t)(idx - offset)] += n;
+            collapse(cap);
+        }
+
+        void merge(const Store& o, std::size_t cap) {
+            if (o.counts.empty()) return;
+            if (counts.empty()) {
+                offset = o.offset;
+                counts = o.counts;
+                return;
+            }
+            int new_lo = std::min(offset, o.offset);
+            int new_hi = std::max(offset + (int)counts.size(), o.offset + (int)o.counts.size());
+            if (new_lo < offset) {
+                counts.insert(counts.begin(), (std::size_t)(offset - new_lo), 0);
+                offset = new_lo;
+            }
+            counts.resize((std::size_t)(new_hi - offset), 0);
+            for (std::size_t i = 0; i < o.counts.size(); i++) counts[(std::size_t)(o.offset - offset) + i] += o.counts[i];
+            collapse(cap);
+        }
+
+        // Folds the lowest buckets into one so at most `cap` remain.
+        void collapse(std::size_t cap) {
+            if (counts.size() <= cap) return;
+            std::size_t fold = counts.size() - cap;
+            std::uint64_t folded = 0;
+            for (std::size_t i = 0; i <= fold; i++) folded += counts[i];
+            counts.erase(counts.begin(), counts.begin() + (std::ptrdiff_t)fold);
+            counts[0] = folded;
+            offset += (int)fold;
+        }
+
+        void serialize(std::string& out) const {
+            put_varint(out, ((std::uint64_t)offset << 1) ^ (std::uint64_t)(offset >> 31));
+            put_varint(out, counts.size());
+            for (auto c : counts) put_varint(out, c);
+        }
+
+        void deserialize(Reader& r) {
+            std::uint64_t z = r.varint();
+            offset = (int)((z >> 1) ^ (~(z & 1) + 1));
+            std::uint64_t n = r.varint();
+            if (n > r.in.size()) throw std::runtime_error("bad sketch length");
+            counts.assign((std::size_t)n, 0);
+            for (auto& c : counts) c = r.varint();
+        }
+    };
+
+    static void put_varint(std::string& out, std::uint64_t v) {
+        while (v >= 0x80) {
+            out.push_back((char)(v | 0x80));
+            v >>= 7;
+        }
+        out.push_back((char)v);
+    }
+
+    template <class T>
+    static void put_raw(std::string& out, T v) {
+        char b[sizeof(T)];
+        std::memcpy(b, &v, sizeof(T));
+        out.append(b, sizeof(T));
+    }
+
+    int index(double x) const { return (int)std::ceil(std::log(x) / log_gamma); }
+
+    // Midpoint (in relative terms) of bucket i: within alpha of every value in it.
+    double value(int i) const { return 2.0 * std::pow(gamma, i) / (gamma + 1.0); }
+
+    double alpha;
+    double gamma;
+    double log_gamma;
+    std::size_t max_buckets;
+
+    std::uint64_t total = 0;
+    double sum_values = 0.0;
+    double lo = 0.0;
+    double hi = 0.0;
+    std::uint64_t zero = 0;
+    Store pos;
+    Store neg;
+};
+
+} // namespace common
@@ -0,0 +1,227 @@
+#pragma once
+
+#include <sqlite3.h>
+
+#include "common/config.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Shared SQLite access layer: RAII connections with a per-connection prepared
+// statement cache, and a per-thread connection provider for servers whose
+// handlers run on a worker pool.
+namespace common {
+
+struct StoragePragmas {
+    std::string synchronous = "FULL";
+    long long cache_size_kb = 8192;
+    long long mmap_size = 256LL * 1024 * 1024;
+    std::string temp_store = "MEMORY";
+    int busy_timeout_ms = 5000;
+
+    // SQLITE_SYNCHRONOUS, SQLITE_CACHE_SIZE_KB, SQLITE_MMAP_SIZE,
+    // SQLITE_TEMP_STORE, SQLITE_BUSY_TIMEOUT_MS.
+    static StoragePragmas from_env() {
+        StoragePragmas p;
+        p.synchronous = env_str("SQLITE_SYNCHRONOUS", p.synchronous);
+        p.cache_size_kb = env_int("SQLITE_CACHE_SIZE_KB", p.cache_size_kb);
+        p.mmap_size = env_int("SQLITE_MMAP_SIZE", p.mmap_size);
+        p.temp_store = env_str("SQLITE_TEMP_STORE", p.temp_store);
+        p.busy_timeout_ms = (int)env_int("SQLITE_BUSY_TIMEOUT_MS", p.busy_timeout_ms);
+        return p;
+    }
+};
+
+enum class OpenMode { ReadOnly, ReadWrite };
+
+class Statement {
+public:
+    Statement(sqlite3* db, const std::string& sql) : db(db) {
+        if (sqlite3_prepare_v3(db, sql.c_str(), (int)sql.size(), SQLITE_PREPARE_PERSISTENT, &stmt, nullptr) != SQLITE_OK) {
+            throw std::runtime_error(std::string("sqlite prepare failed: ") + sqlite3_errmsg(db));
+        }
+    }
+
+    ~Statement() { sqlite3_finalize(stmt); }
+
+    Statement(const Statement&) = delete;
+    Statement& operator=(const Statement&) = delete;
+
+    // Text and blob binds are SQLITE_STATIC: the caller keeps the buffer alive
+    // until the statement is reset.
+    void bind(int idx, std::string_view v) { sqlite3_bind_text(stmt, idx, v.data(), (int)v.size(), SQLITE_STATIC); }
+    void bind_blob(int idx, const void* p, int n) { sqlite3_bind_blob(stmt, idx, p, n, SQLITE_STATIC); }
+    void bind(int idx, std::int64_t v) { sqlite3_bind_int64(stmt, idx, v); }
+    void bind(int idx, int v) { sqlite3_bind_int(stmt, idx, v); }
+    void bind(int idx, double v) { sqlite3_bind_double(stmt, idx, v); }
+
+    // True while a row is available, false once the statement is done.
+    bool step() {
+        int rc = sqlite3_step(stmt);
+        if (rc == SQLITE_ROW) return true;
+        if (rc == SQLITE_DONE) return false;
+        throw std::runtime_error(std::string("sqlite step failed: ") + sqlite3_errmsg(db));
+    }
+
+    std::int64_t column_int64(int i) { return sqlite3_column_int64(stmt, i); }
+    int column_int(int i) { return sqlite3_column_int(stmt, i); }
+    double column_double(int i) { return sqlite3_column_double(stmt, i); }
+    std::string_view column_text(int i) {
+        auto p = reinterpret_cast<const char*>(sqlite3_column_text(stmt, i));
+        return p ? std::string_view(p, (std::size_t)sqlite3_column_bytes(stmt, i)) : std::string_view();
+    }
+    std::string_view column_blob(int i) {
+        auto p = static_cast<const char*>(sqlite3_column_blob(stmt, i));
+        return p ? std::string_view(p, (std::size_t)sqlite3_column_bytes(stmt, i)) : std::string_view();
+    }
+    bool column_is_blob(int i) { return sqlite3_column_type(stmt, i) == SQLITE_BLOB; }
+    bool column_is_null(int i) { return sqlite3_column_type(stmt, i) == SQLITE_NULL; }
+
+    void reset() {
+        sqlite3_reset(stmt);
+        sqlite3_clear_bindings(stmt);
+    }
+
+private:
+    sqlite3* db;
+    sqlite3_stmt* stmt = nullptr;
+};
+
+// Hands out a cached statement and resets it on scope exit, so an abandoned
+// SELECT never pins a read transaction (and with it the WAL checkpoint).
+class StatementLease {
+public:
+    explicit StatementLease(Statement& s) : s(&s) {}
+    ~StatementLease() { if (s) s->reset(); }
+
+    StatementLease(StatementLease&& o) noexcept : s(o.s) { o.s = nullptr; }
+    StatementLease(const StatementLease&) = delete;
+    StatementLease& operator=(const StatementLease&) = delete;
+    StatementLease& operator=(StatementLease&&) = delete;
+
+    Statement* operator->() { return s; }
+    Statement& operator*() { return *s; }
+
+private:
+    Statement* s;
+};
+
+class Connection {
+public:
+    Connection(const std::string& path, OpenMode mode, const StoragePragmas& pragmas) {
+        int flags = SQLITE_OPEN_NOMUTEX |
+            (mode == OpenMode::ReadOnly ? SQLITE_OPEN_READONLY : (SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE));
+        if (sqlite3_open_v2(path.c_str(), &db, flags, nullptr) != SQLITE_OK) {
+            std::string msg = db ? sqlite3_errmsg(db) : "unknown";
+            if (db) sqlite3_close(db);
+            db = nullptr;
+            throw std::runtime_error(std::string(mode == OpenMode::ReadOnly ? "sqlite open (readonly) failed: " : "sqlite open failed: ") + msg);
+        }
+
+        sqlite3_busy_timeout(db, pragmas.busy_timeout_ms);
+        try {
+            if (mode == OpenMode::ReadWrite) exec("PRAGMA journal_mode=WAL;");
+            exec("PRAGMA synchronous=" + pragmas.synchronous + ";");
+            exec("PRAGMA cache_size=-" + std::to_string(pragmas.cache_size_kb) + ";");
+            exec("PRAGMA mmap_size=" + std::to_string(pragmas.mmap_size) + ";");
+            exec("PRAGMA temp_store=" + pragmas.temp_store + ";");
+        } catch (...) {
+            sqlite3_close(db);
+            throw;
+        }
+    }
+
+    ~Connection() {
+        stmts.clear();
+        if (db) sqlite3_close(db);
+    }
+
+    Connection(const Connection&) = delete;
+    Connection& operator=(const Connection&) = delete;
+
+    void exec(const std::string& sql) {
+        char* err = nullptr;
+        if (sqlite3_exec(db, sql.c_str(), nullptr, nullptr, &err) != SQLITE_OK) {
+            std::string msg = err ? err : "unknown";
+            sqlite3_free(err);
+            throw std::runtime_error("sqlite exec failed: " + msg);
+        }
+    }
+
+    // Compiled once per connection, then reset and rebound on every use.
+    StatementLease prepare(const std::string& sql) {
+        auto it = stmts.find(sql);
+        if (it == stmts.end()) it = stmts.emplace(sql, std::make_unique<Statement>(db, sql)).first;
+        return StatementLease(*it->second);
+    }
+
+    int changes() { return sqlite3_changes(db); }
+    std::int64_t last_insert_rowid() { return sqlite3_last_insert_rowid(db); }
+    sqlite3* handle() { return db; }
+
+private:
+    sqlite3* db = nullptr;
+    std::unordered_map<std::string, std::unique_ptr<Statement>> stmts;
+};
+
+// Opens one connection per calling thread on first use and keeps it for the
+// thread's lifetime, so concurrent readers never share (and serialize on) a
+// handle. Connections are closed when the Database is destroyed.
+class Database {
+public:
+    Database(std::string path, OpenMode mode, StoragePragmas pragmas)
+        : path(std::move(path)), mode(mode), pragmas(std::move(pragmas)), id(next_id()) {
+        // Fail fast on a bad path instead of on the first request.
+        local();
+    }
+
+    Database(const Database&) = delete;
+    Database& operator=(const Database&) = delete;
+
+    Connection& local() {
+        // Keyed by a never-reused id so a stale entry from a destroyed
+        // Database is never looked up again.
+        thread_local std::unordered_map<std::uint64_t, Connection*> mine;
+        auto it = mine.find(id);
+        if (it != mine.end()) return *it->second;
+
+        auto conn = std::make_unique<Connection>(path, mode, pragmas);
+        Connection* p = conn.get();
+        {
+            std::lock_guard<std::mutex> lock(mu);
+            conns.push_back(std::move(conn));
+        }
+        mine.emplace(id, p);
+        return *p;
+    }
+
+    std::size_t connection_count() {
+        std::lock_guard<std::mutex> lock(mu);
+        return conns.size();
+    }
+
+    const std::string& file() const { return path; }
+
+private:
+    static std::uint64_t next_id() {
+        static std::atomic<std::uint64_t> n{0};
+        return ++n;
+    }
+
+    std::string path;
+    OpenMode mode;
+    StoragePragmas pragmas;
+    std::uint64_t id;
+
+    std::mutex mu;
+    std::vector<std::unique_ptr<Connection>> conns;
+};
+
+} // namespace common
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+namespace common {
+
+// One telemetry event with its strings borrowed from the request body (or from
+// the decoder that produced it).
+struct EventView {
+    std::string_view event_id;
+    std::string_view sat_id;
+    std::int64_t ts_ms = 0;
+    double latency_ms = 0.0;
+    int dropped_packets = 0;
+    int sent_packets = 0;
+    double link_quality = 0.0;
+};
+
+// Value rules shared by every ingest route. Type checks are the decoder's job;
+// the messages match the JSON route's validate_event.
+inline bool validate_ranges(const EventView& ev, std::string& err) {
+    if (ev.event_id.empty()) { err = "event_id invalid"; return false; }
+    if (ev.sat_id.empty())   { err = "sat_id invalid"; return false; }
+    if (!std::isfinite(ev.latency_ms)) { err = "latency_ms must be number"; return false; }
+    if (ev.sent_packets <= 0) { err = "sent_packets must be > 0"; return false; }
+    if (ev.dropped_packets < 0 || ev.dropped_packets > ev.sent_packets) { err = "dropped_packets must be in [0,sent_packets]"; return false; }
+    if (!(ev.link_quality >= 0.0 && ev.link_quality <= 1.0)) { err = "link_quality out of range [0,1]"; return false; }
+    return true;
+}
+
+// Lower-case 8-4-4-4-12 rendering of a 16-byte UUID into out[36].
+inline void format_uuid(const unsigned char* id, char* out) {
+    static const char hex[] = "0123456789abcdef";
+    int o = 0;
+    for (int i = 0; i < 16; i++) {
+        if (i == 4 || i == 6 || i == 8 || i == 10) out[o++] = '-';
+        out[o++] = hex[id[i] >> 4];
+        out[o++] = hex[id[i] & 0xf];
+    }
+}
+
+// Binary telemetry frames (Content-Type: application/octet-stream).
+//
+// A body is a sequence of frames. All integers are little-endian and doubles
+// are IEEE-754 binary64.
+//
+//   u32  length      bytes that follow (version + type + payload)
+//   u8   version     kFrameVersion
+//   u8   type        FrameType
+//   ...  payload
+//
+// SatDef payload interns a satellite id for the rest of the body:
+//   u16 sat_key (< kMaxSatKeys), u8 len, len bytes of sat_id
+//
+// Event payload is fixed-size (kEventPayloadSize bytes):
+//   @0  16 bytes event_id (UUID, stored as its canonical text form)
+//   @16 i64 ts_ms
+//   @24 f64 latency_ms
+//   @32 f64 link_quality
+//   @40 u32 dropped_packets
+//   @44 u32 sent_packets
+//   @48 u16 sat_key
+//   @50 u16 reserved (0)
+constexpr std::uint8_t kFrameVersion = 1;
+constexpr std::size_t kEventPayloadSize = 52;
+constexpr std::size_t kMaxSatKeys = 1024;
+
+enum class FrameType : std::uint8_t { SatDef = 1, Event = 2 };
+
+namespace detail {
+
+template <typename T>
+inline T load_le(const unsigned char* p) {
+    std::uint64_t v = 0;
+    for (std::size_t i = 0; i < sizeof(T); i++) v |= (std::uint64_t)p[i] << (8 * i);
+    if constexpr (std::is_floating_point_v<T>) {
+        double d;
+        std::memcpy(&d, &v, sizeof(d));
+        return d;
+    } else {
+        return (T)v;
+    }
+}
+
+} // namespace detail
+
+// Walks a frame body without allocating. The EventView returned by next()
+// borrows from the body and from the reader, and is valid until the next call.
+// Invalid means the frame was well-formed but a field does not fit the event
+// (err says which); Error means the body cannot be framed any further.
+class FrameReader {
+public:
+    enum class Status { Event, Invalid, End, Error };
+
+    explicit FrameReader(std::string_view body)
+        : p(reinterpret_cast<const unsigned char*>(body.data())), end(p + body.size()) {}
+
+    Status next(EventView& ev, std::string& err) {
+        while (p != end) {
+            if (end - p < 4) { err = "truncated frame header"; return Status::Error; }
+            std::uint32_t len = detail::load_le<std::uint32_t>(p);
+            if (len < 2 || (std::size_t)(end - p - 4) < len) { err = "truncated frame"; return Status::Error; }
+            const unsigned char* f = p + 4;
+            p = f + len;
+
+            if (f[0] != kFrameVersion) { err = "unsupported frame version " + std::to_string(f[0]); return Status::Error; }
+            const unsigned char* body = f + 2;
+            std::size_t n = len - 2;
+
+            switch ((FrameType)f[1]) {
+                case FrameType::SatDef: {
+                    if (n < 3) { err = "truncated sat frame"; return Status::Error; }
+                    std::uint16_t key = detail::load_le<std::uint16_t>(body);
+                    std::size_t sl = body[2];
+                    if (n < 3 + sl) { err = "truncated sat frame"; return Status::Error; }
+                    if (key >= kMaxSatKeys) { err = "sat_key out of range"; return Status::Error; }
+                    sats[key] = std::string_view(reinterpret_cast<const char*>(body + 3), sl);
+                    defined[key] = true;
+                    break;
+                }
+                case FrameType::Event: {
+                    if (n < kEventPayloadSize) { err = "truncated event frame"; return Status::Error; }
+                    std::uint16_t key = detail::load_le<std::uint16_t>(body + 48);
+                    if (key >= kMaxSatKeys || !defined[key]) { err = "undefined sat_key " + std::to_string(key); return Status::Error; }
+
+                    format_uuid(body, uuid_text);
+                    std::uint32_t dropped = detail::load_le<std::uint32_t>(body + 40);
+                    std::uint32_t sent = detail::load_le<std::uint32_t>(body + 44);
+
+                    ev.event_id = std::string_view(uuid_text, sizeof(uuid_text));
+                    ev.sat_id = sats[key];
+                    ev.ts_ms = detail::load_le<std::int64_t>(body + 16);
+                    ev.latency_ms = detail::load_le<double>(body + 24);
+                    ev.link_quality = detail::load_le<double>(body + 32);
+                    if (dropped > (std::uint32_t)std::numeric_limits<int>::max()) { err = "dropped_packets must be int"; return Status::Invalid; }
+                    if (sent > (std::uint32_t)std::numeric_limits<int>::max()) { err = "sent_packets must be int"; return Status::Invalid; }
+                    ev.dropped_packets = (int)dropped;
+                    ev.sent_packets = (int)sent;
+                    return Status::Event;
+                }
+                default:
+                    err = "unknown frame type " + std::to_string(f[1]);
+                    return Status::Error;
+            }
+        }
+        return Status::End;
+    }
+
+private:
+    const unsigned char* p;
+    const unsigned char* end;
+    std::string_view sats[kMaxSatKeys];
+    bool defined[kMaxSatKeys] = {};
+    char uuid_text[36];
+};
+
+} // namespace common
@@ -0,0 +1,114 @@
+#pragma once
+
+#include "common/sketch.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace common {
+
+// Latency quantiles over a stream of values. Exact (sorted once, linearly
+// interpolated between ranks) while at most exact_limit values have been seen;
+// past that, or once a sketch is merged in, it answers from a QuantileSketch
+// and is within its relative accuracy.
+class LatencyQuantiles {
+public:
+    explicit LatencyQuantiles(std::size_t exact_limit) : exact_limit(exact_limit) {}
+
+    void add(double v) {
+        if (is_exact) {
+            if (values.size() < exact_limit) {
+                values.push_back(v);
+                sorted = false;
+                return;
+            }
+            to_sketch();
+        }
+        sketch.add(v);
+    }
+
+    void add(const double* v, std::size_t n) {
+        if (is_exact && values.size() + n <= exact_limit) {
+            values.insert(values.end(), v, v + n);
+            sorted = sorted && n == 0;
+            return;
+        }
+        for (std::size_t i = 0; i < n; i++) add(v[i]);
+    }
+
+    void merge(const QuantileSketch& s) {
+        if (s.count() == 0) return;
+        if (is_exact) to_sketch();
+        sketch.merge(s);
+    }
+
+    bool exact() const { return is_exact; }
+    std::uint64_t count() const { return is_exact ? values.size() : sketch.count(); }
+
+    // q in [0, 1]; 0 when empty.
+    double quantile(double q) {
+        if (!is_exact) return sketch.quantile(q);
+        if (values.empty()) return 0.0;
+        if (!sorted) {
+            std::sort(values.begin(), values.end());
+            sorted = true;
+        }
+        double idx = std::clamp(q, 0.0, 1.0) * (double)(values.size() - 1);
+        std::size_t i = (std::size_t)idx;
+        double frac = idx - (double)i;
+        if (i + 1 < values.size()) return values[i] * (1.0 - frac) + values[i + 1] * frac;
+        return values[i];
+    }
+
+    double relative_accuracy() const { return is_exact ? 0.0 : sketch.relative_accuracy(); }
+
+private:
+    void to_sketch() {
+        for (double v : values) sketch.add(v);
+        values.clear();
+        values.shrink_to_fit();
+        is_exact = false;
+    }
+
+    std::size_t exact_limit;
+    bool is_exact = true;
+    bool sorted = true;
+    std::vector<double> values;
+    QuantileSketch sketch;
+};
+
+// The /metrics figures for one satellite and window, accumulated in a single
+// pass over rows (or merged from rollup buckets) without keeping the rows.
+struct WindowStats {
+    std::int64_t count = 0;
+    std::int64_t sum_dropped = 0;
+    std::int64_t sum_sent = 0;
+    double sum_link_quality = 0.0;
+    LatencyQuantiles latency;
+
+    explicit WindowStats(std::size_t exact_limit) : latency(exact_limit) {}
+
+    void add(double latency_ms, std::int64_t dropped, std::int64_t sent, double link_quality) {
+        count++;
+        sum_dropped += dropped;
+        sum_sent += sent;
+        sum_link_quality += link_quality;
+        latency.add(latency_ms);
+    }
+
+    // Folds in an already aggregated bucket, e.g. a rollup row.
+    void merge(std::int64_t n, std::int64_t dropped, std::int64_t sent, double link_quality_sum,
+               const QuantileSketch& latency_sketch) {
+        count += n;
+        sum_dropped += dropped;
+        sum_sent += sent;
+        sum_link_quality += link_quality_sum;
+        latency.merge(latency_sketch);
+    }
+
+    double drop_rate() const { return sum_sent > 0 ? (double)sum_dropped / (double)sum_sent : 0.0; }
+    double avg_link_quality() const { return count > 0 ? sum_link_quality / (double)count : 0.0; }
+};
+
+} // namespace common
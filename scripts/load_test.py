@@ -1,10 +1,32 @@
 # scripts/load_test.py
-import argparse, time, random, uuid, json
+import argparse, time, random, uuid, json, struct
 import urllib.request
 
-def post(url, payload):
-    data = json.dumps(payload).encode("utf-8")
-    req = urllib.request.Request(url, data=data, headers={"Content-Type":"application/json"}, method="POST")
+FRAME_VERSION = 1
+FRAME_SAT_DEF = 1
+FRAME_EVENT = 2
+
+def frame(kind, payload):
+    return struct.pack("<IBB", len(payload) + 2, FRAME_VERSION, kind) + payload
+
+def encode_bin(events):
+    """Binary frame body, see common/include/common/telemetry.hpp."""
+    keys = {}
+    out = bytearray()
+    for e in events:
+        sat = e["sat_id"]
+        if sat not in keys:
+            keys[sat] = len(keys)
+            raw = sat.encode("utf-8")
+            out += frame(FRAME_SAT_DEF, struct.pack("<HB", keys[sat], len(raw)) + raw)
+        out += frame(FRAME_EVENT, struct.pack("<16sqddIIHH",
+            uuid.UUID(e["event_id"]).bytes, e["ts_ms"], e["latency_ms"], e["link_quality"],
+            e["dropped_packets"], e["sent_packets"], keys[sat], 0))
+    return bytes(out)
+
+def post(url, payload, content_type="application/json"):
+    data = payload if isinstance(payload, bytes) else json.dumps(payload).encode("utf-8")
+    req = urllib.request.Request(url, data=data, headers={"Content-Type":content_type}, method="POST")
     with urllib.request.urlopen(req, timeout=2) as r:
         return r.read().decode("utf-8")
 
@@ -17,14 +39,21 @@ def main():
     ap.add_argument("--qps", type=float, default=20)
     ap.add_argument("--seconds", type=int, default=60)
     ap.add_argument("--sats", type=int, default=5)
+    ap.add_argument("--batch", type=int, default=1, help="events per request; >1 uses /telemetry/batch")
+    ap.add_argument("--ndjson", action="store_true", help="send batches as application/x-ndjson")
+    ap.add_argument("--format", choices=["json", "bin"], default="json", help="bin posts frames to /telemetry/bin")
     args = ap.parse_args()
 
-    url = args.host.rstrip("/") + "/telemetry"
+    if args.format == "bin":
+        url = args.host.rstrip("/") + "/telemetry/bin"
+    else:
+        url = args.host.rstrip("/") + ("/telemetry/batch" if args.batch > 1 else "/telemetry")
     sat_ids = [f"SAT-{i:03d}" for i in range(1, args.sats + 1)]
 
     start = time.time()
     sent = 0
     period = 1.0 / args.qps
+    pending = []
 
     while time.time() - start < args.seconds:
         t = time.time() - start
@@ -54,11 +83,33 @@ def main():
             "link_quality": lq
         }
 
-        try:
-            post(url, payload)
-            sent += 1
-        except Exception:
-            pass
+        if args.format == "bin" and args.batch <= 1:
+            try:
+                post(url, encode_bin([payload]), "application/octet-stream")
+                sent += 1
+            except Exception:
+                pass
+        elif args.batch <= 1:
+            try:
+                post(url, payload)
+                sent += 1
+            except Exception:
+                pass
+        else:
+            pending.append(payload)
+            if len(pending) >= args.batch:
+                try:
+                    if args.format == "bin":
+                        post(url, encode_bin(pending), "application/octet-stream")
+                    elif args.ndjson:
+                        body = "\n".join(json.dumps(p) for p in pending).encode("utf-8")
+                        post(url, body, "application/x-ndjson")
+                    else:
+                        post(url, pending)
+                    sent += len(pending)
+                except Exception:
+                    pass
+                pending = []
 
         time.sleep(period)
 
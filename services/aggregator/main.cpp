@@ -3,114 +3,1618 @@
 #include <spdlog/spdlog.h>
 #include <sqlite3.h>
 
+#include "common/arrow_ipc.hpp"
+#include "common/columns.hpp"
+#ifdef CPPHTTPLIB_ZLIB_SUPPORT
+#include "common/gzip.hpp"
+#endif
+#include "common/logging.hpp"
+#include "common/partitions.hpp"
+#include "common/periodic.hpp"
+#include "common/rollup.hpp"
+#include "common/schema.hpp"
+#include "common/storage.hpp"
+#include "common/telemetry.hpp"
+#include "common/window_stats.hpp"
+
 #include <algorithm>
 #include <atomic>
+#include <charconv>
+#include <condition_variable>
 #include <chrono>
 #include <cstdint>
 #include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <limits>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 using json = nlohmann::json;
 
+struct TransparentHash {
+    using is_transparent = void;
+    std::size_t operator()(std::string_view s) const { return std::hash<std::string_view>{}(s); }
+};
+
+// Which satellites an export covers, in the form common::export_page_sql()
+// binds: listed sat_ids and/or every sat_id starting with a prefix.
+struct SatSelection {
+    bool everyone = true;
+    std::string ids_json = "[]";
+    std::optional<std::string> prefix;
+    std::optional<std::string> prefix_end;  // first string past the prefix; none if unbounded
+
+    SatSelection(const std::vector<std::string>& ids, std::optional<std::string> p) {
+        if (p && p->empty()) {
+            everyone = true;  // every sat_id starts with ""
+            return;
+        }
+        everyone = ids.empty() && !p;
+        ids_json = json(ids).dump();
+        if (!p) return;
+        std::string end = *p;
+        while (!end.empty() && (unsigned char)end.back() == 0xff) end.pop_back();
+        if (!end.empty()) {
+            end.back() = (char)((unsigned char)end.back() + 1);
+            prefix_end = std::move(end);
+        }
+        prefix = std::move(p);
+    }
+};
+
 struct SqliteRO {
-    sqlite3* db = nullptr;
+    common::Database db;
+    std::atomic<int> version{common::kSchemaNone};
+
+    SqliteRO(const std::string& path, const common::StoragePragmas& pragmas)
+        : db(path, common::OpenMode::ReadOnly, pragmas) {
+        version = common::schema_version(db.local());
+    }
+
+    // Streams the window: fn(latency_ms, dropped, sent, link_quality) per row,
+    // straight off the cursor.
+    template <class F>
+    void scan(const std::string& sat_id, std::int64_t min_ts_ms, F&& fn) {
+        int v = current_version();
+        bool delivered = false;
+        auto counted = [&](double lat, int dropped, int sent, double lq) {
+            delivered = true;
+            fn(lat, dropped, sent, lq);
+        };
+        try {
+            scan_v(v, sat_id, min_ts_ms, counted);
+        } catch (const std::exception&) {
+            // A migration may have swapped the table layout since we last
+            // looked; retry only if nothing was handed out yet.
+            if (delivered) throw;
+            v = common::schema_version(db.local());
+            if (v == version.exchange(v)) throw;
+            scan_v(v, sat_id, min_ts_ms, counted);
+        }
+    }
+
+    // fn(ts_ms, latency_ms, dropped, sent, link_quality) for the rows of
+    // sat_id with from_ms <= ts_ms < to_ms, in ts_ms order.
+    template <class F>
+    void scan_range(const std::string& sat_id, std::int64_t from_ms, std::int64_t to_ms, F&& fn) {
+        int v = current_version();
+        if (v == common::kSchemaNone) return;
+        auto stmt = db.local().prepare(common::select_range_sql(v));
+        stmt->bind(1, std::string_view(sat_id));
+        stmt->bind(2, from_ms);
+        stmt->bind(3, to_ms);
+        while (stmt->step()) {
+            fn(stmt->column_int64(0), stmt->column_double(1), stmt->column_int(2), stmt->column_int(3),
+               stmt->column_double(4));
+        }
+    }
+
+    // One page of an export: fn(rowid, sat_id, event_id, ts_ms, latency_ms,
+    // dropped, sent, link_quality) for up to `limit` rows of the selected
+    // satellites with from_ms <= ts_ms < to_ms after (after_ts, after_rowid) in
+    // (ts_ms, rowid) order; see common::export_page_sql(). Returns the number
+    // of rows handed out.
+    template <class F>
+    std::size_t export_page(std::int64_t from_ms, std::int64_t to_ms, std::int64_t after_ts, std::int64_t after_rowid,
+                            std::size_t limit, const SatSelection& sats, F&& fn) {
+        int v = current_version();
+        if (v == common::kSchemaNone) return 0;
+        auto st = db.local().prepare(common::export_page_sql(v, !sats.everyone));
+        st->bind(1, std::max(from_ms, after_ts));
+        st->bind(2, to_ms);
+        st->bind(3, after_ts);
+        st->bind(4, after_rowid);
+        st->bind(5, (std::int64_t)limit);
+        if (!sats.everyone) {
+            st->bind(6, std::string_view(sats.ids_json));
+            if (sats.prefix) st->bind(7, std::string_view(*sats.prefix));
+            if (sats.prefix_end) st->bind(8, std::string_view(*sats.prefix_end));
+        }
+        std::size_t n = 0;
+        char uuid[36];
+        while (st->step()) {
+            std::string_view event_id = st->column_blob(2);
+            if (st->column_is_blob(2) && event_id.size() == 16) {
+                common::format_uuid(reinterpret_cast<const unsigned char*>(event_id.data()), uuid);
+                event_id = std::string_view(uuid, sizeof(uuid));
+            }
+            fn(st->column_int64(0), st->column_text(1), event_id, st->column_int64(3), st->column_double(4),
+               st->column_int(5), st->column_int(6), st->column_double(7));
+            n++;
+        }
+        return n;
+    }
+
+    // Oldest ts_ms among rows committed after last_rowid; INT64_MAX if none.
+    std::int64_t min_ts_after(std::int64_t last_rowid) {
+        int v = current_version();
+        if (v == common::kSchemaNone) return std::numeric_limits<std::int64_t>::max();
+        // With a watermark, walk the rowid range (min(+ts_ms) keeps SQLite off
+        // the ts_ms index, which would scan from the oldest row up).
+        auto st = db.local().prepare(last_rowid > 0
+            ? "SELECT coalesce(min(+ts_ms), 9223372036854775807) FROM telemetry WHERE rowid > ?;"
+            : "SELECT coalesce(min(ts_ms), 9223372036854775807) FROM telemetry;");
+        if (last_rowid > 0) st->bind(1, last_rowid);
+        return st->step() ? st->column_int64(0) : std::numeric_limits<std::int64_t>::max();
+    }
+
+    // One pass over every satellite's rows with ts_ms >= min_ts_ms.
+    // group(sat_id) is asked once per satellite for the WindowStats its rows
+    // go to, or nullptr to skip it.
+    template <class G>
+    void scan_fleet(std::int64_t min_ts_ms, G&& group) {
+        int v = current_version();
+        if (v == common::kSchemaNone) return;
+        auto& c = db.local();
+        // One snapshot, so every sat_key read below is in the satellites map.
+        c.exec("BEGIN;");
+        try {
+            if (v == common::kSchemaV2) {
+                std::unordered_map<std::int64_t, common::WindowStats*> by_key;
+                {
+                    auto st = c.prepare("SELECT sat_key, sat_id FROM satellites;");
+                    while (st->step()) by_key.emplace(st->column_int64(0), group(st->column_text(1)));
+                }
+                auto st = c.prepare(common::select_fleet_window_sql(v));
+                st->bind(1, min_ts_ms);
+                while (st->step()) {
+                    auto it = by_key.find(st->column_int64(0));
+                    if (it == by_key.end() || !it->second) continue;
+                    it->second->add(st->column_double(1), st->column_int(2), st->column_int(3), st->column_double(4));
+                }
+            } else {
+                std::unordered_map<std::string, common::WindowStats*, TransparentHash, std::equal_to<>> by_id;
+                auto st = c.prepare(common::select_fleet_window_sql(v));
+                st->bind(1, min_ts_ms);
+                while (st->step()) {
+                    std::string_view id = st->column_text(0);
+                    auto it = by_id.find(id);
+                    if (it == by_id.end()) it = by_id.emplace(std::string(id), group(id)).first;
+                    if (!it->second) continue;
+                    it->second->add(st->column_double(1), st->column_int(2), st->column_int(3), st->column_double(4));
+                }
+            }
+            c.exec("COMMIT;");
+        } catch (...) {
+            try { c.exec("ROLLBACK;"); } catch (...) {}
+            // Re-detected on the next query in case a migration swapped tables.
+            version = common::kSchemaNone;
+            throw;
+        }
+    }
 
-    explicit SqliteRO(const std::string& path) {
-        if (sqlite3_open_v2(path.c_str(), &db, SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK) {
-            std::string msg = db ? sqlite3_errmsg(db) : "unknown";
-            if (db) sqlite3_close(db);
-            db = nullptr;
-            throw std::runtime_error("sqlite open (readonly) failed: " + msg);
+    // See common::sat_watermark_sql(); 0 while the file has no schema.
+    std::int64_t watermark(const std::string& sat_id) {
+        int v = current_version();
+        if (v == common::kSchemaNone) return 0;
+        auto st = db.local().prepare(common::sat_watermark_sql(v));
+        st->bind(1, std::string_view(sat_id));
+        return st->step() ? st->column_int64(0) : 0;
+    }
+
+    // Calls fn(rowid, sat_id, ts_ms, latency_ms, dropped, sent, link_quality)
+    // for up to `limit` rows committed after last_rowid, in commit order.
+    // Returns the number of rows seen.
+    template <class F>
+    std::size_t tail(std::int64_t last_rowid, std::size_t limit, F&& fn) {
+        int v = current_version();
+        if (v == common::kSchemaNone) return 0;
+        auto stmt = db.local().prepare(common::tail_sql(v));
+        stmt->bind(1, last_rowid);
+        stmt->bind(2, (std::int64_t)limit);
+        std::size_t n = 0;
+        while (stmt->step()) {
+            fn(stmt->column_int64(0), stmt->column_text(1), stmt->column_int64(2), stmt->column_double(3),
+               stmt->column_int(4), stmt->column_int(5), stmt->column_double(6));
+            n++;
         }
+        return n;
+    }
+
+    // Like tail(), for every row with ts_ms >= min_ts_ms, read from one
+    // snapshot. Returns the rowid to tail from afterwards.
+    template <class F>
+    std::int64_t backfill(std::int64_t min_ts_ms, F&& fn) {
+        int v = current_version();
+        if (v == common::kSchemaNone) return 0;
+        auto& c = db.local();
+        c.exec("BEGIN;");
+        try {
+            std::int64_t max_rowid = 0;
+            {
+                auto st = c.prepare("SELECT coalesce(max(rowid), 0) FROM telemetry;");
+                if (st->step()) max_rowid = st->column_int64(0);
+            }
+            {
+                auto st = c.prepare(common::since_sql(v));
+                st->bind(1, min_ts_ms);
+                st->bind(2, max_rowid);
+                while (st->step()) {
+                    fn(st->column_int64(0), st->column_text(1), st->column_int64(2), st->column_double(3),
+                       st->column_int(4), st->column_int(5), st->column_double(6));
+                }
+            }
+            c.exec("COMMIT;");
+            return max_rowid;
+        } catch (...) {
+            try { c.exec("ROLLBACK;"); } catch (...) {}
+            version = common::kSchemaNone;
+            throw;
+        }
+    }
+
+private:
+    // Re-detected while unknown, e.g. for a partition still being created.
+    int current_version() {
+        int v = version.load();
+        if (v == common::kSchemaNone) {
+            v = common::schema_version(db.local());
+            version = v;
+        }
+        return v;
+    }
+
+    template <class F>
+    void scan_v(int v, const std::string& sat_id, std::int64_t min_ts_ms, F& fn) {
+        // A partition the writer has not finished creating has no rows yet.
+        if (v == common::kSchemaNone) return;
+        auto stmt = db.local().prepare(common::select_window_sql(v));
+
+        stmt->bind(1, std::string_view(sat_id));
+        stmt->bind(2, min_ts_ms);
+
+        while (stmt->step()) {
+            fn(stmt->column_double(0), stmt->column_int(1), stmt->column_int(2), stmt->column_double(3));
+        }
+    }
+};
 
-        sqlite3_busy_timeout(db, 5000);
-        exec("PRAGMA busy_timeout=5000;");
+static std::int64_t now_ms() {
+    return (std::int64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+static std::atomic<long long> g_partitions_scanned{0};
+
+// Read side of the partition layout: one SqliteRO per partition file, opened on
+// first use. A query only touches the partitions overlapping its window, and
+// opens them one at a time. Every reading thread adds a connection to a
+// reader, so readers idle for `idle` are closed and at most `max_open` are
+// kept, least recently used going first; a query still holding one finishes
+// on it. The directory listing is reused for `list_ttl`, and readers for
+// files that retention has removed are dropped when it is refreshed.
+class PartitionReaders {
+public:
+    PartitionReaders(common::PartitionScheme scheme, common::StoragePragmas pragmas, std::chrono::milliseconds list_ttl,
+                     std::chrono::milliseconds idle, std::size_t max_open)
+        : scheme(std::move(scheme)), pragmas(std::move(pragmas)), list_ttl(list_ttl), idle(idle),
+          max_open(std::max<std::size_t>(1, max_open)) {
+        // Fail fast on a bad single-file path instead of on the first request.
+        if (!this->scheme.partitioned()) reader(this->scheme.list().front());
     }
 
-    ~SqliteRO() { if (db) sqlite3_close(db); }
+    const common::PartitionScheme& layout() const { return scheme; }
 
-    void exec(const std::string& sql) {
-        char* err = nullptr;
-        if (sqlite3_exec(db, sql.c_str(), nullptr, nullptr, &err) != SQLITE_OK) {
-            std::string msg = err ? err : "unknown";
-            sqlite3_free(err);
-            throw std::runtime_error("sqlite exec failed: " + msg);
+    // Partitions that can hold rows with ts_ms in [from_ms, to_ms), oldest
+    // first.
+    std::vector<common::Partition> overlapping(std::int64_t from_ms, std::int64_t to_ms) {
+        std::lock_guard<std::mutex> lock(mu);
+        auto now = std::chrono::steady_clock::now();
+        if (!listed_at || now - *listed_at >= list_ttl) {
+            listed = scheme.list();
+            listed_at = now;
+            for (auto it = open.begin(); it != open.end();) {
+                bool keep = std::any_of(listed.begin(), listed.end(),
+                                        [&](const common::Partition& p) { return p.start_ms == it->first; });
+                it = keep ? std::next(it) : open.erase(it);
+            }
         }
+        std::vector<common::Partition> out;
+        for (auto& p : listed) {
+            if (p.end_ms > from_ms && p.start_ms < to_ms) out.push_back(p);
+        }
+        return out;
+    }
+
+    std::shared_ptr<SqliteRO> reader(const common::Partition& p) {
+        std::lock_guard<std::mutex> lock(mu);
+        auto now = std::chrono::steady_clock::now();
+        auto it = open.find(p.start_ms);
+        if (it == open.end()) it = open.emplace(p.start_ms, Reader{std::make_shared<SqliteRO>(p.path, pragmas), now}).first;
+        it->second.used = now;
+        auto db = it->second.db;
+        for (auto e = open.begin(); e != open.end();) {
+            e = e != it && now - e->second.used > idle ? open.erase(e) : std::next(e);
+        }
+        while (open.size() > max_open) {
+            auto lru = open.end();
+            for (auto e = open.begin(); e != open.end(); ++e) {
+                if (e != it && (lru == open.end() || e->second.used < lru->second.used)) lru = e;
+            }
+            open.erase(lru);
+        }
+        return db;
+    }
+
+    // fn(SqliteRO&) for each partition overlapping [from_ms, to_ms), oldest
+    // first.
+    template <class F>
+    void each(std::int64_t from_ms, std::int64_t to_ms, F&& fn) {
+        for (auto& p : overlapping(from_ms, to_ms)) fn(*reader(p));
+    }
+
+    template <class F>
+    void scan(const std::string& sat_id, std::int64_t min_ts_ms, F&& fn) {
+        each(min_ts_ms, std::numeric_limits<std::int64_t>::max(), [&](SqliteRO& db) {
+            db.scan(sat_id, min_ts_ms, fn);
+            g_partitions_scanned++;
+        });
+    }
+
+    // Partitions are listed oldest first, so rows arrive in ts_ms order.
+    template <class F>
+    void scan_range(const std::string& sat_id, std::int64_t from_ms, std::int64_t to_ms, F&& fn) {
+        each(from_ms, to_ms, [&](SqliteRO& db) {
+            db.scan_range(sat_id, from_ms, to_ms, fn);
+            g_partitions_scanned++;
+        });
+    }
+
+    // Changes when sat_id gains a row in any partition overlapping
+    // [from_ms, to_ms), or when that set of partitions changes.
+    std::int64_t watermark(const std::string& sat_id, std::int64_t from_ms, std::int64_t to_ms) {
+        std::uint64_t h = 1469598103934665603ULL;
+        each(from_ms, to_ms, [&](SqliteRO& db) {
+            h = (h ^ (std::uint64_t)db.watermark(sat_id)) * 1099511628211ULL;
+            h = (h ^ std::hash<std::string>{}(db.db.file())) * 1099511628211ULL;
+        });
+        return (std::int64_t)h;
+    }
+
+    template <class G>
+    void scan_fleet(std::int64_t min_ts_ms, G&& group) {
+        each(min_ts_ms, std::numeric_limits<std::int64_t>::max(), [&](SqliteRO& db) {
+            db.scan_fleet(min_ts_ms, group);
+            g_partitions_scanned++;
+        });
     }
 
-    struct Row {
-        double latency_ms;
-        int dropped;
-        int sent;
-        double link_quality;
+    std::size_t open_count() {
+        std::lock_guard<std::mutex> lock(mu);
+        return open.size();
+    }
+
+private:
+    struct Reader {
+        std::shared_ptr<SqliteRO> db;
+        std::chrono::steady_clock::time_point used;
     };
 
-    std::vector<Row> select_rows(const std::string& sat_id, std::int64_t min_ts_ms) {
-        const char* sql =
-            "SELECT latency_ms, dropped_packets, sent_packets, link_quality "
-            "FROM telemetry WHERE sat_id = ? AND ts_ms >= ?;";
-
-        sqlite3_stmt* stmt = nullptr;
-        if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
-            throw std::runtime_error(std::string("sqlite prepare failed: ") + sqlite3_errmsg(db));
-        }
-
-        sqlite3_bind_text(stmt, 1, sat_id.c_str(), -1, SQLITE_TRANSIENT);
-        sqlite3_bind_int64(stmt, 2, min_ts_ms);
-
-        std::vector<Row> out;
-        while (true) {
-            int rc = sqlite3_step(stmt);
-            if (rc == SQLITE_ROW) {
-                Row r;
-                r.latency_ms = sqlite3_column_double(stmt, 0);
-                r.dropped = sqlite3_column_int(stmt, 1);
-                r.sent = sqlite3_column_int(stmt, 2);
-                r.link_quality = sqlite3_column_double(stmt, 3);
-                out.push_back(r);
-            } else if (rc == SQLITE_DONE) {
-                break;
+    common::PartitionScheme scheme;
+    common::StoragePragmas pragmas;
+    const std::chrono::milliseconds list_ttl;
+    const std::chrono::milliseconds idle;
+    const std::size_t max_open;
+
+    std::mutex mu;
+    std::vector<common::Partition> listed;
+    std::optional<std::chrono::steady_clock::time_point> listed_at;
+    std::map<std::int64_t, Reader> open;
+};
+
+static std::atomic<long long> g_live_hits{0};
+static std::atomic<long long> g_live_misses{0};
+static std::atomic<long long> g_live_rows_tailed{0};
+static std::atomic<long long> g_live_rows_evicted{0};
+
+// In-memory copy of the most recent rows per satellite, so /metrics over a
+// recent window is answered without touching SQLite. tick() runs on its own
+// thread: it follows every raw file that can hold rows newer than cutoff() by
+// rowid, appends new rows to per-satellite buffers and evicts rows older than
+// the horizon, raising the cutoff further while the store is over its memory
+// budget. Every stored row with ts_ms >= cutoff() is in memory, so a window
+// starting at or after it can be served from here. Answers trail SQLite by at
+// most one tail interval.
+class LiveStore {
+public:
+    LiveStore(PartitionReaders& readers, std::chrono::milliseconds horizon, std::size_t budget_bytes,
+              std::size_t tail_chunk)
+        : readers(readers), horizon(horizon.count()), budget(budget_bytes),
+          tail_chunk(std::max<std::size_t>(1, tail_chunk)) {}
+
+    // Adds the rows of sat_id with from_ms <= ts_ms < to_ms to stats and
+    // returns true, or returns false without touching stats if part of that
+    // range is no longer (or not yet) held.
+    bool scan(const std::string& sat_id, std::int64_t from_ms, std::int64_t to_ms, common::WindowStats& stats) {
+        if (!ready.load() || from_ms < cutoff_ms.load()) return false;
+        std::shared_lock<std::shared_mutex> lock(map_mu);
+        auto it = sats.find(sat_id);
+        if (it == sats.end()) return true;
+        Sat& s = *it->second;
+        std::lock_guard<std::mutex> sat_lock(s.mu);
+        // Re-checked under the satellite lock: eviction raises the cutoff
+        // before it touches any buffer.
+        if (from_ms < cutoff_ms.load()) return false;
+        common::accumulate_range(s.rows.span(), from_ms, to_ms, stats);
+        return true;
+    }
+
+    // A value that changes whenever a row is appended for sat_id. False under
+    // the same conditions as scan().
+    bool watermark(const std::string& sat_id, std::int64_t min_ts_ms, std::int64_t& out) {
+        if (!ready.load() || min_ts_ms < cutoff_ms.load()) return false;
+        std::shared_lock<std::shared_mutex> lock(map_mu);
+        auto it = sats.find(sat_id);
+        if (it == sats.end()) {
+            out = 0;
+            return true;
+        }
+        std::lock_guard<std::mutex> sat_lock(it->second->mu);
+        out = it->second->last_seq;
+        return true;
+    }
+
+    // scan() for every satellite, with group() as in SqliteRO::scan_fleet.
+    // On false, stats already handed out are partial and must be discarded.
+    template <class G>
+    bool scan_fleet(std::int64_t min_ts_ms, G&& group) {
+        if (!ready.load() || min_ts_ms < cutoff_ms.load()) return false;
+        std::shared_lock<std::shared_mutex> lock(map_mu);
+        for (auto& [id, s] : sats) {
+            common::WindowStats* stats = group(std::string_view(id));
+            if (!stats) continue;
+            std::lock_guard<std::mutex> sat_lock(s->mu);
+            if (min_ts_ms < cutoff_ms.load()) return false;
+            common::accumulate_range(s->rows.span(), min_ts_ms, std::numeric_limits<std::int64_t>::max(), *stats);
+        }
+        return true;
+    }
+
+    // Adds each row of sat_id with from_ms <= ts_ms < from_ms + n * step_ms to
+    // out[(ts_ms - from_ms) / step_ms]; false, as scan(), if not held.
+    bool scan_buckets(const std::string& sat_id, std::int64_t from_ms, std::int64_t step_ms, std::int32_t n,
+                      common::WindowStats* out) {
+        if (!ready.load() || from_ms < cutoff_ms.load()) return false;
+        std::shared_lock<std::shared_mutex> lock(map_mu);
+        auto it = sats.find(sat_id);
+        if (it == sats.end()) return true;
+        Sat& s = *it->second;
+        std::lock_guard<std::mutex> sat_lock(s.mu);
+        if (from_ms < cutoff_ms.load()) return false;
+        auto c = s.rows.span();
+        thread_local std::vector<std::int32_t> idx;
+        if (idx.size() < c.n) idx.resize(c.n);
+        common::simd::bucket_index(c.ts, c.n, from_ms, step_ms, n, idx.data());
+        for (std::size_t i = 0; i < c.n; i++) {
+            if (idx[i] >= 0) out[idx[i]].add(c.latency[i], c.dropped[i], c.sent[i], c.link_quality[i]);
+        }
+        return true;
+    }
+
+    void tick(std::int64_t now) {
+        if (!ready.load()) {
+            backfill(now);
+            ready = true;
+        } else {
+            follow();
+        }
+        caught_up_ms = now;
+        evict(now);
+    }
+
+    std::int64_t cutoff() const { return cutoff_ms.load(); }
+    std::int64_t lag_ms(std::int64_t now) const { return ready.load() ? now - caught_up_ms.load() : -1; }
+
+    std::size_t memory_bytes() const {
+        return (std::size_t)rows_held.load() * common::WindowColumns::kRowBytes + (std::size_t)sat_bytes.load();
+    }
+
+    std::size_t satellites() {
+        std::shared_lock<std::shared_mutex> lock(map_mu);
+        return sats.size();
+    }
+
+private:
+    struct Sat {
+        std::mutex mu;
+        common::WindowColumns rows;  // arrival (rowid) order
+        std::int64_t last_seq = 0;
+    };
+
+    void append(std::string_view sat_id, std::int64_t ts, double latency, int dropped, int sent, double lq) {
+        if (ts < cutoff_ms.load()) return;
+        Sat* s = nullptr;
+        {
+            std::shared_lock<std::shared_mutex> lock(map_mu);
+            auto it = sats.find(sat_id);
+            if (it != sats.end()) s = it->second.get();
+        }
+        if (!s) {
+            std::unique_lock<std::shared_mutex> lock(map_mu);
+            auto& slot = sats[std::string(sat_id)];
+            if (!slot) {
+                slot = std::make_unique<Sat>();
+                sat_bytes += (long long)(sizeof(Sat) + sat_id.size() + 64);
+            }
+            s = slot.get();
+        }
+        std::lock_guard<std::mutex> lock(s->mu);
+        s->rows.push_back(ts, latency, lq, dropped, sent);
+        s->last_seq = ++append_seq;
+        rows_held++;
+        g_live_rows_tailed++;
+    }
+
+    void backfill(std::int64_t now) {
+        cutoff_ms = now - horizon;
+        try {
+            for (auto& part : readers.overlapping(cutoff_ms.load(), std::numeric_limits<std::int64_t>::max())) {
+                auto db = readers.reader(part);
+                watermarks[db->db.file()] = db->backfill(cutoff_ms.load(), [this](std::int64_t, std::string_view sat,
+                    std::int64_t ts, double lat, int dropped, int sent, double lq) { append(sat, ts, lat, dropped, sent, lq); });
+            }
+        } catch (...) {
+            // Start over on the next tick rather than tail on top of a partial copy.
+            std::unique_lock<std::shared_mutex> lock(map_mu);
+            sats.clear();
+            watermarks.clear();
+            rows_held = 0;
+            sat_bytes = 0;
+            throw;
+        }
+        spdlog::info("live store backfilled {} rows for {} satellites", rows_held.load(), satellites());
+    }
+
+    void follow() {
+        std::vector<std::string> present;
+        for (auto& part : readers.overlapping(cutoff_ms.load(), std::numeric_limits<std::int64_t>::max())) {
+            auto db = readers.reader(part);
+            // A partition first seen now was created after the backfill, so
+            // all of its rows are new. The watermark moves with every row, so
+            // a failure part-way through never replays rows on the next tick.
+            std::int64_t& wm = watermarks[db->db.file()];
+            present.push_back(db->db.file());
+            while (true) {
+                std::size_t n = db->tail(wm, tail_chunk, [&](std::int64_t rowid, std::string_view sat,
+                    std::int64_t ts, double lat, int dropped, int sent, double lq) {
+                    append(sat, ts, lat, dropped, sent, lq);
+                    wm = rowid;
+                });
+                if (n < tail_chunk) break;
+            }
+        }
+        for (auto it = watermarks.begin(); it != watermarks.end();) {
+            bool keep = std::find(present.begin(), present.end(), it->first) != present.end();
+            it = keep ? std::next(it) : watermarks.erase(it);
+        }
+    }
+
+    void evict(std::int64_t now) {
+        std::int64_t cut = std::max(cutoff_ms.load(), now - horizon);
+        std::size_t sat_count = satellites();
+        std::size_t over = 0;
+        do {
+            // Over budget: advance the cutoff an eighth of the way to now per
+            // round until enough rows are gone.
+            if (over) cut += std::max<std::int64_t>(1, (now - cut) / 8);
+            cutoff_ms = cut;
+            std::shared_lock<std::shared_mutex> lock(map_mu);
+            for (auto& [id, s] : sats) {
+                std::lock_guard<std::mutex> sat_lock(s->mu);
+                auto n = (long long)s->rows.drop_front_before(cut);
+                rows_held -= n;
+                g_live_rows_evicted += n;
+            }
+            over = memory_bytes() > budget ? 1 : 0;
+        } while (over && cut < now && sat_count > 0);
+    }
+
+    PartitionReaders& readers;
+    const std::int64_t horizon;
+    const std::size_t budget;
+    const std::size_t tail_chunk;
+
+    std::atomic<bool> ready{false};
+    std::atomic<std::int64_t> cutoff_ms{0};
+    std::atomic<std::int64_t> caught_up_ms{0};
+    std::atomic<long long> rows_held{0};
+    std::atomic<long long> sat_bytes{0};
+    std::atomic<std::int64_t> append_seq{0};  // never reset, so never reused
+
+    std::shared_mutex map_mu;
+    std::unordered_map<std::string, std::unique_ptr<Sat>, TransparentHash, std::equal_to<>> sats;
+    std::map<std::string, std::int64_t> watermarks;  // tick() thread only
+};
+
+// Read side of the ingest rollups. A tier answers for a time range only when
+// it holds the range completely: no earlier than its oldest kept bucket, and
+// ending no later than the oldest raw row the rollup engine has not folded
+// yet (see common/rollup.hpp). Absent until ingest has created the database.
+class RollupReader {
+public:
+    RollupReader(const common::PartitionScheme& scheme, common::StoragePragmas pragmas)
+        : path(common::rollup_path(scheme)), pragmas(std::move(pragmas)) {}
+
+    // [first, last) of the tier's complete coverage of [from_ms, to_ms), empty
+    // if it has none or the database is not there yet.
+    std::pair<std::int64_t, std::int64_t> coverage(common::RollupTier tier, PartitionReaders& raw,
+                                                   std::int64_t from_ms, std::int64_t to_ms) {
+        common::Database* d = get();
+        if (!d) return {0, 0};
+        try {
+            std::int64_t oldest = std::numeric_limits<std::int64_t>::max();
+            {
+                auto st = d->local().prepare(std::string("SELECT coalesce(min(bucket_ms), 9223372036854775807) FROM ") +
+                                             common::tier_table(tier) + ";");
+                if (st->step()) oldest = st->column_int64(0);
+            }
+            std::map<std::string, std::int64_t> folded;
+            {
+                auto st = d->local().prepare("SELECT source, last_rowid FROM rollup_watermark;");
+                while (st->step()) folded[std::string(st->column_text(0))] = st->column_int64(1);
+            }
+            // Read after the watermarks: rows folded meanwhile only make the
+            // answer conservative.
+            std::int64_t until = std::numeric_limits<std::int64_t>::max();
+            for (auto& part : raw.overlapping(from_ms, to_ms)) {
+                auto db = raw.reader(part);
+                auto it = folded.find(common::rollup_source(db->db.file()));
+                until = std::min(until, db->min_ts_after(it == folded.end() ? 0 : it->second));
+            }
+            std::int64_t first = std::max(from_ms, oldest), last = std::min(to_ms, until);
+            return first < last ? std::make_pair(first, last) : std::make_pair<std::int64_t, std::int64_t>(0, 0);
+        } catch (const std::exception& e) {
+            spdlog::debug("rollups unavailable: {}", e.what());
+            return {0, 0};
+        }
+    }
+
+    // fn(bucket_ms, RollupAgg) for sat_id's buckets in [from_ms, to_ms), in order.
+    template <class F>
+    void scan(common::RollupTier tier, const std::string& sat_id, std::int64_t from_ms, std::int64_t to_ms, F&& fn) {
+        common::Database* d = get();
+        if (!d) return;
+        auto st = d->local().prepare(std::string("SELECT bucket_ms, count, sum_dropped, sum_sent, sum_link_quality, "
+                                                 "min_link_quality, max_link_quality, latency_sketch FROM ") +
+                                     common::tier_table(tier) +
+                                     " WHERE sat_id = ? AND bucket_ms >= ? AND bucket_ms < ? ORDER BY bucket_ms;");
+        st->bind(1, std::string_view(sat_id));
+        st->bind(2, from_ms);
+        st->bind(3, to_ms);
+        while (st->step()) fn(st->column_int64(0), common::RollupAgg::from_row(*st, 1));
+    }
+
+private:
+    common::Database* get() {
+        std::lock_guard<std::mutex> lock(mu);
+        if (!db && std::filesystem::exists(path)) {
+            try {
+                db = std::make_unique<common::Database>(path, common::OpenMode::ReadOnly, pragmas);
+            } catch (const std::exception& e) {
+                spdlog::warn("cannot open rollups {}: {}", path, e.what());
+            }
+        }
+        return db.get();
+    }
+
+    const std::string path;
+    const common::StoragePragmas pragmas;
+    std::mutex mu;
+    std::unique_ptr<common::Database> db;
+};
+
+// One piece of a /metrics plan: [from_ms, to_ms) read from a rollup tier or,
+// for tier "raw", from the live store or SQLite. rows is filled in by the
+// query: rollup buckets or raw rows read.
+struct PlanSegment {
+    std::optional<common::RollupTier> tier;
+    std::int64_t from_ms = 0;
+    std::int64_t to_ms = 0;
+    std::int64_t rows = 0;
+
+    const char* name() const { return tier ? common::tier_table(*tier) : "raw"; }
+};
+
+// Covers [from_ms, to_ms) with whole buckets of the coarsest tier that holds
+// them, then whole buckets of the finer one, and raw rows for the partial
+// buckets at the edges and anything no tier holds yet. Nothing at or after
+// tiers_until (the request time, for an open-ended window) comes from a tier.
+// Segments come out in time order with neighbours of the same tier merged.
+static std::vector<PlanSegment> plan_range(RollupReader& rollups, PartitionReaders& raw, std::int64_t from_ms,
+                                           std::int64_t to_ms, std::int64_t tiers_until) {
+    static constexpr common::RollupTier kTiers[] = {common::RollupTier::Hour, common::RollupTier::Minute};
+    std::vector<PlanSegment> out;
+    auto push = [&out](std::optional<common::RollupTier> tier, std::int64_t a, std::int64_t b) {
+        if (a >= b) return;
+        if (!out.empty() && out.back().tier == tier && out.back().to_ms == a) out.back().to_ms = b;
+        else out.push_back(PlanSegment{tier, a, b});
+    };
+    std::function<void(std::int64_t, std::int64_t, std::size_t)> split = [&](std::int64_t a, std::int64_t b,
+                                                                             std::size_t t) {
+        if (a >= b) return;
+        if (t == std::size(kTiers)) return push(std::nullopt, a, b);
+        std::int64_t w = common::tier_width_ms(kTiers[t]);
+        auto [first, last] = rollups.coverage(kTiers[t], raw, a, b);
+        std::int64_t lo = first, hi = last;
+        if (first < last) {
+            lo = first + (w - ((first % w) + w) % w) % w;
+            hi = last - ((last % w) + w) % w;
+        }
+        if (lo >= hi) return split(a, b, t + 1);
+        split(a, lo, t + 1);
+        push(kTiers[t], lo, hi);
+        split(hi, b, t + 1);
+    };
+    split(from_ms, std::min(to_ms, tiers_until), 0);
+    push(std::nullopt, std::max(from_ms, std::min(to_ms, tiers_until)), to_ms);
+    return out;
+}
+
+static std::atomic<long long> g_plan_rows_raw{0}, g_plan_rows_1m{0}, g_plan_rows_1h{0};
+
+// What window queries read from. Ranges up to raw_max_ms always come from raw
+// rows; longer ones take whole rollup buckets where a tier holds them.
+struct QuerySources {
+    PartitionReaders& db;
+    LiveStore* live;
+    RollupReader& rollups;
+    std::size_t exact_limit;
+    std::int64_t raw_max_ms;
+};
+
+// A value that changes whenever sat_id gains a row in [from_ms, to_ms), read
+// from the live store when it holds the range and SQLite otherwise; the low
+// bit tells the two apart.
+static std::int64_t query_watermark(QuerySources& src, const std::string& sat_id, std::int64_t from_ms,
+                                    std::int64_t to_ms) {
+    std::int64_t wm = 0;
+    if (src.live && src.live->watermark(sat_id, from_ms, wm)) return (std::int64_t)((std::uint64_t)wm << 1);
+    return (std::int64_t)((std::uint64_t)src.db.watermark(sat_id, from_ms, to_ms) << 1 | 1);
+}
+
+
+static std::atomic<long long> g_cache_hits{0};
+static std::atomic<long long> g_cache_coalesced{0};
+static std::atomic<long long> g_cache_misses{0};
+static std::atomic<long long> g_cache_evictions{0};
+
+// /metrics response bodies by request key. An entry answers a later request
+// only within the same time bucket and while the satellite's watermark is
+// unchanged, so a cached answer is never older than one bucket and never
+// misses a row the store had when it was asked. Identical requests that
+// arrive while an entry is being computed wait for that computation
+// (singleflight). Least recently used entries go once the bodies exceed the
+// byte budget; failures are not cached.
+class ResponseCache {
+public:
+    ResponseCache(std::size_t budget_bytes, std::int64_t bucket_ms)
+        : budget(budget_bytes), bucket_ms(std::max<std::int64_t>(1, bucket_ms)) {}
+
+    template <class F>
+    std::string get(const std::string& key, std::int64_t watermark, std::int64_t now, F&& compute) {
+        std::int64_t bucket = now / bucket_ms;
+        std::shared_future<std::string> body;
+        std::promise<std::string> result;
+        std::uint64_t gen = 0;
+        {
+            std::lock_guard<std::mutex> lock(mu);
+            auto it = entries.find(key);
+            if (it != entries.end() && it->second.bucket == bucket && it->second.watermark == watermark) {
+                lru.splice(lru.begin(), lru, it->second.pos);
+                (it->second.ready ? g_cache_hits : g_cache_coalesced)++;
+                body = it->second.body;
             } else {
-                sqlite3_finalize(stmt);
-                throw std::runtime_error(std::string("sqlite step failed: ") + sqlite3_errmsg(db));
+                g_cache_misses++;
+                if (it == entries.end()) {
+                    lru.push_front(key);
+                    it = entries.emplace(key, Entry{}).first;
+                    it->second.pos = lru.begin();
+                } else {
+                    lru.splice(lru.begin(), lru, it->second.pos);
+                    held -= it->second.bytes;
+                }
+                Entry& e = it->second;
+                e.bucket = bucket;
+                e.watermark = watermark;
+                e.gen = gen = ++next_gen;
+                e.ready = false;
+                e.body = result.get_future().share();
+                e.bytes = 2 * key.size() + kEntryOverhead;
+                held += e.bytes;
             }
         }
-        sqlite3_finalize(stmt);
-        return out;
+        if (!gen) return body.get();
+
+        try {
+            std::string out = compute();
+            result.set_value(out);
+            finish(key, gen, out.size());
+            return out;
+        } catch (...) {
+            result.set_exception(std::current_exception());
+            finish(key, gen, std::nullopt);
+            throw;
+        }
+    }
+
+    std::size_t entry_count() {
+        std::lock_guard<std::mutex> lock(mu);
+        return entries.size();
+    }
+
+    std::size_t bytes() {
+        std::lock_guard<std::mutex> lock(mu);
+        return held;
+    }
+
+private:
+    static constexpr std::size_t kEntryOverhead = 128;
+
+    struct Entry {
+        std::int64_t bucket = 0;
+        std::int64_t watermark = 0;
+        std::uint64_t gen = 0;
+        bool ready = false;
+        std::shared_future<std::string> body;
+        std::size_t bytes = 0;
+        std::list<std::string>::iterator pos;
+    };
+
+    // Publishes (or, on failure, drops) the entry computed as `gen`, unless a
+    // newer computation or eviction has replaced it meanwhile.
+    void finish(const std::string& key, std::uint64_t gen, std::optional<std::size_t> body_bytes) {
+        std::lock_guard<std::mutex> lock(mu);
+        auto it = entries.find(key);
+        if (it == entries.end() || it->second.gen != gen) return;
+        if (!body_bytes) {
+            erase(it);
+            return;
+        }
+        it->second.ready = true;
+        it->second.bytes += *body_bytes;
+        held += *body_bytes;
+        auto victim = std::prev(lru.end());
+        while (held > budget && !entries.empty()) {
+            auto e = entries.find(*victim);
+            bool last = victim == lru.begin();
+            if (!last) --victim;
+            // In-flight entries are left to finish().
+            if (e->second.ready) {
+                erase(e);
+                g_cache_evictions++;
+            }
+            if (last) break;
+        }
+    }
+
+    void erase(std::unordered_map<std::string, Entry, TransparentHash, std::equal_to<>>::iterator it) {
+        held -= it->second.bytes;
+        lru.erase(it->second.pos);
+        entries.erase(it);
     }
+
+    const std::size_t budget;
+    const std::int64_t bucket_ms;
+
+    std::mutex mu;
+    std::unordered_map<std::string, Entry, TransparentHash, std::equal_to<>> entries;
+    std::list<std::string> lru;  // most recently used first
+    std::size_t held = 0;
+    std::uint64_t next_gen = 0;
 };
 
-static double percentile(std::vector<double> v, double p) {
-    if (v.empty()) return 0.0;
-    std::sort(v.begin(), v.end());
-    double idx = (p / 100.0) * (v.size() - 1);
-    std::size_t i = static_cast<std::size_t>(idx);
-    double frac = idx - static_cast<double>(i);
-    if (i + 1 < v.size()) return v[i] * (1.0 - frac) + v[i + 1] * frac;
-    return v[i];
+// Parses q=50,90,99.9 (percent, 0 < q <= 100) into {label, fraction} pairs.
+static bool parse_quantiles(const std::string& spec, std::vector<std::pair<std::string, double>>& out, std::string& err) {
+    std::size_t pos = 0;
+    while (pos <= spec.size()) {
+        std::size_t comma = spec.find(',', pos);
+        if (comma == std::string::npos) comma = spec.size();
+        std::string item = spec.substr(pos, comma - pos);
+        pos = comma + 1;
+        char* end = nullptr;
+        double v = std::strtod(item.c_str(), &end);
+        if (item.empty() || *end != '\0' || !(v > 0.0 && v <= 100.0)) {
+            err = "invalid quantile '" + item + "': expected a percentage in (0,100]";
+            return false;
+        }
+        out.emplace_back(item, v / 100.0);
+        if (out.size() > 32) {
+            err = "too many quantiles (max 32)";
+            return false;
+        }
+    }
+    return true;
+}
+
+using Quantiles = std::vector<std::pair<std::string, double>>;
+
+// The per-satellite fields of /metrics; /metrics/fleet emits one per satellite.
+static json window_json(const std::string& sat_id, int window_s, common::WindowStats& stats, const Quantiles& quantiles) {
+    json out = {
+        {"sat_id", sat_id},
+        {"window_s", window_s},
+        {"count", stats.count},
+        {"drop_rate", stats.drop_rate()},
+        {"latency_p50_ms", stats.latency.quantile(0.50)},
+        {"latency_p95_ms", stats.latency.quantile(0.95)},
+        {"avg_link_quality", stats.avg_link_quality()},
+        {"quantile_mode", stats.latency.exact() ? "exact" : "sketch"}
+    };
+    if (!quantiles.empty()) {
+        json q = json::object();
+        for (auto& [label, frac] : quantiles) q[label] = stats.latency.quantile(frac);
+        out["latency_quantiles_ms"] = std::move(q);
+    }
+    return out;
+}
+
+// window_json() for sat_id over [from_ms, to_ms) (to_ms INT64_MAX for a
+// window open at the end), plus the tier it was answered from ("mixed" for
+// more than one), rows_scanned and the plan segments. exact reads raw rows
+// only; otherwise see plan_range().
+static json query_window(QuerySources& src, const std::string& sat_id, int window_s, std::int64_t from_ms,
+                         std::int64_t to_ms, std::int64_t now, bool exact, const Quantiles& quantiles) {
+    std::vector<PlanSegment> plan;
+    if (exact || std::min(to_ms, now) - from_ms <= src.raw_max_ms) plan.push_back(PlanSegment{std::nullopt, from_ms, to_ms});
+    else plan = plan_range(src.rollups, src.db, from_ms, to_ms, now);
+
+    common::WindowStats stats(src.exact_limit);
+    auto add = [&stats](double lat, int dropped, int sent, double lq) { stats.add(lat, dropped, sent, lq); };
+    std::int64_t rows = 0;
+    json segments = json::array();
+    for (auto& seg : plan) {
+        if (seg.tier) {
+            src.rollups.scan(*seg.tier, sat_id, seg.from_ms, seg.to_ms, [&](std::int64_t, const common::RollupAgg& a) {
+                stats.merge(a.count, a.sum_dropped, a.sum_sent, a.sum_link_quality, a.latency);
+                seg.rows++;
+            });
+        } else {
+            std::int64_t before = stats.count;
+            if (src.live && src.live->scan(sat_id, seg.from_ms, seg.to_ms, stats)) {
+                g_live_hits++;
+            } else {
+                if (src.live) g_live_misses++;
+                if (seg.to_ms == std::numeric_limits<std::int64_t>::max()) {
+                    src.db.scan(sat_id, seg.from_ms, add);
+                } else {
+                    src.db.scan_range(sat_id, seg.from_ms, seg.to_ms,
+                                      [&add](std::int64_t, double lat, int dropped, int sent, double lq) {
+                                          add(lat, dropped, sent, lq);
+                                      });
+                }
+            }
+            seg.rows = stats.count - before;
+        }
+        std::string_view tier = seg.name();
+        (tier == "raw" ? g_plan_rows_raw : tier == "rollup_1m" ? g_plan_rows_1m : g_plan_rows_1h) += seg.rows;
+        rows += seg.rows;
+        json item = {{"tier", seg.name()}, {"from_ms", seg.from_ms}, {"rows", seg.rows}};
+        if (seg.to_ms != std::numeric_limits<std::int64_t>::max()) item["to_ms"] = seg.to_ms;
+        segments.push_back(std::move(item));
+    }
+
+    json out = window_json(sat_id, window_s, stats, quantiles);
+    bool mixed = std::any_of(plan.begin(), plan.end(), [&](const PlanSegment& p) { return p.tier != plan.front().tier; });
+    out["tier"] = mixed ? "mixed" : plan.front().name();
+    out["rows_scanned"] = rows;
+    out["plan"] = std::move(segments);
+    return out;
+}
+
+// Reads an optional integer parameter; false (with err set) if it is present
+// but not an integer.
+static bool int_param(const httplib::Request& req, const char* name, std::int64_t& out, std::string& err) {
+    if (!req.has_param(name)) return true;
+    std::string v = req.get_param_value(name);
+    char* end = nullptr;
+    long long x = std::strtoll(v.c_str(), &end, 10);
+    if (v.empty() || *end != '\0') {
+        err = std::string("invalid ") + name + " '" + v + "': expected an integer";
+        return false;
+    }
+    out = x;
+    return true;
+}
+
+// int_param() for a timestamp, which must also lie in the years 1970 to
+// 9999 so that window and plan arithmetic on it cannot overflow.
+static bool epoch_param(const httplib::Request& req, const char* name, std::int64_t& out, std::string& err) {
+    std::int64_t v = out;
+    if (!int_param(req, name, v, err)) return false;
+    if (req.has_param(name) && (v < common::PartitionScheme::kMinTsMs || v > common::PartitionScheme::kMaxTsMs)) {
+        err = std::string("invalid ") + name + " '" + req.get_param_value(name) + "': expected epoch milliseconds in [" +
+              std::to_string(common::PartitionScheme::kMinTsMs) + ", " +
+              std::to_string(common::PartitionScheme::kMaxTsMs) + "]";
+        return false;
+    }
+    out = v;
+    return true;
 }
 
-static std::atomic<long long> g_health{0}, g_ready{0}, g_prom{0}, g_query{0};
+// Every sat_id parameter, each a comma-separated list.
+static std::vector<std::string> sat_id_params(const httplib::Request& req) {
+    std::vector<std::string> ids;
+    for (std::size_t i = 0; i < req.get_param_value_count("sat_id"); i++) {
+        std::string list = req.get_param_value("sat_id", i);
+        std::size_t pos = 0;
+        while (pos <= list.size()) {
+            std::size_t comma = list.find(',', pos);
+            if (comma == std::string::npos) comma = list.size();
+            if (comma > pos) ids.push_back(list.substr(pos, comma - pos));
+            pos = comma + 1;
+        }
+    }
+    return ids;
+}
+
+static std::atomic<long long> g_export_rows{0}, g_export_bytes{0}, g_export_rejected{0};
+
+// Keeps exports from starving the query routes: at most max_active run at
+// once (the rest are turned away), and together they stream at most
+// rows_per_s rows a second, paced a page at a time. rows_per_s <= 0 disables pacing.
+class ExportThrottle {
+public:
+    ExportThrottle(std::size_t max_active, double rows_per_s)
+        : max_active(std::max<std::size_t>(1, max_active)), rate(rows_per_s), tokens(rows_per_s) {}
+
+    bool try_acquire() {
+        std::lock_guard<std::mutex> lock(mu);
+        if (active >= max_active) return false;
+        active++;
+        return true;
+    }
+
+    void release() {
+        std::lock_guard<std::mutex> lock(mu);
+        active--;
+    }
+
+    std::size_t running() {
+        std::lock_guard<std::mutex> lock(mu);
+        return active;
+    }
+
+    // Charges n rows to the shared budget and sleeps while it is overdrawn,
+    // so concurrent exports split the rate between them.
+    void pace(std::size_t n) {
+        if (rate <= 0) return;
+        std::chrono::duration<double> wait{0};
+        {
+            std::lock_guard<std::mutex> lock(mu);
+            auto now = std::chrono::steady_clock::now();
+            tokens = std::min(rate, tokens + rate * std::chrono::duration<double>(now - last).count());
+            last = now;
+            tokens -= (double)n;
+            if (tokens < 0) wait = std::chrono::duration<double>(-tokens / rate);
+        }
+        if (wait.count() > 0) std::this_thread::sleep_for(wait);
+    }
+
+private:
+    const std::size_t max_active;
+    const double rate;
+
+    std::mutex mu;
+    std::size_t active = 0;
+    double tokens;
+    std::chrono::steady_clock::time_point last = std::chrono::steady_clock::now();
+};
+
+// Raw rows of a satellite set over [from_ms, to_ms), one page of at most
+// page_rows rows per next() call, partition by partition in (ts_ms, rowid)
+// order. The satellite filter runs in SQLite, so rows of other satellites are
+// never handed out or charged to the throttle. Only the current page is ever
+// in memory and no SQLite cursor is held between pages, so an export of any
+// length neither grows nor pins the WAL; partitions are opened as it reaches
+// them. Holds one ExportThrottle slot for its lifetime.
+class ExportStream {
+public:
+    enum class Format { Ndjson, Csv, Arrow };
+
+    ExportStream(ExportThrottle& throttle, PartitionReaders& readers, std::vector<common::Partition> parts,
+                 std::int64_t from_ms, std::int64_t to_ms, Format format, std::size_t page_rows,
+                 const std::vector<std::string>& ids, std::optional<std::string> prefix)
+        : throttle(throttle), readers(readers), parts(std::move(parts)), from_ms(from_ms), to_ms(to_ms), format(format),
+          page_rows(std::max<std::size_t>(1, page_rows)), sats(ids, std::move(prefix)),
+          window_ms(std::max<std::uint64_t>(1, distance(from_ms, to_ms) / 64)) {
+        if (format == Format::Arrow) {
+            using common::arrow::Type;
+            arrow.emplace(std::vector<common::arrow::Field>{
+                {"sat_id", Type::Utf8}, {"event_id", Type::Utf8}, {"ts_ms", Type::TimestampMs},
+                {"latency_ms", Type::Float64}, {"dropped_packets", Type::Int32}, {"sent_packets", Type::Int32},
+                {"link_quality", Type::Float64}});
+        }
+    }
+
+    ~ExportStream() { throttle.release(); }
+
+    ExportStream(const ExportStream&) = delete;
+    ExportStream& operator=(const ExportStream&) = delete;
+
+    // Appends the next piece of the body to out; false once that was the last.
+    bool next(std::string& out) {
+        if (!started) {
+            started = true;
+            if (format == Format::Csv) out += "sat_id,event_id,ts_ms,latency_ms,dropped_packets,sent_packets,link_quality\n";
+            if (arrow) out += arrow->schema();
+        }
+        if (part == parts.size()) {
+            if (arrow) out += common::arrow::StreamWriter::end();
+            return false;
+        }
+        // A filtered page is read off the (sat_key, ts_ms) index and sorted,
+        // which costs every selected row up to its upper bound; capping that
+        // at a window sized to hold about a page keeps each sort page-sized.
+        std::int64_t lower = std::max(from_ms, after_ts);
+        std::int64_t upper = to_ms;
+        if (!sats.everyone && window_ms < distance(lower, to_ms))
+            upper = (std::int64_t)((std::uint64_t)lower + window_ms);
+        std::size_t streamed = readers.reader(parts[part])->export_page(from_ms, upper, after_ts, after_rowid, page_rows, sats,
+            [&](std::int64_t rowid, std::string_view sat, std::string_view event_id, std::int64_t ts, double lat,
+                int dropped, int sent, double lq) {
+                after_ts = ts;
+                after_rowid = rowid;
+                emit(out, sat, event_id, ts, lat, dropped, sent, lq);
+                g_export_rows++;
+            });
+        if (arrow) out += arrow->flush();
+        if (streamed == page_rows) {
+            // Full page: the window held at least a page, so narrow it if the
+            // page ended in its first half.
+            if (distance(lower, after_ts) < window_ms / 2) window_ms = std::max<std::uint64_t>(1, window_ms / 2);
+        } else if (upper < to_ms) {
+            // The window ran dry; carry on from its end with a wider one.
+            after_ts = upper - 1;
+            after_rowid = std::numeric_limits<std::int64_t>::max();
+            std::uint64_t span = distance(from_ms, to_ms);
+            window_ms = window_ms > span / 2 ? span : window_ms * 2;
+        } else {
+            part++;
+            after_ts = std::numeric_limits<std::int64_t>::min();
+            after_rowid = 0;
+        }
+        throttle.pace(streamed);
+        return true;
+    }
+
+#ifdef CPPHTTPLIB_ZLIB_SUPPORT
+    std::unique_ptr<common::GzipStream> gzip;
+#endif
+
+private:
+    void emit(std::string& out, std::string_view sat, std::string_view event_id, std::int64_t ts, double lat,
+              int dropped, int sent, double lq) {
+        switch (format) {
+        case Format::Ndjson:
+            out += json{{"sat_id", sat}, {"event_id", event_id}, {"ts_ms", ts}, {"latency_ms", lat},
+                        {"dropped_packets", dropped}, {"sent_packets", sent}, {"link_quality", lq}}.dump();
+            out += '\n';
+            break;
+        case Format::Csv:
+            csv_field(out, sat);
+            out += ',';
+            csv_field(out, event_id);
+            out += ',' + std::to_string(ts) + ',';
+            csv_number(out, lat);
+            out += ',' + std::to_string(dropped) + ',' + std::to_string(sent) + ',';
+            csv_number(out, lq);
+            out += '\n';
+            break;
+        case Format::Arrow:
+            arrow->append(0, sat);
+            arrow->append(1, event_id);
+            arrow->append(2, ts);
+            arrow->append(3, lat);
+            arrow->append(4, (std::int32_t)dropped);
+            arrow->append(5, (std::int32_t)sent);
+            arrow->append(6, lq);
+            arrow->end_row();
+            break;
+        }
+    }
+
+    // b - a for a <= b, which may not fit in an int64.
+    static std::uint64_t distance(std::int64_t a, std::int64_t b) { return (std::uint64_t)b - (std::uint64_t)a; }
+
+    // RFC 4180: quoted, with quotes doubled, only when it has to be.
+    static void csv_field(std::string& out, std::string_view v) {
+        if (v.find_first_of(",\"\r\n") == std::string_view::npos) {
+            out += v;
+            return;
+        }
+        out += '"';
+        for (char c : v) {
+            if (c == '"') out += '"';
+            out += c;
+        }
+        out += '"';
+    }
+
+    // Shortest text that reads back as the same double.
+    static void csv_number(std::string& out, double v) {
+        char buf[32];
+        auto r = std::to_chars(buf, buf + sizeof(buf), v);
+        out.append(buf, r.ptr);
+    }
+
+    ExportThrottle& throttle;
+    PartitionReaders& readers;
+    const std::vector<common::Partition> parts;
+    const std::int64_t from_ms;
+    const std::int64_t to_ms;
+    const Format format;
+    const std::size_t page_rows;
+    const SatSelection sats;
+
+    std::optional<common::arrow::StreamWriter> arrow;
+    std::size_t part = 0;
+    std::uint64_t window_ms;  // ts span of a filtered page's query
+    std::int64_t after_ts = std::numeric_limits<std::int64_t>::min();
+    std::int64_t after_rowid = 0;
+    bool started = false;
+};
+
+static std::atomic<long long> g_sub_computed{0}, g_sub_skipped{0}, g_sub_events{0}, g_sub_rejected{0};
+static std::atomic<long long> g_sub_lag_ms_sum{0}, g_sub_lag_count{0};
+
+// One (sat_id, window_s, q) watched by /subscribe streams; shared by all of
+// them, so it is computed once however many streams watch it. The fields
+// after key are guarded by SubscriptionHub.
+struct Topic {
+    std::string sat_id;
+    int window_s = 0;
+    Quantiles quantiles;
+    std::string key;
+
+    std::string body;            // last published window_json() + tier
+    std::uint64_t version = 0;   // bumped whenever body changes
+    std::int64_t published_ms = 0;
+    std::int64_t watermark = 0;
+    std::int64_t computed_ms = 0;
+    std::size_t watchers = 0;
+};
+
+// Keeps every watched topic current. tick() recomputes a topic only when its
+// watermark shows new rows or refresh_ms has passed since it was last
+// computed (rows also leave a window by ageing out), and publishes a new
+// version only when the JSON actually changed. Streams block in wait().
+class SubscriptionHub {
+public:
+    SubscriptionHub(QuerySources& src, std::size_t max_streams, std::int64_t refresh_ms)
+        : src(src), max_streams(std::max<std::size_t>(1, max_streams)), refresh_ms(refresh_ms) {}
+
+    bool open_stream() {
+        std::lock_guard<std::mutex> lock(mu);
+        if (streams >= max_streams) return false;
+        streams++;
+        return true;
+    }
+
+    void close_stream() {
+        std::lock_guard<std::mutex> lock(mu);
+        streams--;
+    }
+
+    // The shared topics for `wanted`, computing the ones nobody watched yet.
+    std::vector<std::shared_ptr<Topic>> watch(std::vector<std::shared_ptr<Topic>> wanted, std::int64_t now) {
+        std::vector<std::shared_ptr<Topic>> fresh;
+        {
+            std::lock_guard<std::mutex> lock(mu);
+            for (auto& t : wanted) {
+                auto [it, inserted] = topics.try_emplace(t->key, t);
+                if (inserted) fresh.push_back(t);
+                t = it->second;
+                t->watchers++;
+            }
+        }
+        try {
+            for (auto& t : fresh) refresh(*t, now);
+        } catch (...) {
+            unwatch(wanted);
+            throw;
+        }
+        return wanted;
+    }
+
+    void unwatch(const std::vector<std::shared_ptr<Topic>>& watched) {
+        std::lock_guard<std::mutex> lock(mu);
+        for (auto& t : watched) {
+            if (--t->watchers == 0) topics.erase(t->key);
+        }
+    }
+
+    void tick(std::int64_t now) {
+        std::vector<std::shared_ptr<Topic>> due;
+        {
+            std::lock_guard<std::mutex> lock(mu);
+            for (auto& [key, t] : topics) due.push_back(t);
+        }
+        for (auto& t : due) {
+            try {
+                refresh(*t, now);
+            } catch (const std::exception& e) {
+                spdlog::warn("subscription refresh failed sat_id={}: {}", t->sat_id, e.what());
+            }
+        }
+    }
+
+    // Blocks until some topics[i] is past seen[i] or until `until`; true if one is.
+    bool wait(const std::vector<std::shared_ptr<Topic>>& watched, const std::vector<std::uint64_t>& seen,
+              std::chrono::steady_clock::time_point until) {
+        std::unique_lock<std::mutex> lock(mu);
+        return cv.wait_until(lock, until, [&] {
+            for (std::size_t i = 0; i < watched.size(); i++) {
+                if (watched[i]->version > seen[i]) return true;
+            }
+            return false;
+        });
+    }
+
+    // fn(body, published_ms) for every topic past seen, which moves up.
+    template <class F>
+    void collect(const std::vector<std::shared_ptr<Topic>>& watched, std::vector<std::uint64_t>& seen, F&& fn) {
+        std::lock_guard<std::mutex> lock(mu);
+        for (std::size_t i = 0; i < watched.size(); i++) {
+            if (watched[i]->version <= seen[i]) continue;
+            seen[i] = watched[i]->version;
+            fn(watched[i]->body, watched[i]->published_ms);
+        }
+    }
+
+    std::size_t stream_count() {
+        std::lock_guard<std::mutex> lock(mu);
+        return streams;
+    }
+
+    std::size_t topic_count() {
+        std::lock_guard<std::mutex> lock(mu);
+        return topics.size();
+    }
+
+private:
+    void refresh(Topic& t, std::int64_t now) {
+        std::int64_t from = now - (std::int64_t)t.window_s * 1000, to = std::numeric_limits<std::int64_t>::max();
+        std::int64_t wm = query_watermark(src, t.sat_id, from, to);
+        {
+            std::lock_guard<std::mutex> lock(mu);
+            if (t.version > 0 && wm == t.watermark && now - t.computed_ms < refresh_ms) {
+                g_sub_skipped++;
+                return;
+            }
+        }
+        json out = query_window(src, t.sat_id, t.window_s, from, to, now, false, t.quantiles);
+        out.erase("plan");
+        out.erase("rows_scanned");
+        std::string body = out.dump();
+        g_sub_computed++;
+
+        std::lock_guard<std::mutex> lock(mu);
+        t.watermark = wm;
+        t.computed_ms = now;
+        if (body == t.body) return;
+        t.body = std::move(body);
+        t.version++;
+        t.published_ms = now;
+        cv.notify_all();
+    }
+
+    QuerySources& src;
+    const std::size_t max_streams;
+    const std::int64_t refresh_ms;
+
+    std::mutex mu;
+    std::condition_variable cv;
+    std::unordered_map<std::string, std::shared_ptr<Topic>> topics;
+    std::size_t streams = 0;
+};
+
+// The body of one /subscribe response: an SSE "metrics" event per changed
+// topic, batched so a client gets at most one batch per interval, and a
+// comment line after `heartbeat` without one so a dead client is noticed.
+// Holds one hub stream slot for its lifetime.
+class SubscriptionStream {
+public:
+    SubscriptionStream(SubscriptionHub& hub, std::vector<std::shared_ptr<Topic>> topics,
+                       std::chrono::milliseconds interval, std::chrono::milliseconds heartbeat)
+        : hub(hub), topics(std::move(topics)), seen(this->topics.size(), 0), interval(interval),
+          heartbeat(heartbeat), opened_ms(now_ms()) {}
 
-static std::string prom_metrics() {
+    ~SubscriptionStream() {
+        hub.unwatch(topics);
+        hub.close_stream();
+    }
+
+    SubscriptionStream(const SubscriptionStream&) = delete;
+    SubscriptionStream& operator=(const SubscriptionStream&) = delete;
+
+    // Blocks until there is something to send and appends it to out.
+    void next(std::string& out) {
+        if (!hub.wait(topics, seen, last_write + heartbeat)) {
+            out += ": keepalive\n\n";
+            last_write = std::chrono::steady_clock::now();
+            return;
+        }
+        // Let further changes pile up until the interval is over.
+        std::this_thread::sleep_until(next_send);
+        std::int64_t now = now_ms();
+        hub.collect(topics, seen, [&](const std::string& body, std::int64_t published_ms) {
+            out += "event: metrics\ndata: ";
+            out += body;
+            out += "\n\n";
+            g_sub_events++;
+            // Time from publication (or from subscribing, for the initial
+            // state) to hand-off, interval coalescing included.
+            g_sub_lag_ms_sum += now - std::max(published_ms, opened_ms);
+            g_sub_lag_count++;
+        });
+        last_write = std::chrono::steady_clock::now();
+        next_send = last_write + interval;
+    }
+
+private:
+    SubscriptionHub& hub;
+    const std::vector<std::shared_ptr<Topic>> topics;
+    std::vector<std::uint64_t> seen;
+    const std::chrono::milliseconds interval;
+    const std::chrono::milliseconds heartbeat;
+    const std::int64_t opened_ms;
+    std::chrono::steady_clock::time_point last_write = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point next_send = std::chrono::steady_clock::now();
+};
+
+static std::atomic<long long> g_health{0}, g_ready{0}, g_prom{0}, g_query{0}, g_fleet{0}, g_series{0}, g_export{0};
+static std::atomic<long long> g_subscribe{0};
+static std::atomic<long long> g_fleet_satellites{0};
+static std::atomic<long long> g_series_buckets_raw{0}, g_series_buckets_1m{0}, g_series_buckets_1h{0};
+
+static std::string prom_metrics(PartitionReaders& db, LiveStore* live, ResponseCache* cache, ExportThrottle& exports,
+                                SubscriptionHub& hub) {
     std::ostringstream out;
+    if (cache) {
+        long long hits = g_cache_hits.load() + g_cache_coalesced.load();
+        long long total = hits + g_cache_misses.load();
+        out << "# TYPE response_cache_requests_total counter\n";
+        out << "response_cache_requests_total{result=\"hit\"} " << g_cache_hits.load() << "\n";
+        out << "response_cache_requests_total{result=\"coalesced\"} " << g_cache_coalesced.load() << "\n";
+        out << "response_cache_requests_total{result=\"miss\"} " << g_cache_misses.load() << "\n";
+        out << "# TYPE response_cache_hit_ratio gauge\n";
+        out << "response_cache_hit_ratio " << (total > 0 ? (double)hits / (double)total : 0.0) << "\n";
+        out << "# TYPE response_cache_entries gauge\n";
+        out << "response_cache_entries " << cache->entry_count() << "\n";
+        out << "# TYPE response_cache_bytes gauge\n";
+        out << "response_cache_bytes " << cache->bytes() << "\n";
+        out << "# TYPE response_cache_evictions_total counter\n";
+        out << "response_cache_evictions_total " << g_cache_evictions.load() << "\n";
+    }
+    if (live) {
+        out << "# TYPE live_store_memory_bytes gauge\n";
+        out << "live_store_memory_bytes " << live->memory_bytes() << "\n";
+        out << "# TYPE live_store_satellites gauge\n";
+        out << "live_store_satellites " << live->satellites() << "\n";
+        out << "# TYPE live_store_cutoff_age_ms gauge\n";
+        out << "live_store_cutoff_age_ms " << now_ms() - live->cutoff() << "\n";
+        out << "# TYPE live_store_tail_lag_ms gauge\n";
+        out << "live_store_tail_lag_ms " << live->lag_ms(now_ms()) << "\n";
+        out << "# TYPE live_store_rows_tailed_total counter\n";
+        out << "live_store_rows_tailed_total " << g_live_rows_tailed.load() << "\n";
+        out << "# TYPE live_store_rows_evicted_total counter\n";
+        out << "live_store_rows_evicted_total " << g_live_rows_evicted.load() << "\n";
+        out << "# TYPE live_store_queries_total counter\n";
+        out << "live_store_queries_total{result=\"hit\"} " << g_live_hits.load() << "\n";
+        out << "live_store_queries_total{result=\"miss\"} " << g_live_misses.load() << "\n";
+    }
+    out << "# TYPE telemetry_partitions_open gauge\n";
+    out << "telemetry_partitions_open{service=\"aggregator\"} " << db.open_count() << "\n";
+    out << "# TYPE telemetry_partitions_scanned_total counter\n";
+    out << "telemetry_partitions_scanned_total " << g_partitions_scanned.load() << "\n";
     out << "# TYPE http_requests_total counter\n";
     out << "http_requests_total{service=\"aggregator\",route=\"/health\"} " << g_health.load() << "\n";
     out << "http_requests_total{service=\"aggregator\",route=\"/ready\"} " << g_ready.load() << "\n";
     out << "http_requests_total{service=\"aggregator\",route=\"/prom\"} " << g_prom.load() << "\n";
     out << "http_requests_total{service=\"aggregator\",route=\"/metrics\"} " << g_query.load() << "\n";
+    out << "http_requests_total{service=\"aggregator\",route=\"/metrics/fleet\"} " << g_fleet.load() << "\n";
+    out << "http_requests_total{service=\"aggregator\",route=\"/series\"} " << g_series.load() << "\n";
+    out << "http_requests_total{service=\"aggregator\",route=\"/export\"} " << g_export.load() << "\n";
+    out << "http_requests_total{service=\"aggregator\",route=\"/subscribe\"} " << g_subscribe.load() << "\n";
+    out << "# TYPE subscriptions_active gauge\n";
+    out << "subscriptions_active " << hub.stream_count() << "\n";
+    out << "# TYPE subscription_topics gauge\n";
+    out << "subscription_topics " << hub.topic_count() << "\n";
+    out << "# TYPE subscriptions_rejected_total counter\n";
+    out << "subscriptions_rejected_total " << g_sub_rejected.load() << "\n";
+    out << "# TYPE subscription_refreshes_total counter\n";
+    out << "subscription_refreshes_total{result=\"computed\"} " << g_sub_computed.load() << "\n";
+    out << "subscription_refreshes_total{result=\"unchanged\"} " << g_sub_skipped.load() << "\n";
+    out << "# TYPE subscription_events_total counter\n";
+    out << "subscription_events_total " << g_sub_events.load() << "\n";
+    out << "# TYPE subscription_fanout_lag_ms summary\n";
+    out << "subscription_fanout_lag_ms_sum " << g_sub_lag_ms_sum.load() << "\n";
+    out << "subscription_fanout_lag_ms_count " << g_sub_lag_count.load() << "\n";
+    out << "# TYPE exports_active gauge\n";
+    out << "exports_active " << exports.running() << "\n";
+    out << "# TYPE exports_rejected_total counter\n";
+    out << "exports_rejected_total " << g_export_rejected.load() << "\n";
+    out << "# TYPE export_rows_total counter\n";
+    out << "export_rows_total " << g_export_rows.load() << "\n";
+    out << "# TYPE export_bytes_total counter\n";
+    out << "export_bytes_total " << g_export_bytes.load() << "\n";
+    out << "# TYPE series_buckets_total counter\n";
+    out << "series_buckets_total{source=\"raw\"} " << g_series_buckets_raw.load() << "\n";
+    out << "series_buckets_total{source=\"rollup_1m\"} " << g_series_buckets_1m.load() << "\n";
+    out << "series_buckets_total{source=\"rollup_1h\"} " << g_series_buckets_1h.load() << "\n";
+    out << "# TYPE metrics_rows_scanned_total counter\n";
+    out << "metrics_rows_scanned_total{tier=\"raw\"} " << g_plan_rows_raw.load() << "\n";
+    out << "metrics_rows_scanned_total{tier=\"rollup_1m\"} " << g_plan_rows_1m.load() << "\n";
+    out << "metrics_rows_scanned_total{tier=\"rollup_1h\"} " << g_plan_rows_1h.load() << "\n";
+    out << "# TYPE fleet_satellites_returned_total counter\n";
+    out << "fleet_satellites_returned_total " << g_fleet_satellites.load() << "\n";
+    out << common::logging_prom("aggregator");
     return out.str();
 }
 
 int main(int argc, char** argv) {
+    common::init_async_logging("aggregator");
     try {
         int port = (argc > 1) ? std::atoi(argv[1]) : 8082;
         std::string db_path = (argc > 2) ? argv[2] : std::string("data/telemetry.db");
 
-        SqliteRO db(db_path);
+        // Partitioned, a reader is kept per file with a connection per thread
+        // that reads it: AGG_PARTITION_MAX_OPEN and AGG_PARTITION_IDLE_S bound
+        // them, and the directory is listed at most every
+        // AGG_PARTITION_LIST_MS.
+        PartitionReaders db(common::PartitionScheme::from_env(db_path), common::StoragePragmas::from_env(),
+                            std::chrono::milliseconds(common::env_int("AGG_PARTITION_LIST_MS", 1000)),
+                            std::chrono::seconds(common::env_int("AGG_PARTITION_IDLE_S", 300)),
+                            (std::size_t)common::env_int("AGG_PARTITION_MAX_OPEN", 32));
+
+        // LIVE_STORE_ENABLED=0 sends every query to SQLite.
+        std::unique_ptr<LiveStore> live;
+        std::unique_ptr<common::PeriodicTask> live_tail;
+        if (common::env_int("LIVE_STORE_ENABLED", 1) != 0) {
+            live = std::make_unique<LiveStore>(db,
+                                               std::chrono::seconds(common::env_int("LIVE_STORE_WINDOW_S", 3600)),
+                                               (std::size_t)common::env_int("LIVE_STORE_MB", 64) << 20,
+                                               (std::size_t)common::env_int("LIVE_STORE_TAIL_CHUNK", 10000));
+            live_tail = std::make_unique<common::PeriodicTask>(
+                "live store tail",
+                std::chrono::milliseconds(common::env_int("LIVE_STORE_TAIL_MS", 250)),
+                [&live] { live->tick(now_ms()); });
+        }
+
         httplib::Server svr;
 
         svr.Get("/health", [](const httplib::Request&, httplib::Response& res) {
@@ -123,71 +1627,494 @@ int main(int argc, char** argv) {
             res.set_content(R"({"ok":true})", "application/json");
         });
 
-        svr.Get("/prom", [](const httplib::Request&, httplib::Response& res) {
+        // AGG_CACHE_MB=0 recomputes every /metrics request.
+        std::unique_ptr<ResponseCache> cache;
+        if (common::env_int("AGG_CACHE_MB", 16) > 0) {
+            cache = std::make_unique<ResponseCache>((std::size_t)common::env_int("AGG_CACHE_MB", 16) << 20,
+                                                    common::env_int("AGG_CACHE_BUCKET_MS", 1000));
+        }
+
+        // At most EXPORT_MAX_ACTIVE concurrent /export streams, reading at most
+        // EXPORT_ROWS_PER_S rows a second between them (0 = unpaced).
+        std::size_t max_exports = (std::size_t)common::env_int("EXPORT_MAX_ACTIVE", 2);
+        ExportThrottle exports(max_exports, common::env_double("EXPORT_ROWS_PER_S", 200000));
+
+        // Windows of up to AGG_EXACT_QUANTILE_ROWS rows get exact percentiles;
+        // larger ones a 1%-relative-error sketch built in the same pass.
+        std::size_t exact_limit = (std::size_t)common::env_int("AGG_EXACT_QUANTILE_ROWS", 10000);
+
+        RollupReader rollups(db.layout(), common::StoragePragmas::from_env());
+        QuerySources src{db, live.get(), rollups, exact_limit,
+                         (std::int64_t)common::env_int("AGG_PLANNER_RAW_MAX_S", 900) * 1000};
+
+        // At most SUBSCRIBE_MAX_STREAMS open /subscribe streams. Watched
+        // windows are re-checked every SUBSCRIBE_TICK_MS and recomputed when
+        // they have new rows or SUBSCRIBE_REFRESH_MS after the last time.
+        std::size_t max_streams = (std::size_t)common::env_int("SUBSCRIBE_MAX_STREAMS", 64);
+        SubscriptionHub hub(src, max_streams, common::env_int("SUBSCRIBE_REFRESH_MS", 5000));
+        common::PeriodicTask hub_tick("subscriptions", std::chrono::milliseconds(common::env_int("SUBSCRIBE_TICK_MS", 250)),
+                                      [&hub] { hub.tick(now_ms()); });
+
+        svr.Get("/prom", [&db, &live, &cache, &exports, &hub](const httplib::Request&, httplib::Response& res) {
             g_prom++;
-            res.set_content(prom_metrics(), "text/plain; version=0.0.4");
+            res.set_content(prom_metrics(db, live.get(), cache.get(), exports, hub), "text/plain; version=0.0.4");
         });
 
-        svr.Get("/metrics", [&db](const httplib::Request& req, httplib::Response& res) {
+        // One satellite over the last window_s seconds (default 600), or over
+        // [from_ms, to_ms) in epoch ms: from_ms alone runs to the request time,
+        // to_ms alone starts window_s before it. precision=exact reads raw rows
+        // only; otherwise see plan_range(). The response names the tier used
+        // ("mixed" for more than one) and the rows read per plan segment.
+
+        svr.Get("/metrics", [&src, &cache](const httplib::Request& req, httplib::Response& res) {
             g_query++;
-            if (!req.has_param("sat_id")) {
+            auto bad_request = [&res](const std::string& err) {
                 res.status = 400;
-                res.set_content(R"({"ok":false,"error":"missing sat_id"})", "application/json");
-                return;
-            }
+                res.set_content(json{{"ok",false},{"error",err}}.dump(), "application/json");
+            };
+            if (!req.has_param("sat_id")) return bad_request("missing sat_id");
             std::string sat_id = req.get_param_value("sat_id");
             int window_s = 600;
             if (req.has_param("window_s")) window_s = std::max(1, std::atoi(req.get_param_value("window_s").c_str()));
 
-            std::int64_t now_ms = static_cast<std::int64_t>(
-                std::chrono::duration_cast<std::chrono::milliseconds>(
-                    std::chrono::system_clock::now().time_since_epoch()
-                ).count()
-            );
-            std::int64_t min_ts = now_ms - static_cast<std::int64_t>(window_s) * 1000;
+            std::int64_t now = now_ms();
+            bool absolute = req.has_param("from_ms") || req.has_param("to_ms");
+            std::int64_t to = absolute ? now : std::numeric_limits<std::int64_t>::max();
+            std::string err;
+            if (!epoch_param(req, "to_ms", to, err)) return bad_request(err);
+            std::int64_t from = (absolute ? to : now) - static_cast<std::int64_t>(window_s) * 1000;
+            if (!epoch_param(req, "from_ms", from, err)) return bad_request(err);
+            if (from >= to) return bad_request("from_ms must be before to_ms");
+
+            std::string precision = req.has_param("precision") ? req.get_param_value("precision") : "auto";
+            if (precision != "auto" && precision != "exact") {
+                return bad_request("invalid precision '" + precision + "': expected auto or exact");
+            }
+
+            Quantiles quantiles;
+            if (req.has_param("q") && !parse_quantiles(req.get_param_value("q"), quantiles, err)) return bad_request(err);
+
+            auto compute = [&] {
+                json out = query_window(src, sat_id, window_s, from, to, now, precision == "exact", quantiles);
+                if (absolute) {
+                    out.erase("window_s");
+                    out["from_ms"] = from;
+                    out["to_ms"] = to;
+                }
+                out["ok"] = true;
+                return out.dump();
+            };
+
+            try {
+                if (!cache) {
+                    res.set_content(compute(), "application/json");
+                    return;
+                }
+                // Read before computing, so rows that land meanwhile bump it
+                // for the next request.
+                std::int64_t wm = query_watermark(src, sat_id, from, to);
+                std::string range = absolute ? std::to_string(from) + ':' + std::to_string(to) : std::to_string(window_s);
+                std::string key = sat_id + '\n' + range + '\n' + precision + '\n' + req.get_param_value("q");
+                res.set_content(cache->get(key, wm, now, compute), "application/json");
+            } catch (const std::exception& e) {
+                spdlog::error("metrics query failed sat_id={}: {}", sat_id, e.what());
+                res.status = 500;
+                res.set_content(json{{"ok",false},{"error",e.what()}}.dump(), "application/json");
+            }
+        });
+
+        // One grouped pass for many satellites: sat_id=a,b (repeatable) and/or
+        // prefix=..., or the whole fleet when neither is given. Satellites
+        // listed by id are always reported; others only if they have rows in
+        // the window. The body is chunked: a JSON document by default,
+        // format=ndjson (or Accept: application/x-ndjson) for one object per
+        // line.
+        svr.Get("/metrics/fleet", [&db, &live, exact_limit](const httplib::Request& req, httplib::Response& res) {
+            g_fleet++;
+            int window_s = 600;
+            if (req.has_param("window_s")) window_s = std::max(1, std::atoi(req.get_param_value("window_s").c_str()));
+            std::int64_t min_ts = now_ms() - static_cast<std::int64_t>(window_s) * 1000;
+
+            Quantiles quantiles;
+            std::string err;
+            if (req.has_param("q") && !parse_quantiles(req.get_param_value("q"), quantiles, err)) {
+                res.status = 400;
+                res.set_content(json{{"ok",false},{"error",err}}.dump(), "application/json");
+                return;
+            }
+
+            std::vector<std::string> ids = sat_id_params(req);
+            std::string prefix = req.get_param_value("prefix");
+            bool by_prefix = req.has_param("prefix");
+            bool everyone = ids.empty() && !by_prefix;
+            bool ndjson = req.get_param_value("format") == "ndjson" ||
+                          req.get_header_value("Accept").find("application/x-ndjson") != std::string::npos;
+
+            struct Body {
+                std::map<std::string, common::WindowStats, std::less<>> groups;
+                std::map<std::string, common::WindowStats, std::less<>>::iterator next;
+                bool started = false;
+            };
+            auto body = std::make_shared<Body>();
+            auto& groups = body->groups;
+
+            auto reset = [&] {
+                groups.clear();
+                for (auto& id : ids) groups.try_emplace(id, exact_limit);
+            };
+            auto group = [&](std::string_view id) -> common::WindowStats* {
+                auto it = groups.find(id);
+                if (it != groups.end()) return &it->second;
+                if (!everyone && !(by_prefix && id.starts_with(prefix))) return nullptr;
+                return &groups.try_emplace(std::string(id), exact_limit).first->second;
+            };
 
             try {
-                auto rows = db.select_rows(sat_id, min_ts);
-
-                long long sum_dropped = 0;
-                long long sum_sent = 0;
-                double sum_lq = 0.0;
-                std::vector<double> lat;
-                lat.reserve(rows.size());
-
-                for (auto& r : rows) {
-                    sum_dropped += r.dropped;
-                    sum_sent += r.sent;
-                    sum_lq += r.link_quality;
-                    lat.push_back(r.latency_ms);
-                }
-
-                double drop_rate = (sum_sent > 0) ? (double)sum_dropped / (double)sum_sent : 0.0;
-                double avg_lq = (!rows.empty()) ? sum_lq / (double)rows.size() : 0.0;
-
-                json out = {
-                    {"ok", true},
-                    {"sat_id", sat_id},
-                    {"window_s", window_s},
-                    {"count", (int)rows.size()},
-                    {"drop_rate", drop_rate},
-                    {"latency_p50_ms", percentile(lat, 50.0)},
-                    {"latency_p95_ms", percentile(lat, 95.0)},
-                    {"avg_link_quality", avg_lq}
-                };
-
-                res.set_content(out.dump(), "application/json");
+                reset();
+                if (live && live->scan_fleet(min_ts, group)) {
+                    g_live_hits++;
+                } else {
+                    if (live) g_live_misses++;
+                    reset();
+                    db.scan_fleet(min_ts, group);
+                }
             } catch (const std::exception& e) {
+                spdlog::error("fleet metrics query failed: {}", e.what());
                 res.status = 500;
                 res.set_content(json{{"ok",false},{"error",e.what()}}.dump(), "application/json");
+                return;
             }
+
+            for (auto it = groups.begin(); it != groups.end();) {
+                bool listed = std::find(ids.begin(), ids.end(), it->first) != ids.end();
+                it = (it->second.count > 0 || listed) ? std::next(it) : groups.erase(it);
+            }
+            g_fleet_satellites += (long long)groups.size();
+            body->next = groups.begin();
+
+            // Serializes a batch of satellites per call, so the response never
+            // exists as one string.
+            res.set_chunked_content_provider(ndjson ? "application/x-ndjson" : "application/json",
+                [body, ndjson, window_s, quantiles](std::size_t, httplib::DataSink& sink) {
+                    std::string chunk;
+                    if (!body->started && !ndjson) {
+                        chunk = "{\"ok\":true,\"window_s\":" + std::to_string(window_s) + ",\"satellites\":[";
+                    }
+                    for (int n = 0; n < 256 && body->next != body->groups.end(); n++, ++body->next) {
+                        if (!ndjson && (body->started || n > 0)) chunk += ',';
+                        chunk += window_json(body->next->first, window_s, body->next->second, quantiles).dump();
+                        if (ndjson) chunk += '\n';
+                    }
+                    body->started = true;
+                    bool last = body->next == body->groups.end();
+                    if (last && !ndjson) chunk += "]}";
+                    if (!chunk.empty() && !sink.write(chunk.data(), chunk.size())) return false;
+                    if (last) sink.done();
+                    return true;
+                });
         });
 
-        spdlog::info("aggregator listening on {} db={}", port, db_path);
+        // Bucketed series for one satellite over [from, to) (epoch ms; default
+        // the last hour) in buckets of step ms (default 60000) aligned to
+        // multiples of step. Buckets that a rollup tier whose width divides
+        // step holds completely come from it, coarsest tier first; the rest
+        // from the live store or one ordered index scan per partition. At
+        // most SERIES_MAX_BUCKETS buckets per request.
+        std::int64_t max_buckets = std::max<long long>(1, common::env_int("SERIES_MAX_BUCKETS", 1440));
+
+        svr.Get("/series", [&db, &live, &rollups, exact_limit, max_buckets](const httplib::Request& req,
+                                                                           httplib::Response& res) {
+            g_series++;
+            auto bad_request = [&res](const std::string& err) {
+                res.status = 400;
+                res.set_content(json{{"ok",false},{"error",err}}.dump(), "application/json");
+            };
+            if (!req.has_param("sat_id")) return bad_request("missing sat_id");
+            std::string sat_id = req.get_param_value("sat_id");
+
+            std::int64_t to = now_ms(), from = 0, step = 60000;
+            std::string err;
+            if (!int_param(req, "to", to, err)) return bad_request(err);
+            from = to < std::numeric_limits<std::int64_t>::min() + 3600LL * 1000 ? std::numeric_limits<std::int64_t>::min()
+                                                                                   : to - 3600LL * 1000;
+            if (!int_param(req, "from", from, err) || !int_param(req, "step", step, err)) return bad_request(err);
+            if (step <= 0) return bad_request("step must be positive");
+            if (from >= to) return bad_request("from must be before to");
+
+            // In 128 bits: a large step or a wide range takes the aligned
+            // bounds and the bucket count past int64.
+            __int128 start128 = (__int128)from - (((__int128)from % step) + step) % step;
+            __int128 n128 = ((__int128)to - start128 + step - 1) / step;
+            if (n128 > max_buckets) {
+                auto shown = (std::int64_t)std::min<__int128>(n128, std::numeric_limits<std::int64_t>::max());
+                return bad_request("too many buckets (" + std::to_string(shown) + " > " + std::to_string(max_buckets) +
+                                   "); use a larger step or a shorter range");
+            }
+            // Bucket offsets are computed as ts - start (+ step), so the whole
+            // span plus one step has to fit as well.
+            if (start128 < std::numeric_limits<std::int64_t>::min() ||
+                (n128 + 1) * step > std::numeric_limits<std::int64_t>::max() ||
+                start128 + (n128 + 1) * step > std::numeric_limits<std::int64_t>::max()) {
+                return bad_request("from, to and step do not fit in epoch milliseconds");
+            }
+            std::int64_t start = (std::int64_t)start128, n = (std::int64_t)n128;
+
+            Quantiles quantiles;
+            if (req.has_param("q") && !parse_quantiles(req.get_param_value("q"), quantiles, err)) return bad_request(err);
+
+            std::int64_t end = start + n * step;
+            try {
+                std::vector<common::WindowStats> buckets((std::size_t)n, common::WindowStats(exact_limit));
+                std::vector<const char*> source((std::size_t)n, nullptr);
+                for (auto tier : {common::RollupTier::Hour, common::RollupTier::Minute}) {
+                    std::int64_t width = common::tier_width_ms(tier);
+                    if (step % width != 0) continue;
+                    auto [first, last] = rollups.coverage(tier, db, start, end);
+                    // Whole buckets inside the tier's coverage not already filled.
+                    std::int64_t i = (first - start + step - 1) / step, j = (last - start) / step;
+                    if (first >= last || i >= j) continue;
+                    rollups.scan(tier, sat_id, start + i * step, start + j * step,
+                                 [&](std::int64_t bucket_ms, const common::RollupAgg& a) {
+                                     auto k = (std::size_t)((bucket_ms - start) / step);
+                                     if (source[k]) return;
+                                     buckets[k].merge(a.count, a.sum_dropped, a.sum_sent, a.sum_link_quality, a.latency);
+                                 });
+                    for (std::int64_t k = i; k < j; k++) {
+                        if (!source[k]) source[k] = common::tier_table(tier);
+                    }
+                }
+
+                // The rest, one run of consecutive raw buckets at a time.
+                for (std::int64_t i = 0; i < n;) {
+                    if (source[i]) {
+                        i++;
+                        continue;
+                    }
+                    std::int64_t j = i;
+                    while (j < n && !source[j]) source[j++] = "raw";
+                    std::int64_t run_from = start + i * step;
+                    if (live && live->scan_buckets(sat_id, run_from, step, (std::int32_t)(j - i), &buckets[i])) {
+                        g_live_hits++;
+                    } else {
+                        if (live) g_live_misses++;
+                        db.scan_range(sat_id, run_from, start + j * step,
+                                      [&](std::int64_t ts, double lat, int dropped, int sent, double lq) {
+                                          buckets[(std::size_t)((ts - start) / step)].add(lat, dropped, sent, lq);
+                                      });
+                    }
+                    i = j;
+                }
+
+                json rows = json::array();
+                for (std::int64_t k = 0; k < n; k++) {
+                    auto& b = buckets[k];
+                    json row = {
+                        {"ts_ms", start + k * step},
+                        {"count", b.count},
+                        {"drop_rate", b.drop_rate()},
+                        {"avg_link_quality", b.avg_link_quality()},
+                        {"latency_p50_ms", b.latency.quantile(0.50)},
+                        {"latency_p95_ms", b.latency.quantile(0.95)},
+                        {"source", source[k]}
+                    };
+                    if (!quantiles.empty()) {
+                        json q = json::object();
+                        for (auto& [label, frac] : quantiles) q[label] = b.latency.quantile(frac);
+                        row["latency_quantiles_ms"] = std::move(q);
+                    }
+                    rows.push_back(std::move(row));
+                    std::string_view src = source[k];
+                    (src == "raw" ? g_series_buckets_raw : src == "rollup_1m" ? g_series_buckets_1m : g_series_buckets_1h)++;
+                }
+                res.set_content(json{{"ok", true}, {"sat_id", sat_id}, {"from", from}, {"to", to}, {"step", step},
+                                     {"buckets", std::move(rows)}}.dump(),
+                                "application/json");
+            } catch (const std::exception& e) {
+                spdlog::error("series query failed sat_id={}: {}", sat_id, e.what());
+                res.status = 500;
+                res.set_content(json{{"ok",false},{"error",e.what()}}.dump(), "application/json");
+            }
+        });
+
+        // Raw rows over [from_ms, to_ms) (to_ms defaults to now) for sat_id=a,b
+        // (repeatable) and/or prefix=..., or every satellite, streamed in
+        // (ts_ms, rowid) order as format=ndjson (default), csv or arrow (the
+        // Arrow IPC stream format). Gzipped when the client accepts it and
+        // httplib was built with zlib; httplib compresses text/csv itself.
+        // event_id comes back exactly as it was ingested.
+        std::size_t export_page_rows = (std::size_t)common::env_int("EXPORT_PAGE_ROWS", 5000);
+
+        svr.Get("/export", [&db, &exports, export_page_rows](const httplib::Request& req, httplib::Response& res) {
+            g_export++;
+            auto bad_request = [&res](const std::string& err) {
+                res.status = 400;
+                res.set_content(json{{"ok",false},{"error",err}}.dump(), "application/json");
+            };
+            if (!req.has_param("from_ms")) return bad_request("missing from_ms");
+            std::int64_t from = 0, to = now_ms();
+            std::string err;
+            if (!int_param(req, "from_ms", from, err) || !int_param(req, "to_ms", to, err)) return bad_request(err);
+            if (from >= to) return bad_request("from_ms must be before to_ms");
+
+            std::string format = req.has_param("format") ? req.get_param_value("format") : "ndjson";
+            ExportStream::Format fmt = ExportStream::Format::Ndjson;
+            const char* content_type = "application/x-ndjson";
+            if (format == "csv") {
+                fmt = ExportStream::Format::Csv;
+                content_type = "text/csv";
+            } else if (format == "arrow") {
+                fmt = ExportStream::Format::Arrow;
+                content_type = "application/vnd.apache.arrow.stream";
+            } else if (format != "ndjson") {
+                return bad_request("invalid format '" + format + "': expected ndjson, csv or arrow");
+            }
+            std::optional<std::string> prefix;
+            if (req.has_param("prefix")) prefix = req.get_param_value("prefix");
+
+            std::shared_ptr<ExportStream> stream;
+            try {
+                auto parts = db.overlapping(from, to);
+                if (!exports.try_acquire()) {
+                    g_export_rejected++;
+                    res.status = 503;
+                    res.set_header("Retry-After", "5");
+                    res.set_content(R"({"ok":false,"error":"too many exports running"})", "application/json");
+                    return;
+                }
+                stream = std::make_shared<ExportStream>(exports, db, std::move(parts), from, to, fmt,
+                                                        export_page_rows, sat_id_params(req), std::move(prefix));
+            } catch (const std::exception& e) {
+                spdlog::error("export failed: {}", e.what());
+                res.status = 500;
+                res.set_content(json{{"ok",false},{"error",e.what()}}.dump(), "application/json");
+                return;
+            }
+#ifdef CPPHTTPLIB_ZLIB_SUPPORT
+            if (fmt != ExportStream::Format::Csv &&
+                req.get_header_value("Accept-Encoding").find("gzip") != std::string::npos) {
+                stream->gzip = std::make_unique<common::GzipStream>();
+                res.set_header("Content-Encoding", "gzip");
+            }
+#endif
+
+            // A failure part-way through can only cut the response short.
+            res.set_chunked_content_provider(content_type, [stream](std::size_t, httplib::DataSink& sink) {
+                try {
+                    std::string chunk;
+                    bool more = stream->next(chunk);
+#ifdef CPPHTTPLIB_ZLIB_SUPPORT
+                    if (stream->gzip) {
+                        chunk = stream->gzip->write(chunk);
+                        if (!more) chunk += stream->gzip->finish();
+                    }
+#endif
+                    if (!chunk.empty()) {
+                        if (!sink.write(chunk.data(), chunk.size())) return false;
+                        g_export_bytes += (long long)chunk.size();
+                    }
+                    if (!more) sink.done();
+                    return true;
+                } catch (const std::exception& e) {
+                    spdlog::error("export failed mid-stream: {}", e.what());
+                    return false;
+                }
+            });
+        });
+
+        // Subscribers to the windows of sat_id=a,b (repeatable) over each of
+        // window_s=60,600 (default 600), as server-sent events: the current
+        // state on connect, then a "metrics" event whenever a window's figures
+        // change, at most one batch per interval_ms (default 1000, at least
+        // SUBSCRIBE_MIN_INTERVAL_MS).
+        std::int64_t min_interval_ms = common::env_int("SUBSCRIBE_MIN_INTERVAL_MS", 250);
+
+        svr.Get("/subscribe", [&hub, min_interval_ms](const httplib::Request& req, httplib::Response& res) {
+            g_subscribe++;
+            auto bad_request = [&res](const std::string& err) {
+                res.status = 400;
+                res.set_content(json{{"ok",false},{"error",err}}.dump(), "application/json");
+            };
+            std::vector<std::string> ids = sat_id_params(req);
+            if (ids.empty()) return bad_request("missing sat_id");
+
+            std::vector<int> windows;
+            std::string spec = req.has_param("window_s") ? req.get_param_value("window_s") : "600";
+            for (std::size_t pos = 0; pos <= spec.size();) {
+                std::size_t comma = std::min(spec.find(',', pos), spec.size());
+                std::string item = spec.substr(pos, comma - pos);
+                pos = comma + 1;
+                char* end = nullptr;
+                long v = std::strtol(item.c_str(), &end, 10);
+                if (item.empty() || *end != '\0' || v < 1 || v > 90L * 86400) {
+                    return bad_request("invalid window_s '" + item + "': expected seconds in [1, 7776000]");
+                }
+                windows.push_back((int)v);
+            }
+            if (ids.size() * windows.size() > 256) return bad_request("too many satellite windows (max 256)");
+
+            std::int64_t interval_ms = 1000;
+            std::string err;
+            if (!int_param(req, "interval_ms", interval_ms, err)) return bad_request(err);
+            interval_ms = std::max(interval_ms, min_interval_ms);
+
+            Quantiles quantiles;
+            std::string q = req.get_param_value("q");
+            if (req.has_param("q") && !parse_quantiles(q, quantiles, err)) return bad_request(err);
+
+            if (!hub.open_stream()) {
+                g_sub_rejected++;
+                res.status = 503;
+                res.set_header("Retry-After", "5");
+                res.set_content(R"({"ok":false,"error":"too many subscriptions"})", "application/json");
+                return;
+            }
+            std::shared_ptr<SubscriptionStream> stream;
+            try {
+                std::vector<std::shared_ptr<Topic>> wanted;
+                for (auto& id : ids) {
+                    for (int w : windows) {
+                        auto t = std::make_shared<Topic>();
+                        t->sat_id = id;
+                        t->window_s = w;
+                        t->quantiles = quantiles;
+                        t->key = id + '\n' + std::to_string(w) + '\n' + q;
+                        wanted.push_back(std::move(t));
+                    }
+                }
+                stream = std::make_shared<SubscriptionStream>(hub, hub.watch(std::move(wanted), now_ms()),
+                                                              std::chrono::milliseconds(interval_ms),
+                                                              std::chrono::seconds(15));
+            } catch (const std::exception& e) {
+                hub.close_stream();
+                spdlog::error("subscribe failed: {}", e.what());
+                res.status = 500;
+                res.set_content(json{{"ok",false},{"error",e.what()}}.dump(), "application/json");
+                return;
+            }
+
+            res.set_header("Cache-Control", "no-cache");
+            res.set_chunked_content_provider("text/event-stream", [stream](std::size_t, httplib::DataSink& sink) {
+                if (!sink.is_writable()) return false;
+                std::string chunk;
+                stream->next(chunk);
+                return sink.write(chunk.data(), chunk.size());
+            });
+        });
+
+        // Streams (/subscribe, /export) hold a worker thread each for as long
+        // as they run; size the pool so they never take the ones /metrics
+        // needs.
+        std::size_t workers = CPPHTTPLIB_THREAD_POOL_COUNT + max_streams + max_exports;
+        svr.new_task_queue = [workers] { return new httplib::ThreadPool(workers); };
+
+        spdlog::info("aggregator listening on {} db={} partition={}",
+                     port, db_path, common::env_str("TELEMETRY_PARTITION", "none"));
         svr.listen("0.0.0.0", port);
+        spdlog::shutdown();
         return 0;
     } catch (const std::exception& e) {
         spdlog::error("aggregator fatal: {}", e.what());
+        spdlog::shutdown();
         return 1;
     }
 }
\ No newline at end of file
@@ -2,103 +2,477 @@
 #include <nlohmann/json.hpp>
 #include <spdlog/spdlog.h>
 
+#include "common/alert_log.hpp"
+#include "common/alert_rules.hpp"
+#include "common/alert_state.hpp"
+#include "common/config.hpp"
+#include "common/logging.hpp"
+#include "common/periodic.hpp"
+
+#include <algorithm>
+#include <array>
 #include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <cstdint>
 #include <cstdlib>
+#include <deque>
+#include <functional>
+#include <iterator>
+#include <memory>
 #include <mutex>
+#include <optional>
+#include <queue>
+#include <random>
 #include <sstream>
 #include <string>
 #include <thread>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 using json = nlohmann::json;
 
-struct Thresholds {
+// What /config manages. The original threshold keys still work: they set the
+// numbers in the default rules, which apply until rules are configured.
+struct AlertConfig {
+    int window_s = 600;
     double latency_p95_ms = 200.0;
     double drop_rate = 0.05;
     double min_link_quality = 0.7;
-    int window_s = 600;
+    bool custom_rules = false;
+    std::shared_ptr<const common::RuleSet> rules;
+    bool want_p99 = false;        // some rule reads latency_p99_ms
+    std::string summary_json;     // the "config" object of /alerts
+    std::string thresholds_json;  // and its "thresholds", kept for existing readers
 };
 
-static json eval_alerts(const json& metrics, const Thresholds& t) {
-    json alerts = json::array();
+static json thresholds_json(const AlertConfig& c) {
+    return {
+        {"latency_p95_ms",c.latency_p95_ms},
+        {"drop_rate",c.drop_rate},
+        {"min_link_quality",c.min_link_quality},
+        {"window_s",c.window_s}
+    };
+}
+
+static json default_rules(const AlertConfig& c) {
+    auto num = [](double v) { return json(v).dump(); };
+    return json::array({
+        {{"name","LATENCY_P95"},{"severity","MED"},{"when","latency_p95_ms > " + num(c.latency_p95_ms) + " && count > 0"}},
+        {{"name","DROP_RATE"},{"severity","HIGH"},{"when","drop_rate > " + num(c.drop_rate) + " && count > 0"}},
+        {{"name","LINK_QUALITY"},{"severity","MED"},{"when","avg_link_quality < " + num(c.min_link_quality) + " && count > 0"}}
+    });
+}
+
+static common::AlertCounters g_alert_counters;
+
+// Compiles c's rules (the defaults unless custom_rules) into c.rules; throws
+// common::RuleError.
+static void compile_config(AlertConfig& c, const json& custom, const json& groups, std::uint64_t version) {
+    c.rules = common::RuleSet::compile(c.custom_rules ? custom : default_rules(c), groups, version, g_alert_counters);
+    c.want_p99 = c.rules->uses(common::Metric::LatencyP99);
+    c.summary_json = json{{"version", version}, {"window_s", c.window_s}}.dump();
+    c.thresholds_json = thresholds_json(c).dump();
+}
 
-    if (!metrics.contains("ok") || !metrics["ok"].is_boolean() || !metrics["ok"].get<bool>()) {
-        alerts.push_back({{"severity","HIGH"},{"type","AGGREGATOR_ERROR"},{"message","metrics not ok"}});
-        return alerts;
+static json config_json(const AlertConfig& c) {
+    return {
+        {"window_s", c.window_s},
+        {"version", c.rules->version()},
+        {"thresholds", thresholds_json(c)},
+        {"rules_source", c.custom_rules ? "custom" : "default"},
+        {"rules", c.rules->rules_json()},
+        {"groups", c.rules->groups_config()}
+    };
+}
+
+static std::atomic<long long> g_health{0}, g_ready{0}, g_config{0}, g_alerts{0}, g_prom{0}, g_watched{0};
+
+static std::atomic<long long> g_snapshot_publishes{0};
+static std::atomic<long long> g_alert_changes{0}, g_changes_waiters{0};
+static std::atomic<long long> g_alerts_all{0}, g_alerts_all_not_modified{0}, g_fleet_alerts_builds{0};
+
+static std::atomic<long long> g_poll_cycles{0};
+static std::atomic<long long> g_poll_failures{0};
+static std::atomic<long long> g_poll_overruns{0};
+static std::atomic<long long> g_poll_budget_delayed{0};
+static std::atomic<long long> g_poll_in_flight{0};
+static std::atomic<long long> g_poll_lag_ms_sum{0};
+
+// Per-satellite /metrics fetch latency, rendered as a Prometheus histogram.
+static constexpr long long kFetchBucketsMs[] = {5, 10, 25, 50, 100, 250, 500, 1000, 2500};
+static std::atomic<long long> g_fetch_buckets[std::size(kFetchBucketsMs) + 1];
+static std::atomic<long long> g_fetch_ms_sum{0}, g_fetch_count{0};
+
+static void observe_fetch_ms(long long ms) {
+    std::size_t i = 0;
+    while (i < std::size(kFetchBucketsMs) && ms > kFetchBucketsMs[i]) i++;
+    g_fetch_buckets[i]++;
+    g_fetch_ms_sum += ms;
+    g_fetch_count++;
+}
+
+enum class PollTier { Fast, Slow };
+static constexpr PollTier kPollTiers[] = {PollTier::Fast, PollTier::Slow};
+
+static const char* tier_name(PollTier t) { return t == PollTier::Fast ? "fast" : "slow"; }
+
+// Time between consecutive polls of the same satellite, by the tier it was due on.
+static std::atomic<long long> g_poll_interval_ms_sum[2], g_poll_interval_count[2];
+
+// Polls every watched satellite on its own schedule: alerting or unreachable
+// satellites on the fast tier, healthy ones on the slow tier. Next-due times
+// sit in a min-heap and each is jittered, so satellites added together drift
+// apart instead of hitting the aggregator in bursts; a token bucket caps
+// dispatches per second across the whole fleet. Fetches run on a fixed set of
+// workers, each holding its own keep-alive connection, so a slow satellite
+// only holds up its own worker.
+class PollScheduler {
+public:
+    struct Options {
+        std::chrono::milliseconds fast{1000}, slow{5000};
+        double jitter = 0.1;  // +/- fraction of the interval
+        double max_qps = 0;   // 0 = unlimited
+        int workers = 8;
+        int timeout_ms = 2000;
+    };
+
+    // Polls one satellite; returns the tier to poll it at next.
+    using Fetch = std::function<PollTier(httplib::Client&, const std::string& sat_id)>;
+
+    struct TierStats {
+        std::size_t satellites = 0;
+        std::size_t due = 0;  // due but waiting for a worker or the budget
+    };
+
+    PollScheduler(const std::string& host, int port, Options opt, Fetch fetch)
+        : opt(opt), fetch(std::move(fetch)), tokens(std::max(1.0, opt.max_qps)), rng(std::random_device{}()) {
+        for (int i = 0; i < std::max(1, opt.workers); i++) {
+            auto c = std::make_unique<httplib::Client>(host, port);
+            c->set_keep_alive(true);
+            c->set_connection_timeout(opt.timeout_ms / 1000, (opt.timeout_ms % 1000) * 1000);
+            c->set_read_timeout(opt.timeout_ms / 1000, (opt.timeout_ms % 1000) * 1000);
+            c->set_write_timeout(opt.timeout_ms / 1000, (opt.timeout_ms % 1000) * 1000);
+            clients.push_back(std::move(c));
+        }
+        for (auto& c : clients) threads.emplace_back([this, client = c.get()] { work(*client); });
+        threads.emplace_back([this] { dispatch(); });
     }
 
-    int count = metrics.value("count", 0);
-    if (count == 0) {
-        return alerts;
+    ~PollScheduler() {
+        {
+            std::lock_guard<std::mutex> lock(mu);
+            stop = true;
+        }
+        work_cv.notify_all();
+        dispatch_cv.notify_all();
+        for (auto& t : threads) t.join();
     }
 
-    double p95 = metrics.value("latency_p95_ms", 0.0);
-    double dr  = metrics.value("drop_rate", 0.0);
-    double lq  = metrics.value("avg_link_quality", 0.0);
+    PollScheduler(const PollScheduler&) = delete;
+    PollScheduler& operator=(const PollScheduler&) = delete;
+
+    // Satellites no longer listed are dropped (a poll in flight finishes but is
+    // not rescheduled); new ones start on the slow tier with their first poll
+    // spread over one fast interval.
+    void set_watched(const std::vector<std::string>& ids) {
+        std::lock_guard<std::mutex> lock(mu);
+        std::unordered_map<std::string, Sat> next;
+        auto now = Clock::now();
+        for (const auto& id : ids) {
+            if (next.count(id)) continue;
+            auto it = sats.find(id);
+            if (it != sats.end()) {
+                next.emplace(id, it->second);
+                continue;
+            }
+            Sat& s = next.emplace(id, Sat{}).first->second;
+            s.gen = ++last_gen;
+            std::uniform_int_distribution<long long> spread(0, opt.fast.count());
+            schedule(id, s, now + std::chrono::milliseconds(spread(rng)));
+        }
+        sats = std::move(next);
+        dispatch_cv.notify_one();
+    }
 
-    if (p95 > t.latency_p95_ms) {
-        alerts.push_back({{"severity","MED"},{"type","LATENCY_P95"},{"value",p95},{"threshold",t.latency_p95_ms}});
+    std::array<TierStats, 2> tier_stats() {
+        std::array<TierStats, 2> out{};
+        std::lock_guard<std::mutex> lock(mu);
+        auto now = Clock::now();
+        for (auto& [id, s] : sats) {
+            TierStats& t = out[(int)s.tier];
+            t.satellites++;
+            if (!s.in_flight && s.due <= now) t.due++;
+        }
+        return out;
     }
-    if (dr > t.drop_rate) {
-        alerts.push_back({{"severity","HIGH"},{"type","DROP_RATE"},{"value",dr},{"threshold",t.drop_rate}});
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Sat {
+        PollTier tier = PollTier::Slow;
+        std::uint64_t gen = 0;  // tells a re-added satellite from its stale heap entries
+        Clock::time_point due;
+        std::optional<Clock::time_point> last_dispatch;
+        bool in_flight = false;
+    };
+
+    struct Due {
+        Clock::time_point at;
+        std::uint64_t gen;
+        std::string sat_id;
+
+        bool operator>(const Due& o) const { return at > o.at; }
+    };
+
+    struct Job {
+        std::string sat_id;
+        std::uint64_t gen;
+        Clock::time_point dispatched;
+    };
+
+    std::chrono::milliseconds interval(PollTier t) const { return t == PollTier::Fast ? opt.fast : opt.slow; }
+
+    std::chrono::milliseconds jittered(PollTier t) {
+        std::uniform_real_distribution<double> j(-opt.jitter, opt.jitter);
+        return std::chrono::milliseconds((long long)((double)interval(t).count() * (1.0 + j(rng))));
     }
-    if (lq < t.min_link_quality) {
-        alerts.push_back({{"severity","MED"},{"type","LINK_QUALITY"},{"value",lq},{"threshold",t.min_link_quality}});
+
+    void schedule(const std::string& id, Sat& s, Clock::time_point at) {
+        s.due = at;
+        heap.push(Due{at, s.gen, id});
     }
-    return alerts;
-}
 
-static std::atomic<long long> g_health{0}, g_ready{0}, g_config{0}, g_alerts{0}, g_prom{0}, g_watched{0};
+    void dispatch() {
+        std::unique_lock<std::mutex> lock(mu);
+        while (!stop) {
+            if (heap.empty() || in_flight >= clients.size()) {
+                dispatch_cv.wait(lock);
+                continue;
+            }
+            auto it = sats.find(heap.top().sat_id);
+            if (it == sats.end() || it->second.gen != heap.top().gen) {
+                heap.pop();
+                continue;
+            }
+            auto now = Clock::now();
+            if (heap.top().at > now) {
+                dispatch_cv.wait_until(lock, heap.top().at);
+                continue;
+            }
+            if (opt.max_qps > 0) {
+                tokens = std::min(std::max(1.0, opt.max_qps),
+                                  tokens + opt.max_qps * std::chrono::duration<double>(now - refilled).count());
+                refilled = now;
+                if (tokens < 1.0) {
+                    budget_delayed = true;
+                    dispatch_cv.wait_until(lock, now + std::chrono::duration_cast<Clock::duration>(
+                                                     std::chrono::duration<double>((1.0 - tokens) / opt.max_qps)));
+                    continue;
+                }
+                tokens -= 1.0;
+            }
+            if (budget_delayed) {
+                g_poll_budget_delayed++;
+                budget_delayed = false;
+            }
+
+            Sat& s = it->second;
+            auto lag = std::chrono::duration_cast<std::chrono::milliseconds>(now - heap.top().at);
+            g_poll_lag_ms_sum += lag.count();
+            if (lag > interval(s.tier)) g_poll_overruns++;
+            if (s.last_dispatch) {
+                g_poll_interval_ms_sum[(int)s.tier] +=
+                    std::chrono::duration_cast<std::chrono::milliseconds>(now - *s.last_dispatch).count();
+                g_poll_interval_count[(int)s.tier]++;
+            }
+            s.last_dispatch = now;
+            s.in_flight = true;
+            in_flight++;
+            g_poll_cycles++;
+            jobs.push_back(Job{it->first, s.gen, now});
+            heap.pop();
+            work_cv.notify_one();
+        }
+    }
+
+    void work(httplib::Client& client) {
+        std::unique_lock<std::mutex> lock(mu);
+        for (;;) {
+            work_cv.wait(lock, [this] { return stop || !jobs.empty(); });
+            if (stop) return;
+            Job job = std::move(jobs.front());
+            jobs.pop_front();
+            lock.unlock();
+            PollTier next = fetch(client, job.sat_id);
+            lock.lock();
+            in_flight--;
+            auto it = sats.find(job.sat_id);
+            if (it != sats.end() && it->second.gen == job.gen) {
+                it->second.in_flight = false;
+                it->second.tier = next;
+                schedule(it->first, it->second, std::max(job.dispatched + jittered(next), Clock::now()));
+            }
+            dispatch_cv.notify_one();
+        }
+    }
 
-static std::mutex g_alert_mu;
-static std::unordered_map<std::string, long long> g_alert_type_counts;
+    const Options opt;
+    const Fetch fetch;
+    std::vector<std::unique_ptr<httplib::Client>> clients;
+    std::vector<std::thread> threads;
+
+    std::mutex mu;
+    std::condition_variable work_cv, dispatch_cv;
+    std::unordered_map<std::string, Sat> sats;
+    std::priority_queue<Due, std::vector<Due>, std::greater<Due>> heap;
+    std::deque<Job> jobs;
+    std::size_t in_flight = 0;
+    std::uint64_t last_gen = 0;
+    double tokens;
+    Clock::time_point refilled = Clock::now();
+    bool budget_delayed = false;
+    std::mt19937_64 rng;
+    bool stop = false;
+};
 
-static std::mutex g_state_mu;
-static std::unordered_map<std::string, json> g_last_metrics_by_sat;
-static std::unordered_map<std::string, json> g_last_alerts_by_sat;
+static std::int64_t now_ms() {
+    return (std::int64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
 
-static std::atomic<long long> g_poll_cycles{0};
-static std::atomic<long long> g_poll_failures{0};
+// True if an If-None-Match header value names etag (or is "*").
+static bool etag_matches(const std::string& if_none_match, const std::string& etag) {
+    std::size_t pos = 0;
+    while (pos < if_none_match.size()) {
+        std::size_t end = if_none_match.find(',', pos);
+        if (end == std::string::npos) end = if_none_match.size();
+        std::string tag = if_none_match.substr(pos, end - pos);
+        tag.erase(0, tag.find_first_not_of(" \t"));
+        tag.erase(tag.find_last_not_of(" \t") + 1);
+        if (tag.rfind("W/", 0) == 0) tag.erase(0, 2);
+        if (tag == "*" || tag == etag) return true;
+        pos = end + 1;
+    }
+    return false;
+}
+
+// Reads an optional integer parameter; false (with err set) if it is present
+// but not an integer.
+static bool int_param(const httplib::Request& req, const char* name, std::int64_t& out, std::string& err) {
+    if (!req.has_param(name)) return true;
+    std::string v = req.get_param_value(name);
+    char* end = nullptr;
+    long long x = std::strtoll(v.c_str(), &end, 10);
+    if (v.empty() || *end != '\0') {
+        err = std::string("invalid ") + name + " '" + v + "': expected an integer";
+        return false;
+    }
+    out = x;
+    return true;
+}
 
-static std::string prom_metrics() {
+static std::string prom_metrics(PollScheduler& scheduler, common::SnapshotStore& store, const common::AlertLog& alert_log,
+                                const common::FleetAlerts& fleet) {
     std::ostringstream out;
     out << "# TYPE http_requests_total counter\n";
     out << "http_requests_total{service=\"controlplane\",route=\"/health\"} " << g_health.load() << "\n";
     out << "http_requests_total{service=\"controlplane\",route=\"/ready\"} " << g_ready.load() << "\n";
     out << "http_requests_total{service=\"controlplane\",route=\"/config\"} " << g_config.load() << "\n";
     out << "http_requests_total{service=\"controlplane\",route=\"/alerts\"} " << g_alerts.load() << "\n";
+    out << "http_requests_total{service=\"controlplane\",route=\"/alerts/changes\"} " << g_alert_changes.load() << "\n";
+    out << "http_requests_total{service=\"controlplane\",route=\"/alerts/all\"} " << g_alerts_all.load() << "\n";
     out << "http_requests_total{service=\"controlplane\",route=\"/prom\"} " << g_prom.load() << "\n";
     out << "http_requests_total{service=\"controlplane\",route=\"/watched\"} " << g_watched.load() << "\n";
 
     out << "# TYPE alerts_total counter\n";
-    {
-        std::lock_guard<std::mutex> lock(g_alert_mu);
-        for (auto& kv : g_alert_type_counts) {
-            out << "alerts_total{type=\"" << kv.first << "\"} " << kv.second << "\n";
-        }
+    for (auto& [type, n] : g_alert_counters.totals()) {
+        out << "alerts_total{type=\"" << type << "\"} " << n << "\n";
     }
 
     out << "# TYPE poll_cycles_total counter\n";
     out << "poll_cycles_total " << g_poll_cycles.load() << "\n";
     out << "# TYPE poll_failures_total counter\n";
     out << "poll_failures_total " << g_poll_failures.load() << "\n";
-    return out.str();
-}
+    out << "# TYPE poll_overruns_total counter\n";
+    out << "poll_overruns_total " << g_poll_overruns.load() << "\n";
+    out << "# TYPE poll_budget_delayed_total counter\n";
+    out << "poll_budget_delayed_total " << g_poll_budget_delayed.load() << "\n";
+    out << "# TYPE poll_in_flight gauge\n";
+    out << "poll_in_flight " << g_poll_in_flight.load() << "\n";
+    out << "# TYPE poll_dispatch_lag_ms summary\n";
+    out << "poll_dispatch_lag_ms_sum " << g_poll_lag_ms_sum.load() << "\n";
+    out << "poll_dispatch_lag_ms_count " << g_poll_cycles.load() << "\n";
+
+    auto tiers = scheduler.tier_stats();
+    out << "# TYPE poll_satellites gauge\n";
+    for (PollTier t : kPollTiers) {
+        out << "poll_satellites{tier=\"" << tier_name(t) << "\"} " << tiers[(int)t].satellites << "\n";
+    }
+    out << "# TYPE poll_queue_length gauge\n";
+    for (PollTier t : kPollTiers) {
+        out << "poll_queue_length{tier=\"" << tier_name(t) << "\"} " << tiers[(int)t].due << "\n";
+    }
+    out << "# TYPE poll_achieved_interval_ms summary\n";
+    for (PollTier t : kPollTiers) {
+        out << "poll_achieved_interval_ms_sum{tier=\"" << tier_name(t) << "\"} " << g_poll_interval_ms_sum[(int)t].load() << "\n";
+        out << "poll_achieved_interval_ms_count{tier=\"" << tier_name(t) << "\"} " << g_poll_interval_count[(int)t].load() << "\n";
+    }
 
-static std::int64_t now_ms() {
-    return (std::int64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
-        std::chrono::system_clock::now().time_since_epoch()).count();
+    auto snap = store.load();
+    out << "# TYPE alert_snapshot_publishes_total counter\n";
+    out << "alert_snapshot_publishes_total " << g_snapshot_publishes.load() << "\n";
+    out << "# TYPE alert_snapshot_satellites gauge\n";
+    out << "alert_snapshot_satellites " << snap->sats.size() << "\n";
+    out << "# TYPE alert_snapshot_age_ms gauge\n";
+    out << "alert_snapshot_age_ms " << (snap->version ? now_ms() - snap->published_ms : 0) << "\n";
+
+    auto log = alert_log.stats();
+    out << "# TYPE alert_changes_total counter\n";
+    out << "alert_changes_total{event=\"raised\"} " << log.raised << "\n";
+    out << "alert_changes_total{event=\"cleared\"} " << log.cleared << "\n";
+    out << "# TYPE alert_log_entries gauge\n";
+    out << "alert_log_entries " << log.entries << "\n";
+    out << "# TYPE alert_changes_waiters gauge\n";
+    out << "alert_changes_waiters " << g_changes_waiters.load() << "\n";
+    out << "# TYPE alert_fleet_builds_total counter\n";
+    out << "alert_fleet_builds_total " << g_fleet_alerts_builds.load() << "\n";
+    out << "# TYPE alert_fleet_body_bytes gauge\n";
+    out << "alert_fleet_body_bytes " << fleet.body.size() << "\n";
+    out << "# TYPE alert_fleet_not_modified_total counter\n";
+    out << "alert_fleet_not_modified_total " << g_alerts_all_not_modified.load() << "\n";
+
+    out << "# TYPE poll_fetch_latency_ms histogram\n";
+    long long cumulative = 0;
+    for (std::size_t i = 0; i < std::size(kFetchBucketsMs); i++) {
+        cumulative += g_fetch_buckets[i].load();
+        out << "poll_fetch_latency_ms_bucket{le=\"" << kFetchBucketsMs[i] << "\"} " << cumulative << "\n";
+    }
+    cumulative += g_fetch_buckets[std::size(kFetchBucketsMs)].load();
+    out << "poll_fetch_latency_ms_bucket{le=\"+Inf\"} " << cumulative << "\n";
+    out << "poll_fetch_latency_ms_sum " << g_fetch_ms_sum.load() << "\n";
+    out << "poll_fetch_latency_ms_count " << g_fetch_count.load() << "\n";
+    out << common::logging_prom("controlplane");
+    return out.str();
 }
 
 int main(int argc, char** argv) {
+    common::init_async_logging("controlplane");
     int port = (argc > 1) ? std::atoi(argv[1]) : 8083;
     std::string aggregator_host = (argc > 2) ? argv[2] : std::string("localhost");
     int aggregator_port = (argc > 3) ? std::atoi(argv[3]) : 8082;
 
-    Thresholds thresholds;
-    std::mutex thresholds_mu;
+    // Swapped whole by /config (serialized on config_mu); pollers and readers
+    // just load the current one.
+    std::atomic<std::shared_ptr<const AlertConfig>> config;
+    std::mutex config_mu;
+    {
+        AlertConfig initial;
+        compile_config(initial, json(), json::object(), 1);
+        config.store(std::make_shared<const AlertConfig>(std::move(initial)));
+    }
 
     std::vector<std::string> watched = {"SAT-001","SAT-002","SAT-003","SAT-004","SAT-005"};
     std::mutex watched_mu;
@@ -108,61 +482,89 @@ int main(int argc, char** argv) {
     agg.set_read_timeout(2);
     agg.set_write_timeout(2);
 
-    std::atomic<bool> stop{false};
-
-    std::thread poller([&](){
-        while (!stop.load()) {
-            g_poll_cycles++;
-
-            Thresholds t;
-            {
-                std::lock_guard<std::mutex> lock(thresholds_mu);
-                t = thresholds;
-            }
-
-            std::vector<std::string> sats;
-            {
-                std::lock_guard<std::mutex> lock(watched_mu);
-                sats = watched;
-            }
-
-            for (const auto& sat_id : sats) {
-                std::string path = "/metrics?sat_id=" + sat_id + "&window_s=" + std::to_string(t.window_s);
-
-                auto r = agg.Get(path.c_str());
-                if (!r || r->status != 200) {
-                    g_poll_failures++;
-                    continue;
-                }
-
-                json metrics;
-                try {
-                    metrics = json::parse(r->body);
-                } catch (...) {
-                    g_poll_failures++;
-                    continue;
-                }
-
-                json alerts = eval_alerts(metrics, t);
-
-                {
-                    std::lock_guard<std::mutex> lock(g_state_mu);
-                    g_last_metrics_by_sat[sat_id] = metrics;
-                    g_last_alerts_by_sat[sat_id] = alerts;
-                }
-
-                {
-                    std::lock_guard<std::mutex> lock(g_alert_mu);
-                    for (auto& a : alerts) {
-                        if (a.contains("type") && a["type"].is_string()) {
-                            g_alert_type_counts[a["type"].get<std::string>()]++;
-                        }
-                    }
-                }
-            }
+    PollScheduler::Options poll;
+    poll.fast = std::chrono::milliseconds(std::max(100LL, common::env_int("POLL_FAST_MS", 1000)));
+    poll.slow = std::chrono::milliseconds(std::max(100LL, common::env_int("POLL_SLOW_MS", 5000)));
+    poll.jitter = std::clamp(common::env_double("POLL_JITTER", 0.1), 0.0, 0.5);
+    poll.max_qps = std::max(0.0, common::env_double("POLL_MAX_QPS", 200.0));
+    poll.workers = (int)std::clamp(common::env_int("POLL_CONCURRENCY", 8), 1LL, 256LL);
+    poll.timeout_ms = (int)std::max(100LL, common::env_int("POLL_TIMEOUT_MS", 2000));
+
+    common::SnapshotStore store;
+    common::AlertLog alert_log((std::size_t)std::max(1LL, common::env_int("ALERT_LOG_CAPACITY", 10000)),
+                               (std::uint64_t)now_ms() * 1000);
+    const long long max_waiters = std::max(0LL, common::env_int("ALERT_CHANGES_MAX_WAITERS", 32));
+    // Rebuilt by the publisher when any alert or the set of satellites
+    // changes; /alerts/all readers share the current one.
+    std::atomic<std::shared_ptr<const common::FleetAlerts>> fleet_alerts(
+        common::FleetAlerts::build(*store.load(), alert_log.stats().last_seq));
+
+    // Alerting, erroring or unreachable satellites go on the fast tier.
+    PollScheduler scheduler(aggregator_host, aggregator_port, poll,
+                            [&config, &store](httplib::Client& client, const std::string& sat_id) {
+        auto cfg = config.load();
+
+        std::string path = "/metrics?sat_id=" + sat_id + "&window_s=" + std::to_string(cfg->window_s);
+        if (cfg->want_p99) path += "&q=99";
+
+        g_poll_in_flight++;
+        auto fetch_started = std::chrono::steady_clock::now();
+        auto r = client.Get(path.c_str());
+        observe_fetch_ms(std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - fetch_started).count());
+        g_poll_in_flight--;
+        if (!r || r->status != 200) {
+            g_poll_failures++;
+            return PollTier::Fast;
+        }
 
-            std::this_thread::sleep_for(std::chrono::seconds(5));
+        auto state = std::make_shared<common::SatState>();
+        try {
+            state->metrics = common::SatMetrics::from_json(json::parse(r->body));
+        } catch (...) {
+            g_poll_failures++;
+            return PollTier::Fast;
         }
+        state->metrics_json = r->body;
+        // "for N cycles" runs carry over from this satellite's previous poll
+        // unless the rules have changed since.
+        static const std::vector<std::uint32_t> no_streaks;
+        auto prev = store.latest(sat_id);
+        bool same_rules = prev && prev->rules_version == cfg->rules->version();
+        state->alerts = cfg->rules->eval(sat_id, state->metrics, same_rules ? prev->streaks : no_streaks, state->streaks);
+        state->rules_version = cfg->rules->version();
+        state->alerts_json = common::alerts_json(state->alerts).dump();
+        state->polled_ms = now_ms();
+
+        bool alerting = !state->alerts.empty();
+        store.stage(sat_id, std::move(state));
+        return alerting ? PollTier::Fast : PollTier::Slow;
+    });
+    scheduler.set_watched(watched);
+    store.retain(watched);
+
+    // Poll results reach /alerts readers through one snapshot swap per
+    // publish interval rather than one lock round-trip per satellite. The
+    // alert changes each swap makes go to the change log; /alerts/all is
+    // rebuilt whenever any satellite's alerts body differs, since an alert
+    // that stays raised still carries a new value each poll.
+    common::PeriodicTask publisher("snapshot publish",
+                                   std::chrono::milliseconds(std::max(10LL, common::env_int("ALERT_PUBLISH_MS", 250))),
+                                   [&store, &alert_log, &fleet_alerts] {
+        std::int64_t now = now_ms();
+        common::AlertChanges changes;
+        bool rebuild = false;
+        bool published = store.publish(now, [&](const std::string& sat_id, const common::SatState* before,
+                                                const common::SatState* after) {
+            common::AlertLog::diff(sat_id, before, after, now, changes);
+            rebuild |= !before || !after || before->alerts_json != after->alerts_json;
+        });
+        if (!published) return;
+        g_snapshot_publishes++;
+        alert_log.append(changes);
+        if (!rebuild) return;
+        fleet_alerts.store(common::FleetAlerts::build(*store.load(), alert_log.stats().last_seq));
+        g_fleet_alerts_builds++;
     });
 
     httplib::Server svr;
@@ -183,35 +585,56 @@ int main(int argc, char** argv) {
         res.set_content(R"({"ok":true})", "application/json");
     });
 
-    svr.Get("/prom", [](const httplib::Request&, httplib::Response& res) {
+    svr.Get("/prom", [&scheduler, &store, &alert_log, &fleet_alerts](const httplib::Request&, httplib::Response& res) {
         g_prom++;
-        res.set_content(prom_metrics(), "text/plain; version=0.0.4");
+        res.set_content(prom_metrics(scheduler, store, alert_log, *fleet_alerts.load()), "text/plain; version=0.0.4");
+    });
+
+    svr.Get("/config", [&config](const httplib::Request&, httplib::Response& res) {
+        g_config++;
+        json out = config_json(*config.load());
+        out["ok"] = true;
+        res.set_content(out.dump(), "application/json");
     });
 
-    svr.Post("/config", [&thresholds_mu, &thresholds](const httplib::Request& req, httplib::Response& res) {
+    // Takes any of window_s, the three legacy thresholds, "rules" (an array
+    // replacing the rule set; null to go back to the defaults) and "groups".
+    // Rules are compiled here, so a bad one is a 400 and changes nothing.
+    svr.Post("/config", [&config_mu, &config](const httplib::Request& req, httplib::Response& res) {
         g_config++;
         try {
             auto j = json::parse(req.body);
-            std::lock_guard<std::mutex> lock(thresholds_mu);
-
-            if (j.contains("latency_p95_ms")) thresholds.latency_p95_ms = j["latency_p95_ms"].get<double>();
-            if (j.contains("drop_rate")) thresholds.drop_rate = j["drop_rate"].get<double>();
-            if (j.contains("min_link_quality")) thresholds.min_link_quality = j["min_link_quality"].get<double>();
-            if (j.contains("window_s")) thresholds.window_s = j["window_s"].get<int>();
-
-            res.set_content(json{{"ok",true},{"thresholds",{
-                {"latency_p95_ms",thresholds.latency_p95_ms},
-                {"drop_rate",thresholds.drop_rate},
-                {"min_link_quality",thresholds.min_link_quality},
-                {"window_s",thresholds.window_s}
-            }}}.dump(), "application/json");
+            std::lock_guard<std::mutex> lock(config_mu);
+            auto cur = config.load();
+            AlertConfig next = *cur;
+
+            if (j.contains("latency_p95_ms")) next.latency_p95_ms = j["latency_p95_ms"].get<double>();
+            if (j.contains("drop_rate")) next.drop_rate = j["drop_rate"].get<double>();
+            if (j.contains("min_link_quality")) next.min_link_quality = j["min_link_quality"].get<double>();
+            if (j.contains("window_s")) next.window_s = j["window_s"].get<int>();
+
+            json rules = cur->custom_rules ? cur->rules->rules_json() : json();
+            if (j.contains("rules")) {
+                next.custom_rules = !j["rules"].is_null();
+                rules = j["rules"];
+            }
+            json groups = j.contains("groups") ? j["groups"] : cur->rules->groups_config();
+            compile_config(next, rules, groups, cur->rules->version() + 1);
+
+            config.store(std::make_shared<const AlertConfig>(next));
+            json out = config_json(next);
+            out["ok"] = true;
+            res.set_content(out.dump(), "application/json");
+        } catch (const common::RuleError& e) {
+            res.status = 400;
+            res.set_content(json{{"ok",false},{"error",e.what()}}.dump(), "application/json");
         } catch (const std::exception& e) {
             res.status = 400;
             res.set_content(json{{"ok",false},{"error",std::string("invalid json: ")+e.what()}}.dump(), "application/json");
         }
     });
 
-    svr.Post("/watched", [&watched_mu, &watched](const httplib::Request& req, httplib::Response& res) {
+    svr.Post("/watched", [&watched_mu, &watched, &scheduler, &store](const httplib::Request& req, httplib::Response& res) {
         g_watched++;
         try {
             auto j = json::parse(req.body);
@@ -230,8 +653,12 @@ int main(int argc, char** argv) {
                 return;
             }
             {
+                // Under watched_mu so concurrent updates reach the scheduler
+                // and the store in the same order as `watched`.
                 std::lock_guard<std::mutex> lock(watched_mu);
-                watched = std::move(next);
+                watched = next;
+                scheduler.set_watched(next);
+                store.retain(next);
             }
             res.set_content(R"({"ok":true})", "application/json");
         } catch (const std::exception& e) {
@@ -250,7 +677,7 @@ int main(int argc, char** argv) {
         res.set_content(json{{"ok",true},{"sats",sats}}.dump(), "application/json");
     });
 
-    svr.Get("/alerts", [&thresholds_mu, &thresholds](const httplib::Request& req, httplib::Response& res) {
+    svr.Get("/alerts", [&config, &store](const httplib::Request& req, httplib::Response& res) {
         g_alerts++;
         if (!req.has_param("sat_id")) {
             res.status = 400;
@@ -259,41 +686,150 @@ int main(int argc, char** argv) {
         }
         std::string sat_id = req.get_param_value("sat_id");
 
-        Thresholds t;
-        {
-            std::lock_guard<std::mutex> lock(thresholds_mu);
-            t = thresholds;
-        }
+        auto cfg = config.load();
+        auto snap = store.load();
+        auto it = snap->sats.find(sat_id);
+        const common::SatState* state = it == snap->sats.end() ? nullptr : it->second.get();
+
+        // Spliced from the snapshot's pre-serialized parts, keys in the order
+        // json::dump() would give them.
+        json poll = {{"cycles", g_poll_cycles.load()}, {"failures", g_poll_failures.load()}, {"now_ms", now_ms()}};
+        if (state) poll["polled_ms"] = state->polled_ms;
+        std::string out;
+        out += "{\"alerts\":";
+        out += state ? state->alerts_json : "[]";
+        out += ",\"config\":";
+        out += cfg->summary_json;
+        out += ",\"metrics\":";
+        out += state ? state->metrics_json : R"({"error":"no data yet","ok":false})";
+        out += ",\"ok\":true,\"poll\":";
+        out += poll.dump();
+        out += ",\"sat_id\":";
+        out += json(sat_id).dump();
+        out += ",\"thresholds\":";
+        out += cfg->thresholds_json;
+        out += "}";
+
+        res.set_content(std::move(out), "application/json");
+    });
 
-        json metrics = json{{"ok",false},{"error","no data yet"}};
-        json alerts = json::array();
-        {
-            std::lock_guard<std::mutex> lock(g_state_mu);
-            if (g_last_metrics_by_sat.count(sat_id)) metrics = g_last_metrics_by_sat[sat_id];
-            if (g_last_alerts_by_sat.count(sat_id)) alerts = g_last_alerts_by_sat[sat_id];
+    // Alert transitions after the cursor `since`, oldest first, at most
+    // `limit`: {"changes":[...],"next":<cursor>,"resync":<bool>}. Without
+    // since, just the current cursor: take it, then read /alerts, then follow
+    // from it (/alerts/all returns alerts and cursor together). With wait_ms
+    // (up to 30000) and nothing new yet, the request is held until a change
+    // arrives or the wait runs out.
+    svr.Get("/alerts/changes", [&alert_log, max_waiters](const httplib::Request& req, httplib::Response& res) {
+        g_alert_changes++;
+        auto bad_request = [&res](const std::string& err) {
+            res.status = 400;
+            res.set_content(json{{"ok",false},{"error",err}}.dump(), "application/json");
+        };
+        std::int64_t since = -1, limit = 1000, wait_ms = 0;
+        std::string err;
+        if (!int_param(req, "since", since, err) || !int_param(req, "limit", limit, err) ||
+            !int_param(req, "wait_ms", wait_ms, err)) {
+            return bad_request(err);
+        }
+        if (req.has_param("since") && since < 0) return bad_request("since must be a cursor from a previous response");
+        if (limit < 1 || limit > 10000) return bad_request("limit must be from 1 to 10000");
+        wait_ms = std::clamp<std::int64_t>(wait_ms, 0, 30000);
+
+        std::uint64_t cursor = since < 0 ? alert_log.stats().last_seq : (std::uint64_t)since;
+        std::string changes;
+        bool resync = false;
+        std::uint64_t next = alert_log.read(cursor, since < 0 ? 0 : (std::size_t)limit, changes, resync);
+        if (since >= 0 && next == cursor && !resync && wait_ms > 0) {
+            // Waiting holds a server thread; past the cap, answer at once.
+            if (++g_changes_waiters <= max_waiters) {
+                auto until = std::chrono::steady_clock::now() + std::chrono::milliseconds(wait_ms);
+                if (alert_log.wait(cursor, until)) {
+                    changes.clear();
+                    next = alert_log.read(cursor, (std::size_t)limit, changes, resync);
+                }
+            }
+            g_changes_waiters--;
         }
 
-        json out = {
-            {"ok", true},
-            {"sat_id", sat_id},
-            {"metrics", metrics},
-            {"alerts", alerts},
-            {"thresholds", {
-                {"latency_p95_ms",t.latency_p95_ms},
-                {"drop_rate",t.drop_rate},
-                {"min_link_quality",t.min_link_quality},
-                {"window_s",t.window_s}
-            }},
-            {"poll", {{"cycles", g_poll_cycles.load()}, {"failures", g_poll_failures.load()}, {"now_ms", now_ms()}}}
+        std::string out;
+        out += "{\"changes\":";
+        out += changes;
+        out += ",\"next\":";
+        out += std::to_string(next);
+        out += ",\"ok\":true,\"resync\":";
+        out += resync ? "true" : "false";
+        out += "}";
+        res.set_header("Cache-Control", "no-cache");
+        res.set_content(std::move(out), "application/json");
+    });
+
+    // Every published satellite's alerts: {"cursor":N,"ok":true,"satellites":
+    // [{"alerts":[...],"sat_id":"..."}]}, where cursor is the /alerts/changes
+    // position they are current as of. severity= and type= (comma-separated)
+    // keep only matching alerts and the satellites that have any. The ETag
+    // changes only when the alerts do; If-None-Match on it gets a 304.
+    svr.Get("/alerts/all", [&fleet_alerts](const httplib::Request& req, httplib::Response& res) {
+        g_alerts_all++;
+        auto fleet = fleet_alerts.load();
+
+        bool severities[3] = {false, false, false};
+        bool by_severity = false;
+        std::unordered_set<std::string> types;
+        auto each = [](const std::string& list, auto&& fn) {
+            std::stringstream in(list);
+            std::string item;
+            while (std::getline(in, item, ',')) {
+                if (!item.empty()) fn(item);
+            }
         };
+        std::string bad;
+        each(req.get_param_value("severity"), [&](const std::string& sev) {
+            if (sev == "LOW") severities[(int)common::Severity::Low] = true;
+            else if (sev == "MED") severities[(int)common::Severity::Med] = true;
+            else if (sev == "HIGH") severities[(int)common::Severity::High] = true;
+            else bad = sev;
+            by_severity = true;
+        });
+        if (!bad.empty()) {
+            res.status = 400;
+            res.set_content(json{{"ok",false},{"error","unknown severity '" + bad + "': expected LOW, MED or HIGH"}}.dump(),
+                            "application/json");
+            return;
+        }
+        each(req.get_param_value("type"), [&](const std::string& type) { types.insert(type); });
+
+        // The body depends only on the alerts and this request's filters, so
+        // one tag per fleet state serves every filtered URL too.
+        res.set_header("ETag", fleet->etag);
+        res.set_header("Cache-Control", "no-cache");
+        if (req.has_header("If-None-Match") && etag_matches(req.get_header_value("If-None-Match"), fleet->etag)) {
+            g_alerts_all_not_modified++;
+            res.status = 304;
+            return;
+        }
 
-        res.set_content(out.dump(), "application/json");
+        if (!by_severity && types.empty()) {
+            // The shared body itself, kept alive by the provider.
+            res.set_content_provider(fleet->body.size(), "application/json",
+                                     [fleet](std::size_t offset, std::size_t length, httplib::DataSink& sink) {
+                return sink.write(fleet->body.data() + offset, length);
+            });
+            return;
+        }
+        res.set_content(fleet->render([&](const common::FleetAlerts::Entry& e) {
+            return (!by_severity || severities[(int)e.severity]) && (types.empty() || types.count(e.type));
+        }, true), "application/json");
     });
 
-    spdlog::info("controlplane listening on {} -> aggregator {}:{}", port, aggregator_host, aggregator_port);
+    // Long-polls on /alerts/changes hold a worker thread each; size the pool
+    // so they never take the ones the other routes need.
+    std::size_t workers = CPPHTTPLIB_THREAD_POOL_COUNT + (std::size_t)max_waiters;
+    svr.new_task_queue = [workers] { return new httplib::ThreadPool(workers); };
+
+    spdlog::info("controlplane listening on {} -> aggregator {}:{} (poll fast {} ms, slow {} ms, {} in flight, {} qps)",
+                 port, aggregator_host, aggregator_port, poll.fast.count(), poll.slow.count(), poll.workers, poll.max_qps);
     svr.listen("0.0.0.0", port);
 
-    stop.store(true);
-    if (poller.joinable()) poller.join();
+    spdlog::shutdown();
     return 0;
 }
@@ -3,118 +3,905 @@
 #include <spdlog/spdlog.h>
 #include <sqlite3.h>
 
+#include "common/config.hpp"
+#include "common/event_json.hpp"
+#include "common/logging.hpp"
+#include "common/partitions.hpp"
+#include "common/periodic.hpp"
+#include "common/rollup.hpp"
+#include "common/schema.hpp"
+#include "common/storage.hpp"
+#include "common/telemetry.hpp"
+
 #include <cstdint>
 #include <cstdlib>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 
+#include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <sstream>
+#include <thread>
+#include <vector>
 
 using json = nlohmann::json;
 
+struct Event {
+    std::string event_id;  // compared exactly; lowercase UUIDs are stored compactly, anything else as text
+    std::string sat_id;
+    std::int64_t ts_ms = 0;
+    double latency_ms = 0.0;
+    int dropped_packets = 0;
+    int sent_packets = 0;
+    double link_quality = 0.0;
+};
+
+// Assumes validate_event() has already accepted j.
+static Event event_from_json(const json& j) {
+    Event ev;
+    ev.event_id = j["event_id"].get<std::string>();
+    ev.sat_id = j["sat_id"].get<std::string>();
+    ev.ts_ms = j["ts_ms"].get<std::int64_t>();
+    ev.latency_ms = j["latency_ms"].get<double>();
+    ev.dropped_packets = j["dropped_packets"].get<int>();
+    ev.sent_packets = j["sent_packets"].get<int>();
+    ev.link_quality = j["link_quality"].get<double>();
+    return ev;
+}
+
+static Event event_from_view(const common::EventView& v) {
+    Event ev;
+    ev.event_id = v.event_id;
+    ev.sat_id = v.sat_id;
+    ev.ts_ms = v.ts_ms;
+    ev.latency_ms = v.latency_ms;
+    ev.dropped_packets = v.dropped_packets;
+    ev.sent_packets = v.sent_packets;
+    ev.link_quality = v.link_quality;
+    return ev;
+}
+
+static std::int64_t now_ms() {
+    return (std::int64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
 struct Sqlite {
-    sqlite3* db = nullptr;
+    std::string path;
+    common::Connection conn;
+    int version = common::kSchemaNone;
+    common::SatelliteKeys sats;
 
-    explicit Sqlite(const std::string& path) {
-        if (sqlite3_open(path.c_str(), &db) != SQLITE_OK) {
-            std::string msg = db ? sqlite3_errmsg(db) : "unknown";
-            if (db) sqlite3_close(db);
-            db = nullptr;
-            throw std::runtime_error("sqlite open failed: " + msg);
+    // New databases get schema v2. A v1 database keeps working as v1 until
+    // tools/migrate upgrades it, which the writer picks up via refresh_schema().
+    Sqlite(const std::string& path, const common::StoragePragmas& pragmas)
+        : path(path), conn(path, common::OpenMode::ReadWrite, pragmas) {
+        version = common::schema_version(conn);
+        if (version == common::kSchemaNone) {
+            // One transaction, so a reader never sees the tables without
+            // user_version (which would read as v1).
+            begin();
+            try {
+                common::create_schema_v2(conn);
+                commit();
+            } catch (...) {
+                rollback();
+                throw;
+            }
+            version = common::kSchemaV2;
+        } else if (version == common::kSchemaV1) {
+            common::create_schema_v1(conn);
+            spdlog::warn("database uses telemetry schema v1; run telemetry_migrate to upgrade");
         }
+    }
+
+    void exec(const std::string& sql) { conn.exec(sql); }
 
-        sqlite3_busy_timeout(db, 5000);
+    void begin() { exec("BEGIN IMMEDIATE;"); }
+    void commit() { exec("COMMIT;"); }
+    void rollback() {
+        sats.clear();
+        try { exec("ROLLBACK;"); } catch (...) {}
+    }
 
-        exec("PRAGMA busy_timeout=5000;");
-        exec("PRAGMA journal_mode=WAL;");
-        exec(R"sql(
-            CREATE TABLE IF NOT EXISTS telemetry (
-                event_id TEXT PRIMARY KEY,
-                sat_id TEXT NOT NULL,
-                ts_ms INTEGER NOT NULL,
-                latency_ms REAL NOT NULL,
-                dropped_packets INTEGER NOT NULL,
-                sent_packets INTEGER NOT NULL,
-                link_quality REAL NOT NULL
-            );
-        )sql");
-        exec("CREATE INDEX IF NOT EXISTS idx_telemetry_ts ON telemetry(ts_ms);");
-        exec("CREATE INDEX IF NOT EXISTS idx_telemetry_sat ON telemetry(sat_id);");
+    // Re-reads the layout after a failed write; true if it changed (e.g. an
+    // online migration just cut over).
+    bool refresh_schema() {
+        int v = common::schema_version(conn);
+        if (v == version) return false;
+        spdlog::info("telemetry schema changed v{} -> v{}", version, v);
+        version = v;
+        sats.clear();
+        return true;
     }
 
-    ~Sqlite() { if (db) sqlite3_close(db); }
+    bool insert_event(const Event& ev) {
+        auto stmt = conn.prepare(common::insert_sql(version));
 
-    void exec(const std::string& sql) {
-        char* err = nullptr;
-        if (sqlite3_exec(db, sql.c_str(), nullptr, nullptr, &err) != SQLITE_OK) {
-            std::string msg = err ? err : "unknown";
-            sqlite3_free(err);
-            throw std::runtime_error("sqlite exec failed: " + msg);
+        if (version == common::kSchemaV2) {
+            common::EventKey key(ev.event_id);
+            key.bind(*stmt, 1);
+            stmt->bind(2, sats.get(conn, ev.sat_id));
+        } else {
+            stmt->bind(1, std::string_view(ev.event_id));
+            stmt->bind(2, std::string_view(ev.sat_id));
         }
+        stmt->bind(3, ev.ts_ms);
+        stmt->bind(4, ev.latency_ms);
+        stmt->bind(5, ev.dropped_packets);
+        stmt->bind(6, ev.sent_packets);
+        stmt->bind(7, ev.link_quality);
+
+        stmt->step();
+        return conn.changes() > 0;
+    }
+};
+
+static std::atomic<long long> g_write_batches{0};
+static std::atomic<long long> g_write_batch_events{0};
+static std::atomic<long long> g_write_failures{0};
+static std::atomic<long long> g_partitions_opened{0};
+static std::atomic<long long> g_partitions_dropped{0};
+
+// Writer connections, one per partition file (a single one when unpartitioned).
+// The writer thread looks partitions up by event timestamp; maintain() runs on
+// its own thread and opens the next partition before rollover, so the writer
+// never pays for file creation on the hot path, closes partitions that have
+// gone quiet and unlinks those past retention.
+class PartitionSet {
+public:
+    // retention_ms (0 = forever) is how long after its end a partition file
+    // is kept; max_future_ms (0 = unbounded) how far ahead of the clock an
+    // event may be stamped when partitioned. See accepts().
+    PartitionSet(common::PartitionScheme scheme, common::StoragePragmas pragmas, std::int64_t retention_ms,
+                 std::int64_t max_future_ms)
+        : scheme(std::move(scheme)), pragmas(std::move(pragmas)), retention_ms(retention_ms),
+          max_future_ms(max_future_ms) {
+        if (this->scheme.partitioned()) std::filesystem::create_directories(this->scheme.root());
     }
 
-    bool insert_event(const json& j) {
-        const char* sql =
-            "INSERT OR IGNORE INTO telemetry(event_id,sat_id,ts_ms,latency_ms,dropped_packets,sent_packets,link_quality) "
-            "VALUES(?,?,?,?,?,?,?);";
-        sqlite3_stmt* stmt = nullptr;
-        if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
-            throw std::runtime_error(std::string("sqlite prepare failed: ") + sqlite3_errmsg(db));
+    const common::PartitionScheme& layout() const { return scheme; }
+
+    // Whether an event stamped ts_ms may be written at `now`. Partitioned, its
+    // year must fit a file name, its partition must not be past retention
+    // (the file is, or is about to be, gone), and it may not be further ahead
+    // than max_future_ms: each future period is a file kept open until it
+    // ends.
+    bool accepts(std::int64_t ts_ms, std::int64_t now, std::string& err) const {
+        if (!scheme.covers(ts_ms)) {
+            err = "ts_ms must be in years 1970 to 9999 when partitioned";
+            return false;
+        }
+        if (expired(scheme.partition_for(ts_ms), now)) {
+            err = "ts_ms is past the " + std::to_string(retention_ms / 3600000) + "h retention";
+            return false;
+        }
+        if (scheme.partitioned() && max_future_ms > 0 && ts_ms > now && ts_ms - now > max_future_ms) {
+            err = "ts_ms is more than " + std::to_string(max_future_ms / 1000) + "s in the future";
+            return false;
         }
+        return true;
+    }
 
-        sqlite3_bind_text(stmt, 1, j["event_id"].get<std::string>().c_str(), -1, SQLITE_TRANSIENT);
-        sqlite3_bind_text(stmt, 2, j["sat_id"].get<std::string>().c_str(), -1, SQLITE_TRANSIENT);
-        sqlite3_bind_int64(stmt, 3, j["ts_ms"].get<std::int64_t>());
-        sqlite3_bind_double(stmt, 4, j["latency_ms"].get<double>());
-        sqlite3_bind_int(stmt, 5, j["dropped_packets"].get<int>());
-        sqlite3_bind_int(stmt, 6, j["sent_packets"].get<int>());
-        sqlite3_bind_double(stmt, 7, j["link_quality"].get<double>());
+    // Opens (and creates) the partition on a miss. `p` receives its bounds.
+    std::shared_ptr<Sqlite> get(std::int64_t ts_ms, common::Partition& p) {
+        if (!scheme.covers(ts_ms)) throw std::runtime_error("ts_ms " + std::to_string(ts_ms) + " has no partition");
+        p = scheme.partition_for(ts_ms);
+        {
+            std::lock_guard<std::mutex> lock(mu);
+            auto it = open.find(p.start_ms);
+            if (it != open.end()) return it->second;
+        }
+        // Creation is serialized separately so a slow open never holds up
+        // lookups of partitions that are already open. Retention unlinks
+        // under create_mu too, so a file is never reopened as it is removed,
+        // and one it has removed or is about to is never recreated.
+        std::lock_guard<std::mutex> create(create_mu);
+        {
+            std::lock_guard<std::mutex> lock(mu);
+            auto it = open.find(p.start_ms);
+            if (it != open.end()) return it->second;
+        }
+        if (expired(p, now_ms())) throw std::runtime_error("partition " + p.path + " is past retention");
+        auto db = std::make_shared<Sqlite>(p.path, pragmas);
+        g_partitions_opened++;
+        std::lock_guard<std::mutex> lock(mu);
+        open.emplace(p.start_ms, db);
+        return db;
+    }
+
+    std::shared_ptr<Sqlite> get(std::int64_t ts_ms) {
+        common::Partition p;
+        return get(ts_ms, p);
+    }
+
+    // `precreate` is how far ahead of rollover the next partition is opened
+    // and `idle` how long after its end a partition stays open for late
+    // events. can_drop, when set, holds back files that still have work
+    // pending (rows not yet rolled up).
+    void maintain(std::int64_t now, std::int64_t precreate, std::int64_t idle,
+                  const std::function<bool(const common::Partition&)>& can_drop = nullptr) {
+        if (!scheme.partitioned()) return;
+        get(now);
+        get(now + precreate);
+
+        std::vector<std::shared_ptr<Sqlite>> closing;
+        {
+            std::lock_guard<std::mutex> lock(mu);
+            for (auto it = open.begin(); it != open.end();) {
+                if (it->first + scheme.span_ms() + idle < now) {
+                    retired.push_back(std::move(it->second));
+                    it = open.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+            // Closing checkpoints the WAL; only do it here, once the writer has
+            // let go, never as a side effect of the writer dropping the last
+            // reference.
+            for (auto it = retired.begin(); it != retired.end();) {
+                if (it->use_count() == 1) {
+                    closing.push_back(std::move(*it));
+                    it = retired.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+        }
+        closing.clear();
 
-        int rc = sqlite3_step(stmt);
-        sqlite3_finalize(stmt);
-        if (rc != SQLITE_DONE) throw std::runtime_error(std::string("sqlite step failed: ") + sqlite3_errmsg(db));
+        if (retention_ms <= 0) return;
+        for (auto& p : scheme.list()) {
+            if (!expired(p, now)) break;
+            if (can_drop && !can_drop(p)) continue;
+            std::lock_guard<std::mutex> create(create_mu);
+            {
+                std::lock_guard<std::mutex> lock(mu);
+                if (open.count(p.start_ms)) continue;
+                bool busy = false;
+                for (auto& r : retired) busy = busy || r->path == p.path;
+                if (busy) continue;
+            }
+            common::PartitionScheme::unlink(p);
+            g_partitions_dropped++;
+            spdlog::info("retention dropped partition {}", p.path);
+        }
+    }
 
-        return sqlite3_changes(db) > 0;
+    std::size_t open_count() {
+        std::lock_guard<std::mutex> lock(mu);
+        return open.size() + retired.size();
     }
+
+private:
+    bool expired(const common::Partition& p, std::int64_t now) const {
+        return scheme.partitioned() && retention_ms > 0 && p.end_ms <= now - retention_ms;
+    }
+
+    common::PartitionScheme scheme;
+    common::StoragePragmas pragmas;
+    const std::int64_t retention_ms;
+    const std::int64_t max_future_ms;
+
+    std::mutex create_mu;
+    std::mutex mu;
+    std::map<std::int64_t, std::shared_ptr<Sqlite>> open;
+    std::vector<std::shared_ptr<Sqlite>> retired;
 };
 
-static bool validate_event(const json& j, std::string& err) {
-    const char* req[] = {"event_id","sat_id","ts_ms","latency_ms","dropped_packets","sent_packets","link_quality"};
-    for (auto k : req) if (!j.contains(k)) { err = std::string("missing field: ") + k; return false; }
+static std::atomic<long long> g_rollup_passes{0};
+static std::atomic<long long> g_rollup_rows{0};
+static std::atomic<long long> g_rollup_buckets{0};
+static std::atomic<long long> g_rollup_pass_ms{0};
+static std::atomic<long long> g_rollup_newest_ts{0};
+static std::atomic<long long> g_raw_rows_expired{0};
 
-    if (!j["event_id"].is_string() || j["event_id"].get<std::string>().empty()) { err = "event_id invalid"; return false; }
-    if (!j["sat_id"].is_string()   || j["sat_id"].get<std::string>().empty())   { err = "sat_id invalid"; return false; }
-    if (!j["ts_ms"].is_number_integer()) { err = "ts_ms must be int64"; return false; }
-    if (!j["latency_ms"].is_number())    { err = "latency_ms must be number"; return false; }
-    if (!j["dropped_packets"].is_number_integer()) { err = "dropped_packets must be int"; return false; }
-    if (!j["sent_packets"].is_number_integer())    { err = "sent_packets must be int"; return false; }
+// Folds raw telemetry into the minute and hour rollup tables. Each pass tails
+// every raw file past its watermark in chunks; a chunk's buckets are merged
+// into the stored ones and the watermark advanced in one rollup-database
+// transaction. Files whose mtime has not moved since they were last drained
+// are skipped without being opened.
+class RollupEngine {
+public:
+    RollupEngine(const common::PartitionScheme& scheme, const common::StoragePragmas& pragmas, std::size_t chunk_rows)
+        : scheme(scheme), pragmas(pragmas), chunk_rows(std::max<std::size_t>(1, chunk_rows)),
+          out(common::rollup_path(scheme), common::OpenMode::ReadWrite, pragmas) {
+        out.exec("BEGIN IMMEDIATE;");
+        try {
+            common::create_rollup_schema(out);
+            out.exec("COMMIT;");
+        } catch (...) {
+            try { out.exec("ROLLBACK;"); } catch (...) {}
+            throw;
+        }
+        auto st = out.prepare("SELECT source, last_rowid FROM rollup_watermark;");
+        while (st->step()) sources[std::string(st->column_text(0))].last_rowid = st->column_int64(1);
+    }
 
-    int sent = j["sent_packets"].get<int>();
-    int dropped = j["dropped_packets"].get<int>();
-    if (sent <= 0) { err = "sent_packets must be > 0"; return false; }
-    if (dropped < 0 || dropped > sent) { err = "dropped_packets must be in [0,sent_packets]"; return false; }
+    // Brings every raw file up to date, then drops rollup buckets older than
+    // their tier's retention (0 = forever).
+    void pass(std::int64_t now, std::int64_t minute_retention, std::int64_t hour_retention) {
+        auto started = std::chrono::steady_clock::now();
+        auto present = scheme.list();
 
-    double lq = j["link_quality"].get<double>();
-    if (lq < 0.0 || lq > 1.0) { err = "link_quality out of range [0,1]"; return false; }
+        for (auto& p : present) {
+            std::string name = common::rollup_source(p.path);
+            auto mtime = modified(p);
+            Source src;
+            {
+                std::lock_guard<std::mutex> lock(mu);
+                src = sources[name];
+            }
+            if (src.drained && src.mtime == mtime) continue;
+            src.mtime = mtime;
+            fold(p, name, src);
+            std::lock_guard<std::mutex> lock(mu);
+            sources[name] = src;
+        }
 
-    return true;
+        // Forget files removed by retention, so a partition recreated under the
+        // same name by a late event starts again from rowid 0.
+        std::vector<std::string> gone;
+        {
+            std::lock_guard<std::mutex> lock(mu);
+            for (auto it = sources.begin(); it != sources.end();) {
+                bool found = std::any_of(present.begin(), present.end(), [&](const common::Partition& p) {
+                    return common::rollup_source(p.path) == it->first;
+                });
+                if (found) {
+                    ++it;
+                } else {
+                    gone.push_back(it->first);
+                    it = sources.erase(it);
+                }
+            }
+        }
+        for (auto& name : gone) {
+            auto del = out.prepare("DELETE FROM rollup_watermark WHERE source = ?;");
+            del->bind(1, std::string_view(name));
+            del->step();
+        }
+
+        if (minute_retention > 0) expire_buckets(common::RollupTier::Minute, now - minute_retention);
+        if (hour_retention > 0) expire_buckets(common::RollupTier::Hour, now - hour_retention);
+
+        g_rollup_passes++;
+        g_rollup_pass_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - started).count();
+    }
+
+    // True once every row of p has been folded in and it has not been written
+    // to since; retention waits for this before unlinking a partition.
+    bool caught_up(const common::Partition& p) {
+        std::lock_guard<std::mutex> lock(mu);
+        auto it = sources.find(common::rollup_source(p.path));
+        return it != sources.end() && it->second.drained && it->second.mtime == modified(p);
+    }
+
+    // Single-file layout: deletes raw rows older than `before` that have
+    // already been rolled up, in short transactions so the ingest writer is
+    // never locked out for long. The newest row is always kept so the rowid
+    // sequence (and with it the watermark) never restarts.
+    void expire_raw(std::int64_t before) {
+        if (scheme.partitioned()) return;
+        std::int64_t wm;
+        {
+            std::lock_guard<std::mutex> lock(mu);
+            wm = sources[common::rollup_source(scheme.partition_for(0).path)].last_rowid;
+        }
+        if (!raw) raw = std::make_unique<common::Connection>(scheme.root(), common::OpenMode::ReadWrite, pragmas);
+        const std::int64_t kChunk = 5000;
+        while (true) {
+            auto del = raw->prepare(
+                "DELETE FROM telemetry WHERE rowid IN (SELECT rowid FROM telemetry WHERE ts_ms < ? AND rowid <= ? "
+                "AND rowid < (SELECT max(rowid) FROM telemetry) LIMIT ?);");
+            del->bind(1, before);
+            del->bind(2, wm);
+            del->bind(3, kChunk);
+            del->step();
+            int n = raw->changes();
+            g_raw_rows_expired += n;
+            if (n < kChunk) break;
+        }
+    }
+
+private:
+    struct Source {
+        std::int64_t last_rowid = 0;
+        bool drained = false;
+        std::filesystem::file_time_type mtime{};
+    };
+
+    using Buckets = std::map<std::pair<std::string, std::int64_t>, common::RollupAgg>;
+
+    // Latest write to the file or its WAL.
+    static std::filesystem::file_time_type modified(const common::Partition& p) {
+        std::error_code ec;
+        auto t = std::filesystem::last_write_time(p.path, ec);
+        auto w = std::filesystem::last_write_time(p.path + "-wal", ec);
+        if (!ec) t = std::max(t, w);
+        return t;
+    }
+
+    void fold(const common::Partition& p, const std::string& name, Source& src) {
+        common::Connection in(p.path, common::OpenMode::ReadOnly, pragmas);
+        int version = common::schema_version(in);
+        if (version == common::kSchemaNone) return;
+
+        {
+            // A file that shrank below the watermark was recreated.
+            auto st = in.prepare("SELECT coalesce(max(rowid), 0), min(ts_ms) FROM telemetry;");
+            if (st->step() && st->column_int64(0) < src.last_rowid) {
+                spdlog::warn("rollup source {} restarted below its watermark; refolding", name);
+                std::optional<std::int64_t> oldest;
+                if (!st->column_is_null(1)) oldest = st->column_int64(1);
+                restart(p, name, src, oldest);
+            }
+        }
+
+        while (true) {
+            Buckets minutes, hours;
+            std::size_t rows = 0;
+            std::int64_t last = src.last_rowid;
+            std::int64_t newest = 0;
+            {
+                auto st = in.prepare(common::tail_sql(version));
+                st->bind(1, src.last_rowid);
+                st->bind(2, (std::int64_t)chunk_rows);
+                while (st->step()) {
+                    last = st->column_int64(0);
+                    std::string sat(st->column_text(1));
+                    std::int64_t ts = st->column_int64(2);
+                    double latency = st->column_double(3);
+                    std::int64_t dropped = st->column_int64(4), sent = st->column_int64(5);
+                    double lq = st->column_double(6);
+                    minutes[{sat, bucket_of(ts, common::RollupTier::Minute)}].add(latency, dropped, sent, lq);
+                    hours[{std::move(sat), bucket_of(ts, common::RollupTier::Hour)}].add(latency, dropped, sent, lq);
+                    newest = std::max(newest, ts);
+                    rows++;
+                }
+            }
+            if (rows == 0) {
+                src.drained = true;
+                return;
+            }
+
+            out.exec("BEGIN IMMEDIATE;");
+            try {
+                write(common::RollupTier::Minute, minutes);
+                write(common::RollupTier::Hour, hours);
+                auto wm = out.prepare("INSERT OR REPLACE INTO rollup_watermark(source, last_rowid) VALUES(?, ?);");
+                wm->bind(1, std::string_view(name));
+                wm->bind(2, last);
+                wm->step();
+                out.exec("COMMIT;");
+            } catch (...) {
+                try { out.exec("ROLLBACK;"); } catch (...) {}
+                throw;
+            }
+
+            src.last_rowid = last;
+            src.drained = false;
+            publish(name, src);
+            g_rollup_rows += (long long)rows;
+            g_rollup_buckets += (long long)(minutes.size() + hours.size());
+            if (newest > g_rollup_newest_ts.load()) g_rollup_newest_ts = newest;
+            if (rows < chunk_rows) {
+                src.drained = true;
+                return;
+            }
+        }
+    }
+
+    // Keeps the in-memory watermark level with the committed one, so a later
+    // chunk failing cannot send the next pass over rows already folded in.
+    void publish(const std::string& name, const Source& src) {
+        std::lock_guard<std::mutex> lock(mu);
+        sources[name] = src;
+    }
+
+    // Drops what the source's previous incarnation contributed, so the refold
+    // replaces its buckets instead of adding to them: a partition's whole
+    // span, or for the single file everything from the new file's oldest row
+    // on (older buckets outlive their raw rows by design). Resets the
+    // watermark in the same transaction.
+    void restart(const common::Partition& p, const std::string& name, Source& src, std::optional<std::int64_t> oldest) {
+        out.exec("BEGIN IMMEDIATE;");
+        try {
+            for (common::RollupTier t : {common::RollupTier::Minute, common::RollupTier::Hour}) {
+                if (!scheme.partitioned() && !oldest) continue;
+                std::int64_t from = scheme.partitioned() ? p.start_ms : bucket_of(*oldest, t);
+                auto del = out.prepare(std::string("DELETE FROM ") + common::tier_table(t) +
+                                       " WHERE bucket_ms >= ? AND bucket_ms < ?;");
+                del->bind(1, from);
+                del->bind(2, p.end_ms);
+                del->step();
+            }
+            auto wm = out.prepare("INSERT OR REPLACE INTO rollup_watermark(source, last_rowid) VALUES(?, 0);");
+            wm->bind(1, std::string_view(name));
+            wm->step();
+            out.exec("COMMIT;");
+        } catch (...) {
+            try { out.exec("ROLLBACK;"); } catch (...) {}
+            throw;
+        }
+        src.last_rowid = 0;
+        src.drained = false;
+        publish(name, src);
+    }
+
+    static std::int64_t bucket_of(std::int64_t ts, common::RollupTier t) {
+        std::int64_t w = common::tier_width_ms(t);
+        return ts - ((ts % w) + w) % w;
+    }
+
+    void write(common::RollupTier t, Buckets& buckets) {
+        std::string select_sql = common::rollup_select_bucket_sql(t);
+        std::string upsert_sql = common::rollup_upsert_sql(t);
+        for (auto& [key, agg] : buckets) {
+            {
+                auto sel = out.prepare(select_sql);
+                sel->bind(1, std::string_view(key.first));
+                sel->bind(2, key.second);
+                if (sel->step()) agg.merge(common::RollupAgg::from_row(*sel, 0));
+            }
+            std::string sketch = agg.latency.serialize();
+            auto up = out.prepare(upsert_sql);
+            up->bind(1, std::string_view(key.first));
+            up->bind(2, key.second);
+            up->bind(3, agg.count);
+            up->bind(4, agg.sum_dropped);
+            up->bind(5, agg.sum_sent);
+            up->bind(6, agg.sum_link_quality);
+            up->bind(7, agg.min_link_quality);
+            up->bind(8, agg.max_link_quality);
+            up->bind_blob(9, sketch.data(), (int)sketch.size());
+            up->step();
+        }
+    }
+
+    void expire_buckets(common::RollupTier t, std::int64_t before) {
+        auto del = out.prepare(std::string("DELETE FROM ") + common::tier_table(t) + " WHERE bucket_ms < ?;");
+        del->bind(1, before);
+        del->step();
+    }
+
+    common::PartitionScheme scheme;
+    common::StoragePragmas pragmas;
+    const std::size_t chunk_rows;
+    common::Connection out;
+    std::unique_ptr<common::Connection> raw;
+
+    std::mutex mu;  // sources: pass() runs on the rollup thread, caught_up() on maintenance
+    std::map<std::string, Source> sources;
+};
+
+// Single writer thread in front of the database. HTTP handlers enqueue jobs
+// (one or more events) and block on a future; the writer drains jobs until it
+// has max_batch events (or whatever arrived within max_delay of the first one)
+// and commits them in one transaction per partition touched, so the WAL is
+// synced once per batch instead of once per event. If one partition's commit
+// fails after another's succeeded, the whole batch is reported failed; a
+// client retry then sees the committed part as duplicates.
+class BatchWriter {
+public:
+    BatchWriter(PartitionSet& parts, std::size_t max_batch, std::chrono::milliseconds max_delay, std::size_t capacity)
+        : parts(parts), max_batch(std::max<std::size_t>(1, max_batch)), max_delay(max_delay),
+          capacity(std::max(capacity, this->max_batch)) {
+        thread = std::thread([this] { run(); });
+    }
+
+    ~BatchWriter() {
+        {
+            std::lock_guard<std::mutex> lock(mu);
+            stop = true;
+        }
+        not_empty.notify_all();
+        not_full.notify_all();
+        if (thread.joinable()) thread.join();
+    }
+
+    BatchWriter(const BatchWriter&) = delete;
+    BatchWriter& operator=(const BatchWriter&) = delete;
+
+    // Blocks while the queue is full. The future resolves once the job's batch
+    // has committed, with one flag per event: true if inserted, false if it was
+    // a duplicate.
+    std::future<std::vector<bool>> submit(std::vector<Event> events) {
+        Job job{std::move(events), {}};
+        auto fut = job.done.get_future();
+        std::size_t n = job.events.size();
+        {
+            std::unique_lock<std::mutex> lock(mu);
+            // An oversized job is admitted once the queue is empty.
+            not_full.wait(lock, [&] { return stop || queued_events == 0 || queued_events + n <= capacity; });
+            if (stop) throw std::runtime_error("writer stopped");
+            queued_events += n;
+            queue.push_back(std::move(job));
+        }
+        not_empty.notify_one();
+        return fut;
+    }
+
+    std::size_t depth() {
+        std::lock_guard<std::mutex> lock(mu);
+        return queued_events;
+    }
+
+private:
+    struct Job {
+        std::vector<Event> events;
+        std::promise<std::vector<bool>> done;
+    };
+
+    void run() {
+        std::vector<Job> batch;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mu);
+                not_empty.wait(lock, [this] { return stop || !queue.empty(); });
+                if (queue.empty()) return;
+
+                if (max_delay.count() > 0 && queued_events < max_batch) {
+                    auto deadline = std::chrono::steady_clock::now() + max_delay;
+                    not_empty.wait_until(lock, deadline, [this] { return stop || queued_events >= max_batch; });
+                }
+
+                std::size_t n = 0;
+                while (!queue.empty() && (n == 0 || n + queue.front().events.size() <= max_batch)) {
+                    n += queue.front().events.size();
+                    batch.push_back(std::move(queue.front()));
+                    queue.pop_front();
+                }
+                queued_events -= n;
+            }
+            not_full.notify_all();
+
+            commit(batch);
+            batch.clear();
+        }
+    }
+
+    // Events of one batch may span partitions: each touched partition gets its
+    // own transaction, opened on first use and committed together at the end.
+    void commit(std::vector<Job>& batch) {
+        std::vector<std::vector<bool>> inserted;
+        std::size_t n = 0;
+        for (int attempt = 0;; attempt++) {
+            inserted.clear();
+            inserted.reserve(batch.size());
+            n = 0;
+            std::vector<std::shared_ptr<Sqlite>> txns;
+            std::size_t committed = 0;
+            try {
+                try {
+                    Sqlite* db = nullptr;
+                    common::Partition p;
+                    for (auto& job : batch) {
+                        auto& flags = inserted.emplace_back();
+                        flags.reserve(job.events.size());
+                        for (auto& ev : job.events) {
+                            if (!db || ev.ts_ms < p.start_ms || ev.ts_ms >= p.end_ms) db = open(ev.ts_ms, p, txns);
+                            flags.push_back(db->insert_event(ev));
+                        }
+                        n += job.events.size();
+                    }
+                    for (; committed < txns.size(); committed++) txns[committed]->commit();
+                } catch (...) {
+                    for (std::size_t i = committed; i < txns.size(); i++) txns[i]->rollback();
+                    throw;
+                }
+                break;
+            } catch (...) {
+                // One retry if the table layout changed underneath us (and
+                // nothing has been committed yet).
+                bool changed = false;
+                if (attempt == 0 && committed == 0) {
+                    for (auto& db : txns) changed = db->refresh_schema() || changed;
+                }
+                if (changed) continue;
+                g_write_failures++;
+                auto err = std::current_exception();
+                for (auto& job : batch) job.done.set_exception(err);
+                return;
+            }
+        }
+
+        g_write_batches++;
+        g_write_batch_events += (long long)n;
+        for (std::size_t i = 0; i < batch.size(); i++) batch[i].done.set_value(std::move(inserted[i]));
+    }
+
+    Sqlite* open(std::int64_t ts_ms, common::Partition& p, std::vector<std::shared_ptr<Sqlite>>& txns) {
+        auto db = parts.get(ts_ms, p);
+        for (auto& t : txns) if (t == db) return t.get();
+        db->begin();
+        txns.push_back(std::move(db));
+        return txns.back().get();
+    }
+
+    PartitionSet& parts;
+    const std::size_t max_batch;
+    const std::chrono::milliseconds max_delay;
+    const std::size_t capacity;
+
+    std::mutex mu;
+    std::condition_variable not_empty;
+    std::condition_variable not_full;
+    std::deque<Job> queue;
+    std::size_t queued_events = 0;
+    bool stop = false;
+    std::thread thread;
+};
+
+// Non-blank lines of an application/x-ndjson body.
+static std::vector<std::string_view> split_ndjson(std::string_view body) {
+    std::vector<std::string_view> lines;
+    std::size_t pos = 0;
+    while (pos <= body.size()) {
+        std::size_t eol = body.find('\n', pos);
+        if (eol == std::string_view::npos) eol = body.size();
+        std::string_view line = body.substr(pos, eol - pos);
+        pos = eol + 1;
+        if (line.find_first_not_of(" \t\r") != std::string_view::npos) lines.push_back(line);
+    }
+    return lines;
 }
 
 static std::atomic<long long> g_inserted{0};
 static std::atomic<long long> g_duplicates{0};
-static std::atomic<long long> g_health{0}, g_ready{0}, g_telemetry{0}, g_metrics{0};
+static common::LogSampler g_accept_log(common::env_int("INGEST_ACCEPT_LOG_EVERY", 100));
+static std::atomic<long long> g_decode_fast{0};
+static std::atomic<long long> g_decode_fallback{0};
+
+// INGEST_JSON_DECODER=nlohmann disables the schema-specialized decoder.
+static bool g_fast_json = true;
+
+// Decodes one JSON event. Returns false with err set when the event fails
+// validation; throws on malformed JSON exactly as json::parse does.
+static bool decode_event(std::string_view body, Event& ev, std::string& err) {
+    if (g_fast_json) {
+        common::EventView v;
+        switch (common::decode_event_json(body, v, err)) {
+            case common::DecodeResult::Ok:
+                g_decode_fast++;
+                ev = event_from_view(v);
+                return true;
+            case common::DecodeResult::Invalid:
+                g_decode_fast++;
+                return false;
+            case common::DecodeResult::Fallback:
+                g_decode_fallback++;
+                break;
+        }
+    }
+    auto j = json::parse(body);
+    if (!common::validate_event(j, err)) return false;
+    ev = event_from_json(j);
+    return true;
+}
+static std::atomic<long long> g_health{0}, g_ready{0}, g_telemetry{0}, g_batch{0}, g_bin{0}, g_metrics{0};
+
+// Per-item bookkeeping shared by the multi-event routes: rejected items keep
+// their error, accepted ones are committed as a single writer job.
+struct PendingBatch {
+    std::vector<json> results;
+    std::vector<Event> events;
+    std::vector<std::size_t> event_index;
+
+    explicit PendingBatch(std::size_t n) : results(n) {
+        events.reserve(n);
+        event_index.reserve(n);
+    }
+
+    void accept(std::size_t i, Event ev) {
+        events.push_back(std::move(ev));
+        event_index.push_back(i);
+    }
+
+    void reject(std::size_t i, const std::string& err) {
+        if (i >= results.size()) results.resize(i + 1);
+        results[i] = {{"index",i},{"status","error"},{"error",err}};
+    }
+};
+
+static void commit_batch(BatchWriter& writer, PendingBatch& batch, httplib::Response& res) {
+    long long inserted = 0, duplicates = 0;
+    if (!batch.events.empty()) {
+        std::vector<bool> flags;
+        try {
+            flags = writer.submit(std::move(batch.events)).get();
+        } catch (const std::exception& e) {
+            spdlog::error("batch write failed: {}", e.what());
+            res.status = 500;
+            res.set_content(json{{"ok",false},{"error",std::string("error: ")+e.what()}}.dump(), "application/json");
+            return;
+        }
+        for (std::size_t k = 0; k < flags.size(); k++) {
+            if (flags[k]) inserted++; else duplicates++;
+            batch.results[batch.event_index[k]] = {{"index",batch.event_index[k]},{"status",flags[k] ? "inserted" : "duplicate"}};
+        }
+        g_inserted += inserted;
+        g_duplicates += duplicates;
+    }
 
-static std::string prometheus_metrics() {
+    std::size_t count = batch.results.size();
+    long long errors = (long long)count - inserted - duplicates;
+    if (errors > 0) {
+        spdlog::warn("batch rejected {} of {} events", errors, count);
+    }
+    if (g_accept_log.sample()) {
+        spdlog::info("accepted batch events={} inserted={} duplicates={} errors={}",
+                     count, inserted, duplicates, errors);
+    }
+
+    res.status = 202;
+    res.set_content(json{
+        {"ok", errors == 0},
+        {"count", count},
+        {"inserted", inserted},
+        {"duplicates", duplicates},
+        {"errors", errors},
+        {"results", batch.results}
+    }.dump(), "application/json");
+}
+
+static std::string prometheus_metrics(BatchWriter& writer, PartitionSet& parts) {
     std::ostringstream out;
     out << "# TYPE telemetry_inserted_total counter\n";
     out << "telemetry_inserted_total " << g_inserted.load() << "\n";
     out << "# TYPE telemetry_duplicates_total counter\n";
     out << "telemetry_duplicates_total " << g_duplicates.load() << "\n";
+    out << "# TYPE access_log_suppressed_total counter\n";
+    out << "access_log_suppressed_total{service=\"ingest\"} " << g_accept_log.suppressed() << "\n";
+    out << common::logging_prom("ingest");
+    out << "# TYPE telemetry_json_decode_total counter\n";
+    out << "telemetry_json_decode_total{path=\"fast\"} " << g_decode_fast.load() << "\n";
+    out << "telemetry_json_decode_total{path=\"fallback\"} " << g_decode_fallback.load() << "\n";
+    out << "# TYPE telemetry_write_batches_total counter\n";
+    out << "telemetry_write_batches_total " << g_write_batches.load() << "\n";
+    out << "# TYPE telemetry_write_batch_events_total counter\n";
+    out << "telemetry_write_batch_events_total " << g_write_batch_events.load() << "\n";
+    out << "# TYPE telemetry_write_failures_total counter\n";
+    out << "telemetry_write_failures_total " << g_write_failures.load() << "\n";
+    out << "# TYPE telemetry_write_queue_depth gauge\n";
+    out << "telemetry_write_queue_depth " << writer.depth() << "\n";
+    out << "# TYPE telemetry_partitions_open gauge\n";
+    out << "telemetry_partitions_open " << parts.open_count() << "\n";
+    out << "# TYPE telemetry_partitions_opened_total counter\n";
+    out << "telemetry_partitions_opened_total " << g_partitions_opened.load() << "\n";
+    out << "# TYPE telemetry_partitions_dropped_total counter\n";
+    out << "telemetry_partitions_dropped_total " << g_partitions_dropped.load() << "\n";
+    out << "# TYPE rollup_passes_total counter\n";
+    out << "rollup_passes_total " << g_rollup_passes.load() << "\n";
+    out << "# TYPE rollup_rows_total counter\n";
+    out << "rollup_rows_total " << g_rollup_rows.load() << "\n";
+    out << "# TYPE rollup_buckets_written_total counter\n";
+    out << "rollup_buckets_written_total " << g_rollup_buckets.load() << "\n";
+    out << "# TYPE rollup_last_pass_duration_ms gauge\n";
+    out << "rollup_last_pass_duration_ms " << g_rollup_pass_ms.load() << "\n";
+    out << "# TYPE rollup_newest_ts_ms gauge\n";
+    out << "rollup_newest_ts_ms " << g_rollup_newest_ts.load() << "\n";
+    out << "# TYPE telemetry_raw_rows_expired_total counter\n";
+    out << "telemetry_raw_rows_expired_total " << g_raw_rows_expired.load() << "\n";
     out << "# TYPE http_requests_total counter\n";
     out << "http_requests_total{service=\"ingest\",route=\"/health\"} " << g_health.load() << "\n";
     out << "http_requests_total{service=\"ingest\",route=\"/ready\"} " << g_ready.load() << "\n";
     out << "http_requests_total{service=\"ingest\",route=\"/telemetry\"} " << g_telemetry.load() << "\n";
+    out << "http_requests_total{service=\"ingest\",route=\"/telemetry/batch\"} " << g_batch.load() << "\n";
+    out << "http_requests_total{service=\"ingest\",route=\"/telemetry/bin\"} " << g_bin.load() << "\n";
     out << "http_requests_total{service=\"ingest\",route=\"/metrics\"} " << g_metrics.load() << "\n";
     return out.str();
 }
@@ -123,7 +910,57 @@ int main(int argc, char** argv) {
     int port = (argc > 1) ? std::atoi(argv[1]) : 8081;
     std::string db_path = (argc > 2) ? argv[2] : std::string("data/telemetry.db");
 
-    Sqlite db(db_path);
+    common::init_async_logging("ingest");
+    g_fast_json = common::env_str("INGEST_JSON_DECODER", "fast") != "nlohmann";
+
+    // TELEMETRY_PARTITION=hour|day turns db_path into a directory of
+    // per-period files; events stamped more than INGEST_MAX_FUTURE_S ahead
+    // are then rejected.
+    std::int64_t retention = common::env_int("TELEMETRY_RETENTION_HOURS", 0) * 3600 * 1000;
+    PartitionSet parts(common::PartitionScheme::from_env(db_path), common::StoragePragmas::from_env(), retention,
+                       common::env_int("INGEST_MAX_FUTURE_S", 86400) * 1000);
+    int schema = parts.get(now_ms())->version;
+
+    BatchWriter writer(parts,
+                       (std::size_t)common::env_int("INGEST_BATCH_MAX", 512),
+                       std::chrono::milliseconds(common::env_int("INGEST_BATCH_DELAY_MS", 2)),
+                       (std::size_t)common::env_int("INGEST_QUEUE_CAPACITY", 8192));
+
+    // ROLLUP_ENABLED=0 turns off the minute/hour rollups. With rollups on,
+    // TELEMETRY_RETENTION_HOURS is also the raw-data horizon of a single-file
+    // database, and partitions are only dropped once fully rolled up.
+    std::unique_ptr<RollupEngine> rollups;
+    std::unique_ptr<common::PeriodicTask> rollup_task;
+    if (common::env_int("ROLLUP_ENABLED", 1) != 0) {
+        rollups = std::make_unique<RollupEngine>(parts.layout(), common::StoragePragmas::from_env(),
+                                                 (std::size_t)common::env_int("ROLLUP_CHUNK_ROWS", 20000));
+        std::int64_t minute_retention = common::env_int("ROLLUP_MINUTE_RETENTION_HOURS", 24 * 7) * 3600 * 1000;
+        std::int64_t hour_retention = common::env_int("ROLLUP_HOUR_RETENTION_HOURS", 0) * 3600 * 1000;
+        rollup_task = std::make_unique<common::PeriodicTask>(
+            "rollup",
+            std::chrono::seconds(common::env_int("ROLLUP_INTERVAL_S", 10)),
+            [&rollups, minute_retention, hour_retention, retention] {
+                std::int64_t now = now_ms();
+                rollups->pass(now, minute_retention, hour_retention);
+                if (retention > 0) rollups->expire_raw(now - retention);
+            });
+    }
+
+    std::unique_ptr<common::PeriodicTask> maintenance;
+    if (parts.layout().partitioned()) {
+        std::int64_t precreate = common::env_int("INGEST_PARTITION_PRECREATE_S", 300) * 1000;
+        std::int64_t idle = common::env_int("INGEST_PARTITION_IDLE_S", 600) * 1000;
+        std::function<bool(const common::Partition&)> can_drop;
+        if (rollups) can_drop = [&rollups](const common::Partition& p) { return rollups->caught_up(p); };
+        maintenance = std::make_unique<common::PeriodicTask>(
+            "partition maintenance",
+            std::chrono::seconds(common::env_int("INGEST_PARTITION_MAINTENANCE_S", 30)),
+            [&parts, precreate, idle, can_drop] {
+                parts.maintain(now_ms(), precreate, idle, can_drop);
+            });
+    }
+
+    std::size_t max_items = (std::size_t)common::env_int("INGEST_BATCH_MAX_ITEMS", 10000);
     httplib::Server svr;
 
     svr.Get("/health", [](const httplib::Request&, httplib::Response& res) {
@@ -131,45 +968,151 @@ int main(int argc, char** argv) {
         res.set_content(R"({"ok":true})", "application/json");
     });
 
-    svr.Get("/ready", [&db](const httplib::Request&, httplib::Response& res) {
-        (void)db;
+    svr.Get("/ready", [](const httplib::Request&, httplib::Response& res) {
         g_ready++;
         res.set_content(R"({"ok":true})", "application/json");
     });
 
-    svr.Get("/metrics", [](const httplib::Request&, httplib::Response& res) {
+    svr.Get("/metrics", [&writer, &parts](const httplib::Request&, httplib::Response& res) {
         g_metrics++;
-        res.set_content(prometheus_metrics(), "text/plain; version=0.0.4");
+        res.set_content(prometheus_metrics(writer, parts), "text/plain; version=0.0.4");
     });
 
-    svr.Post("/telemetry", [&db](const httplib::Request& req, httplib::Response& res) {
+    // event_id is the dedupe key and is compared exactly: ids that differ
+    // only in case are different events, and each is exported as sent.
+    svr.Post("/telemetry", [&writer, &parts](const httplib::Request& req, httplib::Response& res) {
         g_telemetry++;
         try {
-            auto j = json::parse(req.body);
+            Event ev;
             std::string err;
-            if (!validate_event(j, err)) {
+            if (!decode_event(req.body, ev, err) || !parts.accepts(ev.ts_ms, now_ms(), err)) {
+                spdlog::warn("rejected event: {}", err);
                 res.status = 400;
                 res.set_content(json{{"ok",false},{"error",err}}.dump(), "application/json");
                 return;
             }
 
-            bool inserted = db.insert_event(j);
+            bool inserted = writer.submit({ev}).get()[0];
             if (inserted) g_inserted++; else g_duplicates++;
 
-            spdlog::info("accepted event_id={} sat_id={} inserted={}",
-                         j["event_id"].get<std::string>(),
-                         j["sat_id"].get<std::string>(),
-                         inserted);
+            if (g_accept_log.sample()) {
+                spdlog::info("accepted event_id={} sat_id={} inserted={}",
+                             ev.event_id,
+                             ev.sat_id,
+                             inserted);
+            }
 
             res.status = 202;
             res.set_content(json{{"ok",true},{"inserted",inserted}}.dump(), "application/json");
         } catch (const std::exception& e) {
+            spdlog::warn("rejected event: {}", e.what());
             res.status = 400;
             res.set_content(json{{"ok",false},{"error",std::string("error: ")+e.what()}}.dump(), "application/json");
         }
     });
 
-    spdlog::info("ingest listening on {} db={}", port, db_path);
+    svr.Post("/telemetry/batch", [&writer, &parts, max_items](const httplib::Request& req, httplib::Response& res) {
+        g_batch++;
+        std::int64_t now = now_ms();
+        auto too_large = [&] {
+            spdlog::warn("rejected batch: more than {} events", max_items);
+            res.status = 413;
+            res.set_content(json{{"ok",false},{"error","batch exceeds " + std::to_string(max_items) + " events"}}.dump(), "application/json");
+        };
+
+        if (req.get_header_value("Content-Type").find("ndjson") != std::string::npos) {
+            auto lines = split_ndjson(req.body);
+            if (lines.size() > max_items) return too_large();
+
+            PendingBatch batch(lines.size());
+            for (std::size_t i = 0; i < lines.size(); i++) {
+                Event ev;
+                std::string err;
+                try {
+                    if (decode_event(lines[i], ev, err) && parts.accepts(ev.ts_ms, now, err)) {
+                        batch.accept(i, std::move(ev));
+                        continue;
+                    }
+                } catch (const std::exception& e) {
+                    err = std::string("error: ") + e.what();
+                }
+                batch.reject(i, err);
+            }
+            commit_batch(writer, batch, res);
+            return;
+        }
+
+        json items;
+        try {
+            items = json::parse(req.body);
+            if (!items.is_array()) throw std::runtime_error("expected a JSON array of events");
+        } catch (const std::exception& e) {
+            spdlog::warn("rejected batch: {}", e.what());
+            res.status = 400;
+            res.set_content(json{{"ok",false},{"error",std::string("error: ")+e.what()}}.dump(), "application/json");
+            return;
+        }
+        if (items.size() > max_items) return too_large();
+
+        PendingBatch batch(items.size());
+        for (std::size_t i = 0; i < items.size(); i++) {
+            std::string err;
+            try {
+                if (common::validate_event(items[i], err)) {
+                    Event ev = event_from_json(items[i]);
+                    if (parts.accepts(ev.ts_ms, now, err)) {
+                        batch.accept(i, std::move(ev));
+                        continue;
+                    }
+                }
+            } catch (const std::exception& e) {
+                err = std::string("error: ") + e.what();
+            }
+            batch.reject(i, err);
+        }
+
+        commit_batch(writer, batch, res);
+    });
+
+    svr.Post("/telemetry/bin", [&writer, &parts, max_items](const httplib::Request& req, httplib::Response& res) {
+        g_bin++;
+        std::int64_t now = now_ms();
+        PendingBatch batch(0);
+
+        common::FrameReader reader(req.body);
+        common::EventView view;
+        std::string err;
+        for (std::size_t i = 0;; i++) {
+            auto st = reader.next(view, err);
+            if (st == common::FrameReader::Status::End) break;
+            if (st == common::FrameReader::Status::Error) {
+                spdlog::warn("rejected binary batch at event {}: {}", i, err);
+                res.status = 400;
+                res.set_content(json{{"ok",false},{"error",err},{"index",i}}.dump(), "application/json");
+                return;
+            }
+            if (i >= max_items) {
+                spdlog::warn("rejected binary batch: more than {} events", max_items);
+                res.status = 413;
+                res.set_content(json{{"ok",false},{"error","batch exceeds " + std::to_string(max_items) + " events"}}.dump(), "application/json");
+                return;
+            }
+            if (st == common::FrameReader::Status::Event && common::validate_ranges(view, err) &&
+                parts.accepts(view.ts_ms, now, err)) {
+                batch.accept(i, event_from_view(view));
+                batch.results.emplace_back();
+            } else {
+                batch.reject(i, err);
+            }
+        }
+
+        commit_batch(writer, batch, res);
+    });
+
+    spdlog::info("ingest listening on {} db={} partition={} schema=v{} json_decoder={}",
+                 port, db_path, common::env_str("TELEMETRY_PARTITION", "none"), schema,
+                 g_fast_json ? "fast" : "nlohmann");
     svr.listen("0.0.0.0", port);
+    spdlog::shutdown();
     return 0;
 }
\ No newline at end of file
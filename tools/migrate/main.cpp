@@ -0,0 +1,159 @@
+// Online, resumable upgrade of a telemetry database from schema v1 to v2
+// (see common/schema.hpp).
+//
+//   telemetry_migrate <db_path> [--chunk ROWS] [--pause-ms MS]
+//
+// Rows are copied into a staging table in rowid order, one short write
+// transaction per chunk, with the progress watermark committed alongside each
+// chunk. Ingest keeps writing to the v1 table meanwhile; its new rows get
+// higher rowids and are picked up by later chunks. Once the remaining tail is
+// smaller than one chunk, a final transaction copies it, drops the v1 table
+// and renames the staging table into place. Ingest and the aggregator notice
+// the new layout on their next failed statement and switch over.
+//
+// Rows keep their rowids, so rollup and tail watermarks taken against the v1
+// table stay valid across the cutover.
+//
+// Interrupting the tool at any point is safe; rerunning it resumes from the
+// last committed chunk.
+#include <spdlog/spdlog.h>
+#include <sqlite3.h>
+
+#include "common/schema.hpp"
+#include "common/storage.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <string>
+#include <thread>
+
+static void uuid_key_fn(sqlite3_context* ctx, int, sqlite3_value** argv) {
+    if (sqlite3_value_type(argv[0]) != SQLITE_TEXT) {
+        sqlite3_result_value(ctx, argv[0]);
+        return;
+    }
+    std::string_view id(reinterpret_cast<const char*>(sqlite3_value_text(argv[0])),
+                        (std::size_t)sqlite3_value_bytes(argv[0]));
+    common::EventKey key(id);
+    if (key.uuid) sqlite3_result_blob(ctx, key.bytes, (int)sizeof(key.bytes), SQLITE_TRANSIENT);
+    else sqlite3_result_value(ctx, argv[0]);
+}
+
+static std::int64_t query_int(common::Connection& c, const char* sql) {
+    auto st = c.prepare(sql);
+    return st->step() ? st->column_int64(0) : 0;
+}
+
+static void copy_range(common::Connection& c, std::int64_t lo, std::int64_t hi) {
+    {
+        auto st = c.prepare(
+            "INSERT OR IGNORE INTO satellites(sat_id) "
+            "SELECT DISTINCT sat_id FROM telemetry WHERE rowid > ?1 AND rowid <= ?2;");
+        st->bind(1, lo);
+        st->bind(2, hi);
+        st->step();
+    }
+    {
+        auto st = c.prepare(
+            "INSERT OR IGNORE INTO telemetry_v2(rowid,event_id,sat_key,ts_ms,latency_ms,dropped_packets,sent_packets,link_quality) "
+            "SELECT t.rowid, uuid_key(t.event_id), s.sat_key, t.ts_ms, t.latency_ms, t.dropped_packets, t.sent_packets, t.link_quality "
+            "FROM telemetry t JOIN satellites s ON s.sat_id = t.sat_id "
+            "WHERE t.rowid > ?1 AND t.rowid <= ?2;");
+        st->bind(1, lo);
+        st->bind(2, hi);
+        st->step();
+    }
+    auto st = c.prepare("UPDATE telemetry_migration SET last_rowid = ? WHERE id = 1;");
+    st->bind(1, hi);
+    st->step();
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        spdlog::error("usage: telemetry_migrate <db_path> [--chunk ROWS] [--pause-ms MS]");
+        return 2;
+    }
+    std::string db_path = argv[1];
+    std::int64_t chunk = 20000;
+    int pause_ms = 50;
+    for (int i = 2; i + 1 < argc; i += 2) {
+        std::string flag = argv[i];
+        if (flag == "--chunk") chunk = std::max<std::int64_t>(1, std::atoll(argv[i + 1]));
+        else if (flag == "--pause-ms") pause_ms = std::max(0, std::atoi(argv[i + 1]));
+        else {
+            spdlog::error("unknown option {}", flag);
+            return 2;
+        }
+    }
+
+    try {
+        common::Connection c(db_path, common::OpenMode::ReadWrite, common::StoragePragmas::from_env());
+        if (sqlite3_create_function(c.handle(), "uuid_key", 1, SQLITE_UTF8 | SQLITE_DETERMINISTIC,
+                                    nullptr, uuid_key_fn, nullptr, nullptr) != SQLITE_OK) {
+            throw std::runtime_error(std::string("register uuid_key failed: ") + sqlite3_errmsg(c.handle()));
+        }
+
+        int version = common::schema_version(c);
+        if (version == common::kSchemaV2) {
+            spdlog::info("{} is already on schema v2", db_path);
+            return 0;
+        }
+        if (version != common::kSchemaV1) {
+            spdlog::error("{} has no v1 telemetry table (schema v{})", db_path, version);
+            return 1;
+        }
+
+        c.exec("BEGIN IMMEDIATE;");
+        common::create_schema_v2(c, "telemetry_v2");
+        c.exec("CREATE TABLE IF NOT EXISTS telemetry_migration ("
+               "id INTEGER PRIMARY KEY CHECK (id = 1), last_rowid INTEGER NOT NULL);");
+        c.exec("INSERT OR IGNORE INTO telemetry_migration(id, last_rowid) VALUES(1, 0);");
+        c.exec("COMMIT;");
+
+        std::int64_t last = query_int(c, "SELECT last_rowid FROM telemetry_migration WHERE id = 1;");
+        if (last > 0) spdlog::info("resuming after rowid {}", last);
+
+        auto t0 = std::chrono::steady_clock::now();
+        while (true) {
+            std::int64_t max_rowid = query_int(c, "SELECT coalesce(max(rowid), 0) FROM telemetry;");
+            if (max_rowid - last <= chunk) break;
+
+            c.exec("BEGIN IMMEDIATE;");
+            try {
+                copy_range(c, last, last + chunk);
+                c.exec("COMMIT;");
+            } catch (...) {
+                try { c.exec("ROLLBACK;"); } catch (...) {}
+                throw;
+            }
+            last += chunk;
+            spdlog::info("copied through rowid {} of {}", last, max_rowid);
+            if (pause_ms > 0) std::this_thread::sleep_for(std::chrono::milliseconds(pause_ms));
+        }
+
+        c.exec("BEGIN IMMEDIATE;");
+        try {
+            copy_range(c, last, std::numeric_limits<std::int64_t>::max());
+            c.exec("DROP TABLE telemetry;");
+            c.exec("ALTER TABLE telemetry_v2 RENAME TO telemetry;");
+            c.exec("DROP TABLE telemetry_migration;");
+            c.exec("PRAGMA user_version=2;");
+            c.exec("COMMIT;");
+        } catch (...) {
+            try { c.exec("ROLLBACK;"); } catch (...) {}
+            throw;
+        }
+
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        spdlog::info("{} migrated to schema v2: {} rows, {} satellites in {:.1f}s; run VACUUM to reclaim space",
+                     db_path, query_int(c, "SELECT count(*) FROM telemetry;"),
+                     query_int(c, "SELECT count(*) FROM satellites;"), secs);
+        return 0;
+    } catch (const std::exception& e) {
+        spdlog::error("migration failed: {}", e.what());
+        return 1;
+    }
+}